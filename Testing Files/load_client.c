@@ -0,0 +1,319 @@
+/**
+ *  Load generator for the socket server of the image database. It opens a
+ *  number of connections to the server and keeps a number of QUERY
+ *  OPERATIONS in flight on each, taken in turn from a query file. Once
+ *  every response is in, it reports the requests per second and the p50
+ *  and p99 latency of a request, from its send to its response.
+ *
+ *  Usage: load_client [-c <CONNECTIONS>] [-d <DEPTH>] [-n <REQUESTS>]
+ *  <SOCKET PATH> <QUERY FILE>
+ **/
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "utils.h"
+
+#define USAGE_MSG "Usage: %s [-c <CONNECTIONS>] [-d <DEPTH>] " \
+  "[-n <REQUESTS>] <SOCKET PATH> <QUERY FILE>\n"
+
+// Size of the buffer responses are read into
+#define READ_SIZE	(1 << 16)
+// Longest QUERY OPERATION sent, with its newline character [Longer ones in
+// the query file are skipped]
+#define QUERY_SIZE	256
+
+
+struct Connection {
+	int fd;
+	// Requests waiting to be sent, and how much of them was sent
+	char *pending;
+	size_t used;
+	size_t sent;
+	// Send times of the requests in flight, oldest first, in a ring
+	double *send_times;
+	int oldest;
+	int num_in_flight;
+	// The next query to send, and the number of requests sent and answered
+	size_t next_query;
+	long num_sent;
+	long num_answered;
+	// The events the connection is registered for
+	unsigned int events;
+};
+
+/**
+ *  A helper function that returns the time in seconds.
+ **/
+static double helper_now(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+static int helper_compare_times(const void *a, const void *b) {
+  double first = *(const double *) a;
+  double second = *(const double *) b;
+  return (first > second) - (first < second);
+}
+
+/**
+ *  A helper function that reads the QUERY OPERATIONS of a file, each with
+ *  its newline character. Each is answered with exactly one line.
+ **/
+static char **helper_read_queries(const char *path, size_t *num_queries) {
+  char buf[QUERY_SIZE];
+  char **result = NULL;
+  size_t capacity = 0;
+  FILE *file = fopen(path, "r");
+  if (file == NULL) {
+    perror(path);
+    return NULL;
+  }
+  *num_queries = 0;
+  while (fgets(buf, QUERY_SIZE, file) != NULL) {
+    if ((buf[0] != QUERY) || (strchr(buf, '\n') == NULL)) {
+      continue;
+    }
+    if (*num_queries == capacity) {
+      capacity = (capacity == 0) ? 1024 : (capacity * 2);
+      result = realloc(result, sizeof(char *) * capacity);
+      if (result == NULL) {
+	perror("realloc");
+	exit(1);
+      }
+    }
+    result[(*num_queries)++] = strdup(buf);
+  }
+  fclose(file);
+  if (*num_queries == 0) {
+    fprintf(stderr, "%s: no QUERY OPERATIONS\n", path);
+    free(result);
+    return NULL;
+  }
+  return result;
+}
+
+/**
+ *  A helper function that queues requests on a connection until its depth
+ *  is reached, and sends as many of them as its socket takes.
+ *
+ *  @return 0 on success, -1 if the server is gone.
+ **/
+static int helper_send(struct Connection *connection, char **queries,
+		       size_t num_queries, int depth, long num_requests) {
+  const char *query;
+  size_t length;
+  ssize_t size;
+  // Compact the requests already sent
+  if (connection->sent > 0) {
+    connection->used -= connection->sent;
+    memmove(connection->pending, connection->pending + connection->sent,
+	    connection->used);
+    connection->sent = 0;
+  }
+  while ((connection->num_in_flight < depth) &&
+	 (connection->num_sent < num_requests)) {
+    query = queries[connection->next_query];
+    connection->next_query = (connection->next_query + 1) % num_queries;
+    length = strlen(query);
+    memcpy(connection->pending + connection->used, query, length);
+    connection->used += length;
+    connection->send_times[(connection->oldest +
+			    connection->num_in_flight) % depth] =
+      helper_now();
+    connection->num_in_flight++;
+    connection->num_sent++;
+  }
+  while (connection->sent < connection->used) {
+    size = send(connection->fd, connection->pending + connection->sent,
+		connection->used - connection->sent, MSG_NOSIGNAL);
+    if (size >= 0) {
+      connection->sent += size;
+    }
+    else if (errno == EAGAIN) {
+      break;
+    }
+    else if (errno != EINTR) {
+      perror("send");
+      return -1;
+    }
+  }
+  return 0;
+}
+
+/**
+ *  A helper function that reads the responses of a connection, and notes
+ *  the latency of each request answered.
+ *
+ *  @return 0 on success, -1 if the server is gone.
+ **/
+static int helper_receive(struct Connection *connection, int depth,
+			  double *latencies, long *num_latencies) {
+  char buf[READ_SIZE];
+  ssize_t size = read(connection->fd, buf, READ_SIZE);
+  double now = helper_now();
+  ssize_t i;
+  if (size <= 0) {
+    if ((size < 0) && ((errno == EAGAIN) || (errno == EINTR))) {
+      return 0;
+    }
+    fprintf(stderr, "The server closed the connection\n");
+    return -1;
+  }
+  // Every line answers the oldest request in flight
+  for (i = 0; i < size; i++) {
+    if ((buf[i] == '\n') && (connection->num_in_flight > 0)) {
+      latencies[(*num_latencies)++] =
+	now - connection->send_times[connection->oldest];
+      connection->oldest = (connection->oldest + 1) % depth;
+      connection->num_in_flight--;
+      connection->num_answered++;
+    }
+  }
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  struct sockaddr_un address;
+  struct epoll_event events[64];
+  struct epoll_event event;
+  struct Connection *connections;
+  struct Connection *connection;
+  char **queries;
+  size_t num_queries;
+  double *latencies;
+  long num_latencies = 0;
+  double start, elapsed;
+  int num_connections = 1;
+  int depth = 1;
+  long num_requests = 10000;
+  int num_done = 0;
+  int epoll_fd, num_events, option, i;
+  while ((option = getopt(argc, argv, "c:d:n:")) != -1) {
+    if ((option == 'c') && (atoi(optarg) > 0)) {
+      num_connections = atoi(optarg);
+    }
+    else if ((option == 'd') && (atoi(optarg) > 0)) {
+      depth = atoi(optarg);
+    }
+    else if ((option == 'n') && (atol(optarg) > 0)) {
+      num_requests = atol(optarg);
+    }
+    else {
+      fprintf(stderr, USAGE_MSG, argv[0]);
+      return 1;
+    }
+  }
+  if ((optind + 2 != argc) ||
+      (strlen(argv[optind]) >= sizeof(address.sun_path))) {
+    fprintf(stderr, USAGE_MSG, argv[0]);
+    return 1;
+  }
+  queries = helper_read_queries(argv[optind + 1], &num_queries);
+  if (queries == NULL) {
+    return 1;
+  }
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strcpy(address.sun_path, argv[optind]);
+  epoll_fd = epoll_create1(0);
+  connections = calloc(num_connections, sizeof(struct Connection));
+  latencies = malloc(sizeof(double) * num_connections * num_requests);
+  if ((connections == NULL) || (latencies == NULL)) {
+    perror("malloc");
+    exit(1);
+  }
+  // Connect every connection before timing starts
+  for (i = 0; i < num_connections; i++) {
+    connection = &connections[i];
+    connection->fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if ((connection->fd == -1) ||
+	(connect(connection->fd, (struct sockaddr *) &address,
+		 sizeof(address)) == -1)) {
+      perror(argv[optind]);
+      return 1;
+    }
+    connection->pending = malloc((size_t) depth * QUERY_SIZE);
+    connection->send_times = malloc(sizeof(double) * depth);
+    if ((connection->pending == NULL) || (connection->send_times == NULL)) {
+      perror("malloc");
+      exit(1);
+    }
+    // Each connection starts at another query
+    connection->next_query = ((size_t) i * num_queries) / num_connections;
+    connection->events = EPOLLIN;
+    event.events = connection->events;
+    event.data.ptr = connection;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, connection->fd, &event);
+  }
+  start = helper_now();
+  for (i = 0; i < num_connections; i++) {
+    if (helper_send(&connections[i], queries, num_queries, depth,
+		    num_requests) == -1) {
+      return 1;
+    }
+  }
+  // Keep sending requests as responses come in, until every request of
+  // every connection is answered
+  while (num_done < num_connections) {
+    num_events = epoll_wait(epoll_fd, events, 64, -1);
+    if ((num_events == -1) && (errno != EINTR)) {
+      perror("epoll_wait");
+      return 1;
+    }
+    for (i = 0; i < num_events; i++) {
+      connection = events[i].data.ptr;
+      if (((events[i].events & EPOLLIN) &&
+	   (helper_receive(connection, depth, latencies,
+			   &num_latencies) == -1)) ||
+	  (helper_send(connection, queries, num_queries, depth,
+		       num_requests) == -1)) {
+	return 1;
+      }
+      if ((connection->num_answered == num_requests) &&
+	  (connection->events != 0)) {
+	num_done++;
+	connection->events = 0;
+	epoll_ctl(epoll_fd, EPOLL_CTL_DEL, connection->fd, NULL);
+      }
+      // Wait for room in the socket while requests are left unsent
+      else if (connection->events != 0) {
+	event.events = EPOLLIN |
+	  ((connection->sent < connection->used) ? EPOLLOUT : 0);
+	event.data.ptr = connection;
+	if (event.events != connection->events) {
+	  connection->events = event.events;
+	  epoll_ctl(epoll_fd, EPOLL_CTL_MOD, connection->fd, &event);
+	}
+      }
+    }
+  }
+  elapsed = helper_now() - start;
+  qsort(latencies, num_latencies, sizeof(double), helper_compare_times);
+  printf("%d connection(s), depth %d: %ld requests in %.2fs, %.0f req/s, "
+	 "p50 %.1fus, p99 %.1fus\n", num_connections, depth, num_latencies,
+	 elapsed, num_latencies / elapsed,
+	 latencies[num_latencies / 2] * 1e6,
+	 latencies[(num_latencies * 99) / 100] * 1e6);
+  for (i = 0; i < num_connections; i++) {
+    close(connections[i].fd);
+    free(connections[i].pending);
+    free(connections[i].send_times);
+  }
+  for (i = 0; (size_t) i < num_queries; i++) {
+    free(queries[i]);
+  }
+  free(queries);
+  free(connections);
+  free(latencies);
+  close(epoll_fd);
+  return 0;
+}
@@ -0,0 +1,100 @@
+/**
+ *  Runs a command on an input file, with its output discarded, and reports
+ *  the operations per second [One per input line] and peak RSS of the run.
+ *
+ *  Usage: measure <INPUT FILE> <COMMAND> [<ARGUMENTS>]
+ **/
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ *  A helper function that returns the time in seconds.
+ **/
+static double helper_now(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/**
+ *  A helper function that counts the lines of a file.
+ *
+ *  @param path The path of the file.
+ *  @return The number of lines, or -1 on failure.
+ **/
+static long helper_count_lines(const char *path) {
+  FILE *file = fopen(path, "r");
+  long result = 0;
+  int character;
+  if (file == NULL) {
+    perror(path);
+    return -1;
+  }
+  while ((character = getc(file)) != EOF) {
+    result += (character == '\n');
+  }
+  fclose(file);
+  return result;
+}
+
+int main(int argc, char **argv) {
+  struct rusage usage;
+  double start, elapsed;
+  long num_operations;
+  int status;
+  int fd;
+  pid_t child;
+  if (argc < 3) {
+    fprintf(stderr, "Usage: %s <INPUT FILE> <COMMAND> [<ARGUMENTS>]\n",
+	    argv[0]);
+    return 1;
+  }
+  num_operations = helper_count_lines(argv[1]);
+  if (num_operations == -1) {
+    return 1;
+  }
+  start = helper_now();
+  child = fork();
+  if (child == -1) {
+    perror("fork");
+    return 1;
+  }
+  // Run the command with the input file as standard input, and standard
+  // output discarded
+  if (child == 0) {
+    fd = open(argv[1], O_RDONLY);
+    if ((fd == -1) || (dup2(fd, STDIN_FILENO) == -1)) {
+      perror(argv[1]);
+      _exit(127);
+    }
+    fd = open("/dev/null", O_WRONLY);
+    if ((fd == -1) || (dup2(fd, STDOUT_FILENO) == -1)) {
+      perror("/dev/null");
+      _exit(127);
+    }
+    execvp(argv[2], &argv[2]);
+    perror(argv[2]);
+    _exit(127);
+  }
+  if (wait4(child, &status, 0, &usage) == -1) {
+    perror("wait4");
+    return 1;
+  }
+  elapsed = helper_now() - start;
+  if (!WIFEXITED(status) || (WEXITSTATUS(status) != 0)) {
+    fprintf(stderr, "%s failed\n", argv[2]);
+    return 1;
+  }
+  // ru_maxrss is in kilobytes
+  printf("%ld ops in %.2fs, %.0f ops/sec, peak RSS %.1f MB\n",
+	 num_operations, elapsed, num_operations / elapsed,
+	 usage.ru_maxrss / 1024.0);
+  return 0;
+}
@@ -0,0 +1,179 @@
+/**
+ *  Parser benchmark for the image database. An input file is read and
+ *  tokenized several times over, both by the old path [fgets into a
+ *  256-byte buffer, then strtok_r] and by the block reader and tokenize,
+ *  and the best throughput of each is reported in GB/s. The file is read
+ *  once first, so both are timed against the page cache.
+ *
+ *  Usage: parse_bench <INPUT FILE> [<ROUNDS>]
+ **/
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "reader.h"
+#include "utils.h"
+
+// Size of the line buffer of the old path
+#define OLD_BUFFER_SIZE	256
+// Number of times each path reads the file, unless given
+#define DEFAULT_ROUNDS	5
+
+/**
+ *  A helper function that returns the time in seconds.
+ **/
+static double helper_now(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+/**
+ *  A helper function that tokenizes a command as the old tokenize did, with
+ *  strtok_r.
+ *
+ *  @param cmd The command.
+ *  @param cmd_argv Holds the tokens.
+ *  @return The number of tokens, or -1 if the command is invalid.
+ **/
+static int helper_tokenize_strtok(char *cmd, char **cmd_argv) {
+  char *save_ptr;
+  char *some_token = strtok_r(cmd, DELIMITERS, &save_ptr);
+  int num_tokens = 0;
+  int num_parsed = 0;
+  if ((some_token == NULL) || (some_token[1] != '\0')) {
+    return -1;
+  }
+  if (some_token[0] == INSERT) {
+    num_tokens = 5;
+  }
+  else if (some_token[0] == QUERY) {
+    num_tokens = 4;
+  }
+  else if ((some_token[0] == PRINT) || (some_token[0] == STATS)) {
+    num_tokens = 1;
+  }
+  else if ((some_token[0] == SAVE) || (some_token[0] == LOAD) ||
+	   (some_token[0] == COMPACT)) {
+    num_tokens = 2;
+  }
+  for ( ; (num_parsed < num_tokens) && (some_token != NULL); num_parsed++) {
+    cmd_argv[num_parsed] = some_token;
+    some_token = strtok_r(NULL, DELIMITERS, &save_ptr);
+  }
+  return ((num_tokens > 0) && (num_parsed == num_tokens) &&
+	  (some_token == NULL)) ? num_parsed : -1;
+}
+
+/**
+ *  A helper function that parses a file by the old path.
+ *
+ *  @param path The path of the file.
+ *  @return The number of valid commands.
+ **/
+static long helper_parse_old(const char *path) {
+  char buf[OLD_BUFFER_SIZE];
+  char *args[INPUT_ARG_MAX_NUM];
+  long result = 0;
+  FILE *file = fopen(path, "r");
+  if (file == NULL) {
+    perror(path);
+    exit(1);
+  }
+  while (fgets(buf, OLD_BUFFER_SIZE, file) != NULL) {
+    result += (helper_tokenize_strtok(buf, args) != -1);
+  }
+  fclose(file);
+  return result;
+}
+
+/**
+ *  A helper function that parses a file by the block reader.
+ *
+ *  @param path The path of the file.
+ *  @return The number of valid commands.
+ **/
+static long helper_parse_new(const char *path) {
+  struct Reader reader;
+  char *args[INPUT_ARG_MAX_NUM];
+  char *line;
+  size_t length;
+  long result = 0;
+  int fd = open(path, O_RDONLY);
+  if (fd == -1) {
+    perror(path);
+    exit(1);
+  }
+  reader_init(&reader, fd);
+  while ((line = reader_next_line(&reader, &length)) != NULL) {
+    result += (tokenize(line, args) != -1);
+  }
+  reader_destroy(&reader);
+  close(fd);
+  return result;
+}
+
+/**
+ *  A helper function that times the best of several parses of a file, and
+ *  prints its throughput.
+ *
+ *  @param name The name of the path.
+ *  @param parse The path.
+ *  @param path The path of the file.
+ *  @param size The size of the file.
+ *  @param rounds The number of parses.
+ *  @param num_commands Set to the number of valid commands.
+ *  @return The throughput in GB/s.
+ **/
+static double helper_time(const char *name, long (*parse)(const char *),
+			  const char *path, off_t size, int rounds,
+			  long *num_commands) {
+  double best = 0;
+  double start, time;
+  int round;
+  for (round = 0; round < rounds; round++) {
+    start = helper_now();
+    *num_commands = parse(path);
+    time = helper_now() - start;
+    if ((round == 0) || (time < best)) {
+      best = time;
+    }
+  }
+  printf("%-24s %.3f GB/s (%ld commands, best of %d)\n", name,
+	 size / best / 1e9, *num_commands, rounds);
+  return size / best / 1e9;
+}
+
+int main(int argc, char **argv) {
+  struct stat info;
+  int rounds = (argc > 2) ? atoi(argv[2]) : DEFAULT_ROUNDS;
+  long old_commands, new_commands;
+  double old_speed, new_speed;
+  if ((argc < 2) || (rounds < 1)) {
+    fprintf(stderr, "Usage: %s <INPUT FILE> [<ROUNDS>]\n", argv[0]);
+    return 1;
+  }
+  if (stat(argv[1], &info) == -1) {
+    perror(argv[1]);
+    return 1;
+  }
+  // Warm the page cache
+  helper_parse_new(argv[1]);
+  old_speed = helper_time("fgets + strtok_r:", helper_parse_old, argv[1],
+			  info.st_size, rounds, &old_commands);
+  new_speed = helper_time("block reader + scans:", helper_parse_new,
+			  argv[1], info.st_size, rounds, &new_commands);
+  printf("Speedup: %.2fx\n", new_speed / old_speed);
+  // Both paths must agree on every line
+  if (old_commands != new_commands) {
+    fprintf(stderr, "Paths disagree: %ld and %ld valid commands\n",
+	    old_commands, new_commands);
+    return 1;
+  }
+  return 0;
+}
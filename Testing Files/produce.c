@@ -1,68 +1,330 @@
-# include <stdio.h>
-
-int main(){
-	// initialization
-	FILE * read;
-	FILE * write;
-	char word[100];
-	int i = 0;
-	int file_num = 1;
-
-	// opening 2 files for reading and writing
-	read = fopen("random" , "r");
-	if (!read){
-		perror("fopen");
-		return -1;
-	}
-	write = fopen("outfile", "w");
-	if (!write){
-		perror("fopen");
-		return -1;
-	}
-	// take the words and write it to outfile in the insert syntax
-	while (fscanf(read, "%99s", word) == 1){
-		if ((i % 3) == 0){
-			fprintf(write, "i %s ", word);
-		}
-		else if ((i % 3) == 1){
-			fprintf(write, "%s ", word);
-		}
-		else{
-			fprintf(write, "%s file%d\n", word, file_num);
-			file_num++;
-		}
-		i++;
-	}
-	// PRINT THE ENTIRE TREE
-	fprintf(write, "p\n");
-	fclose(read);
-	fclose(write);
-
-	// open another for the queries that is modified from the outfile
-	read = fopen("outfile", "r");
-	if (!read){
-		perror("fopen");
-		return -1;
-	}
-	write = fopen("queries", "w");
-	if (!write){
-		perror("fopen");
-		return -1;
-	}
-	i = 0;
-	while (fscanf(read, "%99s", word) == 1){
-		if ((i % 5) == 0){
-			fprintf(write, "q ");
-		}
-		else if ((i % 5) <= 3){
-			fprintf(write, "%s ", word);
-		}
-		else{
-			fprintf(write, "\n");
-		}
-		i++;
-	}
-	fclose(read);
-	fclose(write);
-	return 0;
-}
\ No newline at end of file
+/**
+ *  Workload generator for the image database. Writes a stream of INSERT,
+ *  QUERY and PRINT OPERATIONS to standard output [OR] to a file.
+ *
+ *  Usage: produce [-n <OPERATIONS>] [-c <A1>,<A2>,<A3>,<FILENAMES>]
+ *  [-z <SKEW>] [-d <DUPLICATE RATE>] [-m <INSERT>:<QUERY>:<PRINT>]
+ *  [-s <SEED>] [-w <WORD FILE>] [-o <OUTPUT FILE>]
+ *
+ *  -n: Number of operations. Defaults to 10000.
+ *  -c: Number of distinct values of each attribute, and of filenames.
+ *  Defaults to 100,100,100,1000000.
+ *  -z: Zipfian skew of the values of each level [0 draws them uniformly].
+ *  Defaults to 0. The most popular values are spread over the sort order.
+ *  -d: Fraction of INSERT OPERATIONS that repeat an earlier image.
+ *  Defaults to 0.
+ *  -m: Relative weights of INSERT, QUERY and PRINT OPERATIONS. Defaults to
+ *  100:0:0.
+ *  -s: Random seed. The same parameters and seed give the same workload.
+ *  Defaults to 1.
+ *  -w: Take attribute values from the words of a file [One per value, so
+ *  it caps the number of distinct values] instead of numbering them.
+ *  -o: Write to a file instead of standard output.
+ *
+ *  A QUERY OPERATION asks for the attributes of an earlier image, so it
+ *  finds at least that image.
+ **/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define USAGE_MSG "Usage: %s [-n <OPERATIONS>] " \
+  "[-c <A1>,<A2>,<A3>,<FILENAMES>] [-z <SKEW>] [-d <DUPLICATE RATE>] " \
+  "[-m <INSERT>:<QUERY>:<PRINT>] [-s <SEED>] [-w <WORD FILE>] " \
+  "[-o <OUTPUT FILE>]\n"
+
+// Number of levels of an image [Attributes 1-3; filename]
+#define NUM_LEVELS	4
+// Longest word taken from a word file
+#define WORD_SIZE	100
+
+
+// The values of one level, and how often each is drawn
+struct Level {
+	size_t cardinality;
+	// Cumulative weight of the values, by popularity rank
+	double *weights;
+	// The value of each popularity rank
+	size_t *values;
+};
+
+// Prefix of the numbered values of each level
+static const char *PREFIXES[NUM_LEVELS] = {"alpha", "beta", "gamma", "file"};
+
+// State of the random number generator [splitmix64]
+static unsigned long long state;
+
+/**
+ *  A helper function that returns a random 64 bit number.
+ **/
+static unsigned long long helper_random(void) {
+  unsigned long long result = (state += 0x9E3779B97F4A7C15ULL);
+  result = (result ^ (result >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  result = (result ^ (result >> 27)) * 0x94D049BB133111EBULL;
+  return result ^ (result >> 31);
+}
+
+/**
+ *  A helper function that returns a random number in [0, 1).
+ **/
+static double helper_uniform(void) {
+  return (helper_random() >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/**
+ *  A helper function that sets up the values of a level, drawn with the
+ *  given Zipfian skew: the value of rank k is drawn in proportion to
+ *  1 / k^skew.
+ *
+ *  @param level The level.
+ *  @param cardinality The number of distinct values.
+ *  @param skew The skew.
+ **/
+static void helper_init_level(struct Level *level, size_t cardinality,
+			      double skew) {
+  double total = 0;
+  size_t rank, other, swap;
+  level->cardinality = cardinality;
+  level->weights = malloc(sizeof(double) * cardinality);
+  level->values = malloc(sizeof(size_t) * cardinality);
+  if ((level->weights == NULL) || (level->values == NULL)) {
+    perror("malloc");
+    exit(1);
+  }
+  for (rank = 0; rank < cardinality; rank++) {
+    total += (skew == 0) ? 1 : (1 / pow(rank + 1, skew));
+    level->weights[rank] = total;
+    level->values[rank] = rank;
+  }
+  // Shuffle the values, so that popularity does not follow sort order
+  for (rank = cardinality - 1; rank > 0; rank--) {
+    other = helper_random() % (rank + 1);
+    swap = level->values[rank];
+    level->values[rank] = level->values[other];
+    level->values[other] = swap;
+  }
+}
+
+/**
+ *  A helper function that draws a value of a level.
+ *
+ *  @param level The level.
+ *  @return The value.
+ **/
+static size_t helper_draw(const struct Level *level) {
+  double target = helper_uniform() * level->weights[level->cardinality - 1];
+  // Binary search for the first rank whose cumulative weight is larger
+  size_t low = 0;
+  size_t high = level->cardinality - 1;
+  while (low < high) {
+    size_t middle = low + (high - low) / 2;
+    if (level->weights[middle] <= target) {
+      low = middle + 1;
+    }
+    else {
+      high = middle;
+    }
+  }
+  return level->values[low];
+}
+
+/**
+ *  A helper function that reads the distinct words of a file.
+ *
+ *  @param path The path of the file.
+ *  @param num_words Set to the number of words.
+ *  @return The words, or NULL on failure.
+ **/
+static char **helper_read_words(const char *path, size_t *num_words) {
+  char word[WORD_SIZE];
+  char **result = NULL;
+  size_t capacity = 0;
+  size_t i;
+  FILE *file = fopen(path, "r");
+  if (file == NULL) {
+    perror(path);
+    return NULL;
+  }
+  *num_words = 0;
+  while (fscanf(file, "%99s", word) == 1) {
+    // Skip repeated words [Word lists are short, so a scan will do]
+    for (i = 0; (i < *num_words) && (strcmp(result[i], word) != 0); i++) {
+    }
+    if (i < *num_words) {
+      continue;
+    }
+    if (*num_words == capacity) {
+      capacity = (capacity == 0) ? 1024 : (capacity * 2);
+      result = realloc(result, sizeof(char *) * capacity);
+      if (result == NULL) {
+	perror("realloc");
+	exit(1);
+      }
+    }
+    result[(*num_words)++] = strdup(word);
+  }
+  fclose(file);
+  if (*num_words == 0) {
+    fprintf(stderr, "%s: no words\n", path);
+    free(result);
+    return NULL;
+  }
+  return result;
+}
+
+/**
+ *  A helper function that writes the value of a level.
+ *
+ *  @param file The file to write to.
+ *  @param level_number The number of the level.
+ *  @param value The value.
+ *  @param words The words of the word file [NULL to number the values].
+ **/
+static void helper_write_value(FILE *file, int level_number, size_t value,
+			       char **words) {
+  if ((words != NULL) && (level_number < NUM_LEVELS - 1)) {
+    fprintf(file, " %s", words[value]);
+  }
+  else {
+    fprintf(file, " %s%zu", PREFIXES[level_number], value);
+  }
+}
+
+int main(int argc, char **argv) {
+  struct Level levels[NUM_LEVELS];
+  size_t cardinalities[NUM_LEVELS] = {100, 100, 100, 1000000};
+  long num_operations = 10000;
+  double skew = 0;
+  double duplicate_rate = 0;
+  double mix[3] = {100, 0, 0};
+  const char *word_path = NULL;
+  const char *output_path = NULL;
+  char **words = NULL;
+  size_t num_words = 0;
+  FILE *file = stdout;
+  // Every image inserted so far, by the values of its levels
+  size_t *images;
+  size_t num_images = 0;
+  size_t image[NUM_LEVELS];
+  double choice;
+  long operation;
+  int option, i;
+  state = 1;
+  while ((option = getopt(argc, argv, "n:c:z:d:m:s:w:o:")) != -1) {
+    if ((option == 'n') && (atol(optarg) >= 0)) {
+      num_operations = atol(optarg);
+    }
+    else if ((option == 'c') &&
+	     (sscanf(optarg, "%zu,%zu,%zu,%zu", &cardinalities[0],
+		     &cardinalities[1], &cardinalities[2],
+		     &cardinalities[3]) == NUM_LEVELS) &&
+	     (cardinalities[0] > 0) && (cardinalities[1] > 0) &&
+	     (cardinalities[2] > 0) && (cardinalities[3] > 0)) {
+    }
+    else if ((option == 'z') && (atof(optarg) >= 0)) {
+      skew = atof(optarg);
+    }
+    else if ((option == 'd') && (atof(optarg) >= 0) && (atof(optarg) <= 1)) {
+      duplicate_rate = atof(optarg);
+    }
+    else if ((option == 'm') &&
+	     (sscanf(optarg, "%lf:%lf:%lf", &mix[0], &mix[1], &mix[2]) ==
+	      3) && (mix[0] >= 0) && (mix[1] >= 0) && (mix[2] >= 0) &&
+	     (mix[0] + mix[1] + mix[2] > 0)) {
+    }
+    else if (option == 's') {
+      state = strtoull(optarg, NULL, 10);
+    }
+    else if (option == 'w') {
+      word_path = optarg;
+    }
+    else if (option == 'o') {
+      output_path = optarg;
+    }
+    else {
+      fprintf(stderr, USAGE_MSG, argv[0]);
+      return 1;
+    }
+  }
+  // A word file caps the number of distinct attribute values
+  if (word_path != NULL) {
+    words = helper_read_words(word_path, &num_words);
+    if (words == NULL) {
+      return 1;
+    }
+    for (i = 0; i < NUM_LEVELS - 1; i++) {
+      if (cardinalities[i] > num_words) {
+	cardinalities[i] = num_words;
+      }
+    }
+  }
+  if (output_path != NULL) {
+    file = fopen(output_path, "w");
+    if (file == NULL) {
+      perror(output_path);
+      return 1;
+    }
+  }
+  for (i = 0; i < NUM_LEVELS; i++) {
+    helper_init_level(&levels[i], cardinalities[i], skew);
+  }
+  images = malloc(sizeof(size_t) * NUM_LEVELS * (num_operations + 1));
+  if (images == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+  for (operation = 0; operation < num_operations; operation++) {
+    choice = helper_uniform() * (mix[0] + mix[1] + mix[2]);
+    // INSERT OPERATION [A QUERY OPERATION needs an earlier image]
+    if ((choice < mix[0]) || ((choice < mix[0] + mix[1]) &&
+			      (num_images == 0))) {
+      // Repeat an earlier image, or draw a new one
+      if ((num_images > 0) && (helper_uniform() < duplicate_rate)) {
+	memcpy(image, &images[NUM_LEVELS * (helper_random() % num_images)],
+	       sizeof(image));
+      }
+      else {
+	for (i = 0; i < NUM_LEVELS; i++) {
+	  image[i] = helper_draw(&levels[i]);
+	}
+      }
+      memcpy(&images[NUM_LEVELS * num_images++], image, sizeof(image));
+      fprintf(file, "i");
+      for (i = 0; i < NUM_LEVELS; i++) {
+	helper_write_value(file, i, image[i], words);
+      }
+      fprintf(file, "\n");
+    }
+    // QUERY OPERATION for the attributes of an earlier image
+    else if (choice < mix[0] + mix[1]) {
+      memcpy(image, &images[NUM_LEVELS * (helper_random() % num_images)],
+	     sizeof(image));
+      fprintf(file, "q");
+      for (i = 0; i < NUM_LEVELS - 1; i++) {
+	helper_write_value(file, i, image[i], words);
+      }
+      fprintf(file, "\n");
+    }
+    // PRINT OPERATION
+    else {
+      fprintf(file, "p\n");
+    }
+  }
+  if (fclose(file) != 0) {
+    perror("fclose");
+    return 1;
+  }
+  for (i = 0; i < NUM_LEVELS; i++) {
+    free(levels[i].weights);
+    free(levels[i].values);
+  }
+  for (i = 0; (size_t) i < num_words; i++) {
+    free(words[i]);
+  }
+  free(words);
+  free(images);
+  return 0;
+}
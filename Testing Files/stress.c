@@ -0,0 +1,496 @@
+/**
+ *  Concurrency stress test for the image database. One writer thread
+ *  inserts images into a tree, and deletes images and whole branches, while
+ *  reader threads run queries, counts and pages of queries on it. Each read
+ *  is checked against a serial oracle. Between the last operation done
+ *  before the read started and the last one started by the time it ended,
+ *  an image is stable if it was present throughout, and possible if it was
+ *  present at any time. A read must return, in sorted order, every stable
+ *  matching image and nothing but possible ones; a count must lie between
+ *  the numbers of each; a page must skip no stable image it does not count.
+ *
+ *  Usage: stress [<OPERATIONS> [<READERS>]]
+ **/
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tree.h"
+
+// Number of distinct values of each attribute, and of filenames
+#define NUM_A1	40
+#define NUM_A2	30
+#define NUM_A3	20
+#define NUM_FILENAMES	50
+#define NUM_CODES	(NUM_A1 * NUM_A2 * NUM_A3 * NUM_FILENAMES)
+// One in DELETE_RATIO operations is a delete
+#define DELETE_RATIO	5
+// Largest number of images a page skips, and returns
+#define MAX_PAGE_OFFSET	2000
+#define MAX_PAGE_LIMIT	20
+
+
+// An insert of an image, or a delete of every image below the path of its
+// first num_exact values
+struct Operation {
+	int values[4];
+	int num_exact;
+	int is_delete;
+};
+
+// The positions of the operations on each path of a depth level, in order:
+// those of path key are positions[first[key]..first[key + 1]]
+struct Events {
+	int *first;
+	int *positions;
+};
+
+// State shared by the writer and the readers
+struct Stress {
+	struct Tree tree;
+	struct Operation *operations;
+	int num_operations;
+	// The number of operations that have started, and have completed
+	int num_started;
+	int num_done;
+	// Inserts by image, and deletes by the depth level of their last exact
+	// value
+	struct Events inserts;
+	struct Events deletes[4];
+	int is_writer_done;
+	int num_failures;
+};
+
+struct Reader {
+	struct Stress *stress;
+	int number;
+	unsigned int seed;
+	long num_reads;
+	// Marks the codes returned by, and expected of, the current read, and
+	// lists them
+	int *returned;
+	int *expected;
+	int *codes;
+	int *stable;
+};
+
+// Prefix of the values of each depth level
+static const char PREFIXES[4] = {'a', 'b', 'c', 'f'};
+static const int NUM_VALUES[4] = {NUM_A1, NUM_A2, NUM_A3, NUM_FILENAMES};
+
+/**
+ *  Number the path of the first values of an image down to a depth level
+ *  [The image itself at the filename depth level].
+ **/
+static int helper_key(const int *values, int level) {
+  int key = 0;
+  int i;
+  for (i = 0; i <= level; i++) {
+    key = key * NUM_VALUES[i] + values[i];
+  }
+  return key;
+}
+
+static int helper_code(const int *values) {
+  return helper_key(values, 3);
+}
+
+/**
+ *  Order codes for qsort [Codes sort as the images do].
+ **/
+static int helper_compare(const void *a, const void *b) {
+  return *(const int *) a - *(const int *) b;
+}
+
+/**
+ *  Index the operations of one kind on the paths down to a depth level.
+ **/
+static void helper_index(struct Events *events, const struct Stress *stress,
+			 int is_delete, int level) {
+  int num_keys = 1;
+  int *next;
+  int i, key;
+  for (i = 0; i <= level; i++) {
+    num_keys *= NUM_VALUES[i];
+  }
+  next = calloc(num_keys, sizeof(int));
+  events->first = calloc(num_keys + 1, sizeof(int));
+  for (i = 0; i < stress->num_operations; i++) {
+    if ((stress->operations[i].is_delete == is_delete) &&
+	((!is_delete) || (stress->operations[i].num_exact == level + 1))) {
+      events->first[helper_key(stress->operations[i].values, level) + 1]++;
+    }
+  }
+  for (key = 0; key < num_keys; key++) {
+    events->first[key + 1] += events->first[key];
+    next[key] = events->first[key];
+  }
+  events->positions = malloc(sizeof(int) * (events->first[num_keys] + 1));
+  for (i = 0; i < stress->num_operations; i++) {
+    if ((stress->operations[i].is_delete == is_delete) &&
+	((!is_delete) || (stress->operations[i].num_exact == level + 1))) {
+      key = helper_key(stress->operations[i].values, level);
+      events->positions[next[key]++] = i;
+    }
+  }
+  free(next);
+}
+
+/**
+ *  Return the position of the last operation on a path before a position,
+ *  or -1 if there is none.
+ **/
+static int helper_last_before(const struct Events *events, int key,
+			      int position) {
+  int low = events->first[key];
+  int high = events->first[key + 1];
+  while (low < high) {
+    int middle = low + (high - low) / 2;
+    if (events->positions[middle] < position) {
+      low = middle + 1;
+    }
+    else {
+      high = middle;
+    }
+  }
+  return (low > events->first[key]) ? events->positions[low - 1] : -1;
+}
+
+/**
+ *  Check if an image is present once the operations before a position are
+ *  done.
+ **/
+static int helper_is_present(const struct Stress *stress, const int *values,
+			     int position) {
+  int inserted = helper_last_before(&stress->inserts, helper_code(values),
+				    position);
+  int level;
+  for (level = 0; (level < 4) && (inserted != -1); level++) {
+    if (helper_last_before(&stress->deletes[level],
+			   helper_key(values, level), position) > inserted) {
+      inserted = -1;
+    }
+  }
+  return inserted != -1;
+}
+
+/**
+ *  Check if an image is present throughout the operations in [low, high).
+ **/
+static int helper_is_stable(const struct Stress *stress, const int *values,
+			    int low, int high) {
+  int level;
+  int result = helper_is_present(stress, values, low);
+  for (level = 0; (level < 4) && (result); level++) {
+    if (helper_last_before(&stress->deletes[level],
+			   helper_key(values, level), high) >= low) {
+      result = 0;
+    }
+  }
+  return result;
+}
+
+/**
+ *  Check if an image is present at any time during the operations in [low,
+ *  high).
+ **/
+static int helper_is_possible(const struct Stress *stress, const int *values,
+			      int low, int high) {
+  return (helper_is_present(stress, values, low)) ||
+    (helper_last_before(&stress->inserts, helper_code(values), high) >= low);
+}
+
+/**
+ *  Check if an image matches a query, as the database is meant to.
+ **/
+static int helper_oracle_matches(const int *values, char **query) {
+  char text[16];
+  int level;
+  int result = 1;
+  for (level = 0; (level < 3) && (result); level++) {
+    struct AttributeMatch match;
+    snprintf(text, sizeof(text), "%c%02d", PREFIXES[level], values[level]);
+    match_parse(&match, query[level + 1]);
+    result = ((match.is_exact) ? (strcmp(text, query[level + 1]) == 0) :
+	      (!match_is_below(&match, text) &&
+	       !match_is_beyond(&match, text)));
+  }
+  return result;
+}
+
+/**
+ *  Build a random query: exact values, wildcards, prefixes and ranges.
+ **/
+static void helper_random_query(unsigned int *seed, char texts[4][32],
+				char **query) {
+  int level;
+  query[0] = "q";
+  for (level = 0; level < 3; level++) {
+    int kind = rand_r(seed) % 4;
+    int low = rand_r(seed) % NUM_VALUES[level];
+    int high = low + rand_r(seed) % 8;
+    if (kind == 0) {
+      snprintf(texts[level], 32, "%c%02d", PREFIXES[level], low);
+    }
+    else if (kind == 1) {
+      snprintf(texts[level], 32, "*");
+    }
+    else if (kind == 2) {
+      snprintf(texts[level], 32, "%c%d*", PREFIXES[level], low / 10);
+    }
+    else {
+      snprintf(texts[level], 32, "%c%02d..%c%02d", PREFIXES[level], low,
+	       PREFIXES[level], high);
+    }
+    query[level + 1] = texts[level];
+  }
+}
+
+static void *helper_writer(void *arg) {
+  struct Stress *stress = arg;
+  char texts[4][32];
+  char *values[INPUT_ARG_MAX_NUM];
+  int i, level;
+  for (i = 0; i < stress->num_operations; i++) {
+    const struct Operation *operation = &stress->operations[i];
+    values[0] = (operation->is_delete) ? "d" : "i";
+    for (level = 0; level < 4; level++) {
+      snprintf(texts[level], 32, "%c%02d", PREFIXES[level],
+	       operation->values[level]);
+      values[level + 1] = (level < operation->num_exact) ? texts[level] : "*";
+    }
+    ATOMIC_PUBLISH(stress->num_started, i + 1);
+    if (operation->is_delete) {
+      tree_delete(&stress->tree, values);
+    }
+    else {
+      tree_insert(&stress->tree, values);
+    }
+    ATOMIC_PUBLISH(stress->num_done, i + 1);
+  }
+  ATOMIC_PUBLISH(stress->is_writer_done, 1);
+  return NULL;
+}
+
+/**
+ *  List the stable images matching a query, in sorted order, and mark the
+ *  possible ones. Return the number of stable images, and set the number
+ *  of possible ones.
+ **/
+static int helper_expect(struct Reader *reader, char **query, int low,
+			 int high, int *num_possible) {
+  struct Stress *stress = reader->stress;
+  const int *values;
+  int i, code, num_stable = 0;
+  *num_possible = 0;
+  for (i = 0; i < high; i++) {
+    values = stress->operations[i].values;
+    code = helper_code(values);
+    if ((stress->operations[i].is_delete) ||
+	(reader->expected[code] == (int) reader->num_reads) ||
+	(!helper_oracle_matches(values, query)) ||
+	(!helper_is_possible(stress, values, low, high))) {
+      continue;
+    }
+    reader->expected[code] = (int) reader->num_reads;
+    (*num_possible)++;
+    if (helper_is_stable(stress, values, low, high)) {
+      reader->stable[num_stable++] = code;
+    }
+  }
+  qsort(reader->stable, num_stable, sizeof(int), helper_compare);
+  return num_stable;
+}
+
+/**
+ *  Run one query, count or page of a query, and check it against the
+ *  oracle.
+ **/
+static void helper_check_read(struct Reader *reader, int kind) {
+  struct Stress *stress = reader->stress;
+  struct TreeCursor cursor;
+  struct TreeImage image;
+  char texts[4][32];
+  char *query[INPUT_ARG_MAX_NUM];
+  int values[4], previous = -1;
+  int low, high, i, level, code, num_codes = 0;
+  int num_stable, num_possible, num_before;
+  size_t offset = 0, limit = NUM_CODES, num_skipped = 0, count = 0;
+  int is_failed = 0;
+  reader->num_reads++;
+  helper_random_query(&reader->seed, texts, query);
+  if (kind == 2) {
+    offset = rand_r(&reader->seed) % (MAX_PAGE_OFFSET + 1);
+    limit = 1 + rand_r(&reader->seed) % MAX_PAGE_LIMIT;
+  }
+  low = ATOMIC_READ(stress->num_done);
+  epoch_enter(&stress->tree.epochs, reader->number);
+  if (kind == 1) {
+    count = tree_count(&stress->tree, query);
+  }
+  else {
+    cursor_open(&cursor, &stress->tree, query);
+    num_skipped = cursor_skip(&cursor, offset);
+    while ((num_codes < (int) limit) && (cursor_next(&cursor, &image))) {
+      for (level = 0; level < 4; level++) {
+	values[level] = atoi(image.values[level]->text + 1);
+      }
+      code = helper_code(values);
+      reader->returned[code] = (int) reader->num_reads;
+      reader->codes[num_codes++] = code;
+      // Images must come out in sorted order, once each
+      if (code <= previous) {
+	is_failed = 1;
+      }
+      previous = code;
+    }
+    cursor_close(&cursor);
+  }
+  epoch_exit(&stress->tree.epochs, reader->number);
+  high = ATOMIC_READ(stress->num_started);
+  num_stable = helper_expect(reader, query, low, high, &num_possible);
+  if (kind == 1) {
+    is_failed = (count < (size_t) num_stable) ||
+      (count > (size_t) num_possible);
+  }
+  // Nothing may be returned that was not possible, or that does not match
+  for (i = 0; (i < num_codes) && (!is_failed); i++) {
+    if (reader->expected[reader->codes[i]] != (int) reader->num_reads) {
+      is_failed = 1;
+    }
+  }
+  // The stable images before the first one returned must all have been
+  // skipped, and every later stable image returned, up to the last one
+  // of a full page [Or of all of them if the page is short]
+  if ((kind != 1) && (!is_failed)) {
+    if ((num_skipped < offset) && (num_codes > 0)) {
+      is_failed = 1;
+    }
+    for (num_before = 0;
+	 (num_before < num_stable) &&
+	   ((num_codes == 0) ||
+	    (reader->stable[num_before] < reader->codes[0]));
+	 num_before++) {
+    }
+    if (num_before > (int) num_skipped) {
+      is_failed = 1;
+    }
+    for (i = num_before; (i < num_stable) && (!is_failed); i++) {
+      if ((num_codes == (int) limit) &&
+	  (reader->stable[i] > reader->codes[num_codes - 1])) {
+	break;
+      }
+      if (reader->returned[reader->stable[i]] != (int) reader->num_reads) {
+	is_failed = 1;
+      }
+    }
+  }
+  if (is_failed) {
+    fprintf(stderr, "FAILED: %s q %s %s %s %zu %zu (done %d..%d)\n",
+	    (kind == 0) ? "query" : (kind == 1) ? "count" : "page", query[1],
+	    query[2], query[3], offset, limit, low, high);
+    __atomic_add_fetch(&stress->num_failures, 1, __ATOMIC_SEQ_CST);
+  }
+}
+
+static void *helper_reader(void *arg) {
+  struct Reader *reader = arg;
+  int kind;
+  // Keep reading until the writer is done, then once more of each kind
+  while (!ATOMIC_READ(reader->stress->is_writer_done)) {
+    helper_check_read(reader, reader->num_reads % 3);
+  }
+  for (kind = 0; kind < 3; kind++) {
+    helper_check_read(reader, kind);
+  }
+  return NULL;
+}
+
+int main(int argc, char **argv) {
+  struct Stress stress;
+  struct Reader *readers;
+  pthread_t writer;
+  pthread_t *threads;
+  int num_readers = 4;
+  unsigned int seed = 1;
+  long num_reads = 0;
+  int i, level;
+  stress.num_operations = 20000;
+  if (argc > 1) {
+    stress.num_operations = atoi(argv[1]);
+  }
+  if (argc > 2) {
+    num_readers = atoi(argv[2]);
+  }
+  tree_init(&stress.tree);
+  stress.operations = malloc(sizeof(struct Operation) *
+			     stress.num_operations);
+  readers = malloc(sizeof(struct Reader) * num_readers);
+  threads = malloc(sizeof(pthread_t) * num_readers);
+  stress.num_started = 0;
+  stress.num_done = 0;
+  stress.is_writer_done = 0;
+  stress.num_failures = 0;
+  // Draw the operations. A delete takes the path of an image inserted
+  // before it, mostly down to the image itself, sometimes a whole branch
+  for (i = 0; i < stress.num_operations; i++) {
+    struct Operation *operation = &stress.operations[i];
+    operation->is_delete = (i > 0) && (rand_r(&seed) % DELETE_RATIO == 0);
+    operation->num_exact = 4;
+    if (operation->is_delete) {
+      int kind = rand_r(&seed) % 100;
+      memcpy(operation->values,
+	     stress.operations[rand_r(&seed) % i].values, sizeof(int) * 4);
+      operation->num_exact = (kind < 60) ? 4 : (kind < 85) ? 3 :
+	(kind < 98) ? 2 : 1;
+    }
+    else {
+      for (level = 0; level < 4; level++) {
+	operation->values[level] = rand_r(&seed) % NUM_VALUES[level];
+      }
+    }
+  }
+  helper_index(&stress.inserts, &stress, 0, 3);
+  for (level = 0; level < 4; level++) {
+    helper_index(&stress.deletes[level], &stress, 1, level);
+  }
+  // Readers are registered before they run alongside the writer
+  for (i = 0; i < num_readers; i++) {
+    readers[i].stress = &stress;
+    readers[i].number = epoch_register(&stress.tree.epochs);
+    readers[i].seed = i + 2;
+    readers[i].num_reads = 0;
+    readers[i].returned = calloc(NUM_CODES, sizeof(int));
+    readers[i].expected = calloc(NUM_CODES, sizeof(int));
+    readers[i].codes = malloc(sizeof(int) * NUM_CODES);
+    readers[i].stable = malloc(sizeof(int) * NUM_CODES);
+  }
+  for (i = 0; i < num_readers; i++) {
+    pthread_create(&threads[i], NULL, helper_reader, &readers[i]);
+  }
+  pthread_create(&writer, NULL, helper_writer, &stress);
+  pthread_join(writer, NULL);
+  for (i = 0; i < num_readers; i++) {
+    pthread_join(threads[i], NULL);
+    num_reads += readers[i].num_reads;
+    free(readers[i].returned);
+    free(readers[i].expected);
+    free(readers[i].codes);
+    free(readers[i].stable);
+  }
+  printf("%d operations, %d readers, %ld reads, %d failures\n",
+	 stress.num_operations, num_readers, num_reads, stress.num_failures);
+  tree_destroy(&stress.tree);
+  free(stress.operations);
+  free(stress.inserts.first);
+  free(stress.inserts.positions);
+  for (level = 0; level < 4; level++) {
+    free(stress.deletes[level].first);
+    free(stress.deletes[level].positions);
+  }
+  free(readers);
+  free(threads);
+  return (stress.num_failures == 0) ? 0 : 1;
+}
@@ -0,0 +1,183 @@
+/**
+ *  Arena allocator used for the nodes and cargo of the image database.
+ *  Memory is handed out from large blocks by bumping a pointer, so most 
+ *  allocations cost no call to malloc, and the whole arena is released in
+ *  O(blocks). Released memory is kept on free lists: one per size up to 
+ *  ARENA_SMALL_SIZE, so a released node serves the next node exactly, and
+ *  a few per power of two above it. Larger sizes are rounded up to their
+ *  class when allocated, so released arrays serve later arrays of the same
+ *  class, and no more than a quarter of their memory is lost to rounding.
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+
+// Number of exact size classes
+#define NUM_SMALL_CLASSES	(ARENA_SMALL_SIZE / ARENA_ALIGNMENT)
+// The power of two ARENA_SMALL_SIZE is
+#define SMALL_POWER	8
+
+/**
+ *  A helper function that rounds a size up to the arena alignment.
+ *
+ *  @param size The size to round up.
+ *  @return The aligned size.
+ **/
+static size_t helper_align(size_t size) {
+  return (size + ARENA_ALIGNMENT - 1) & ~(ARENA_ALIGNMENT - 1);
+}
+
+/**
+ *  A helper function that finds the size class of a size (i.e., the exact
+ *  size, or the smallest rounded size that holds it).
+ *
+ *  @param size The size, aligned.
+ *  @return The size class.
+ **/
+static int helper_class_of(size_t size) {
+  // Holds the largest power of two below size
+  int power = 0;
+  size_t step;
+  if (size <= ARENA_SMALL_SIZE) {
+    return size / ARENA_ALIGNMENT - 1;
+  }
+  while (((size_t) 2 << power) < size) {
+    power++;
+  }
+  // Sizes in (2^power, 2^(power + 1)] fall into evenly spaced classes
+  step = ((size_t) 1 << power) / ARENA_CLASSES_PER_POWER;
+  return NUM_SMALL_CLASSES + 
+    (power - SMALL_POWER) * ARENA_CLASSES_PER_POWER + 
+    (int) ((size - ((size_t) 1 << power) + step - 1) / step) - 1;
+}
+
+/**
+ *  A helper function that returns the number of bytes every member of a 
+ *  size class holds.
+ *
+ *  @param size_class The size class.
+ *  @return The size.
+ **/
+static size_t helper_class_size(int size_class) {
+  int rounded = size_class - NUM_SMALL_CLASSES;
+  size_t power;
+  if (rounded < 0) {
+    return (size_t) (size_class + 1) * ARENA_ALIGNMENT;
+  }
+  power = (size_t) 1 << (SMALL_POWER + rounded / ARENA_CLASSES_PER_POWER);
+  return power + power / ARENA_CLASSES_PER_POWER * 
+    (rounded % ARENA_CLASSES_PER_POWER + 1);
+}
+
+/**
+ *  Initialize an empty arena.
+ *
+ *  @param arena The arena to initialize.
+ **/
+void arena_init(struct Arena *arena) {
+  memset(arena, 0, sizeof(struct Arena));
+}
+
+/**
+ *  Allocate memory from the arena.
+ *
+ *  @param arena The arena to allocate from.
+ *  @param size The number of bytes required.
+ *  @return A pointer to the allocated memory.
+ **/
+void *arena_alloc(struct Arena *arena, size_t size) {
+  // Holds the memory to be returned
+  void *result = NULL;
+  // Holds the size class that can serve this request
+  int size_class;
+  size = helper_align((size > 0) ? size : 1);
+  size_class = helper_class_of(size);
+  size = helper_class_size(size_class);
+  arena->num_allocations++;
+  // If released memory of the required size class exists, reuse it
+  if ((size_class < ARENA_NUM_CLASSES) && 
+      (arena->free_lists[size_class] != NULL)) {
+    result = arena->free_lists[size_class];
+    arena->free_lists[size_class] = *(void **) result;
+    arena->bytes_free -= helper_class_size(size_class);
+  }
+  // Else, bump the pointer of the current block
+  else {
+    struct ArenaBlock *block = arena->blocks;
+    size_t header = helper_align(sizeof(struct ArenaBlock));
+    // If there is no block [OR] the current block is too full
+    if ((block == NULL) || (block->used + size > block->size)) {
+      // Oversized requests receive a block of their own
+      size_t block_size = (size > ARENA_BLOCK_SIZE / 4) ? size :
+	ARENA_BLOCK_SIZE;
+      block = malloc(header + block_size);
+      if (block == NULL) {
+	perror("malloc");
+	exit(1);
+      }
+      block->size = block_size;
+      block->used = 0;
+      // If the new block is oversized, keep bumping the current block
+      if ((block_size != ARENA_BLOCK_SIZE) && (arena->blocks != NULL)) {
+	block->next = arena->blocks->next;
+	arena->blocks->next = block;
+      }
+      // Else, the new block becomes the current block
+      else {
+	block->next = arena->blocks;
+	arena->blocks = block;
+      }
+      arena->num_blocks++;
+      arena->bytes_reserved += header + block_size;
+    }
+    result = (char *) block + header + block->used;
+    block->used += size;
+    arena->bytes_used += size;
+  }
+  return result;
+}
+
+/**
+ *  Hand memory back to the arena. It is kept on a free list and reused by
+ *  later allocations of the same size class.
+ *
+ *  @param arena The arena the memory was allocated from.
+ *  @param ptr The memory to release. May be NULL.
+ *  @param size The number of bytes that were requested for ptr.
+ **/
+void arena_free(struct Arena *arena, void *ptr, size_t size) {
+  // Holds the size class of the released memory
+  int size_class;
+  size = helper_align(size);
+  // If there is nothing to release
+  if ((ptr == NULL) || (size < sizeof(void *))) {
+    return;
+  }
+  size_class = helper_class_of(size);
+  if (size_class < ARENA_NUM_CLASSES) {
+    // Push the memory onto the free list of its size class
+    *(void **) ptr = arena->free_lists[size_class];
+    arena->free_lists[size_class] = ptr;
+    arena->bytes_free += helper_class_size(size_class);
+  }
+}
+
+/**
+ *  Release every block of the arena. All memory allocated from it becomes
+ *  invalid, and the arena is left empty.
+ *
+ *  @param arena The arena to destroy.
+ **/
+void arena_destroy(struct Arena *arena) {
+  struct ArenaBlock *block = arena->blocks;
+  // Keep releasing blocks until we hit NULL
+  while (block != NULL) {
+    struct ArenaBlock *next = block->next;
+    free(block);
+    block = next;
+  }
+  arena_init(arena);
+}
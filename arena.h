@@ -0,0 +1,66 @@
+/**
+ *  Arena allocator used for the nodes and cargo of the image database.
+ **/
+
+#ifndef _ARENA_H
+#define _ARENA_H
+
+#include <stddef.h>
+
+// Size of a regular arena block
+#define ARENA_BLOCK_SIZE	(1 << 20)
+// Alignment of every allocation
+#define ARENA_ALIGNMENT	sizeof(void *)
+// Largest size with a free list of its own. Larger sizes are rounded up to
+// one of ARENA_CLASSES_PER_POWER classes between each two powers of two
+#define ARENA_SMALL_SIZE	256
+#define ARENA_CLASSES_PER_POWER	4
+// Number of free list size classes (exact sizes, then rounded sizes up to
+// 2^40 bytes)
+#define ARENA_NUM_CLASSES	(ARENA_SMALL_SIZE / ARENA_ALIGNMENT + \
+				 ARENA_CLASSES_PER_POWER * 32)
+
+
+struct ArenaBlock {
+	struct ArenaBlock *next;
+	size_t size;
+	size_t used;
+};
+
+struct Arena {
+	// Blocks owned by the arena, most recently allocated block first
+	struct ArenaBlock *blocks;
+	// Released memory, sorted into size classes
+	void *free_lists[ARENA_NUM_CLASSES];
+
+	// Usage counters
+	size_t num_blocks;
+	size_t num_allocations;
+	size_t bytes_reserved;
+	size_t bytes_used;
+	// Bytes released and not yet reused
+	size_t bytes_free;
+};
+
+/*
+ * Initialize an empty arena.
+ */
+void arena_init(struct Arena *);
+
+/*
+ * Allocate size bytes (aligned for any object) from the arena.
+ */
+void *arena_alloc(struct Arena *, size_t);
+
+/*
+ * Hand size bytes at the given address back to the arena for reuse by later
+ * allocations.
+ */
+void arena_free(struct Arena *, void *, size_t);
+
+/*
+ * Release every block of the arena at once.
+ */
+void arena_destroy(struct Arena *);
+
+#endif /* _ARENA_H */
@@ -0,0 +1,259 @@
+/**
+ *  Parallel execution of query files against the image database. The file
+ *  is read into memory and split into chunks of lines. Worker threads claim
+ *  chunks in order and search the database into a sink of their own, while
+ *  the calling thread writes the finished chunks out in file order.
+ **/
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "batch.h"
+#include "scan.h"
+#include "utils.h"
+
+// Initial size of the file buffer
+#define INITIAL_CAPACITY	(1 << 16)
+
+
+// The results of one chunk of lines, until they are written out
+struct BatchSlot {
+	struct Output output;
+	size_t num_errors;
+	int is_done;
+};
+
+// State shared by the worker threads and the writing thread
+struct Batch {
+	const struct Database *database;
+	char **lines;
+	size_t num_lines;
+	size_t num_chunks;
+	// Chunk i is held by slot (i % num_slots)
+	struct BatchSlot *slots;
+	size_t num_slots;
+	// The next chunk to be claimed, and the oldest chunk not yet written
+	size_t next_chunk;
+	size_t next_written;
+	pthread_mutex_t lock;
+	// Signalled when a slot is written out, and when a chunk is done
+	pthread_cond_t is_slot_free;
+	pthread_cond_t is_chunk_done;
+};
+
+/**
+ *  A helper function that reads a whole file into memory and splits it into
+ *  NUL-terminated lines.
+ *
+ *  @param file The file.
+ *  @param num_lines Set to the number of lines.
+ *  @param text Set to the buffer holding the lines.
+ *  @return An array of the lines, or NULL if the file could not be read.
+ **/
+static char **helper_read_lines(FILE *file, size_t *num_lines, char **text) {
+  size_t capacity = INITIAL_CAPACITY;
+  size_t size = 0;
+  char *buffer = malloc(capacity + 1);
+  char **lines;
+  char *line;
+  char *newline;
+  if (buffer == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+  // Keep reading until EOF, doubling the buffer whenever it is full
+  while (!feof(file) && !ferror(file)) {
+    if (size == capacity) {
+      capacity *= 2;
+      buffer = realloc(buffer, capacity + 1);
+      if (buffer == NULL) {
+	perror("realloc");
+	exit(1);
+      }
+    }
+    size += fread(buffer + size, 1, capacity - size, file);
+  }
+  if (ferror(file)) {
+    perror("fread");
+    free(buffer);
+    return NULL;
+  }
+  // Count the lines [The last one may lack its newline character]
+  *num_lines = 0;
+  for (line = buffer; line < buffer + size; line = newline + 1) {
+    newline = (char *) scan_byte(line, buffer + size, '\n');
+    (*num_lines)++;
+  }
+  lines = malloc(sizeof(char *) * (*num_lines + 1));
+  if (lines == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+  // Terminate every line in place
+  buffer[size] = '\0';
+  *num_lines = 0;
+  for (line = buffer; line < buffer + size; line = newline + 1) {
+    newline = (char *) scan_byte(line, buffer + size, '\n');
+    *newline = '\0';
+    lines[(*num_lines)++] = line;
+  }
+  *text = buffer;
+  return lines;
+}
+
+/**
+ *  A helper function that runs the lines of one chunk into its slot.
+ *
+ *  @param batch The batch.
+ *  @param chunk The chunk.
+ **/
+static void helper_run_chunk(struct Batch *batch, size_t chunk) {
+  struct BatchSlot *slot = &batch->slots[chunk % batch->num_slots];
+  // char* array to hold the pointers to tokens
+  char *args[INPUT_ARG_MAX_NUM];
+  int num_tokens;
+  // Holds the page of a QUERY OPERATION
+  size_t offset;
+  size_t limit;
+  size_t line = chunk * BATCH_CHUNK_LINES;
+  size_t end = line + BATCH_CHUNK_LINES;
+  if (end > batch->num_lines) {
+    end = batch->num_lines;
+  }
+  for ( ; line < end; line++) {
+    // If we have a QUERY OPERATION
+    num_tokens = tokenize(batch->lines[line], args);
+    if ((num_tokens != -1) && (args[0][0] == QUERY) &&
+	(tokenize_page(args, num_tokens, &offset, &limit) == 0)) {
+      database_search_page(batch->database, args, offset, limit, 
+			   &slot->output);
+    }
+    // Else, the input must be invalid [A batch cannot change the database]
+    else {
+      slot->num_errors++;
+    }
+  }
+}
+
+/**
+ *  A helper function run by each worker thread. It keeps claiming the next
+ *  chunk until every chunk is claimed, but never runs more than num_slots
+ *  chunks ahead of the output.
+ *
+ *  @param arg The batch.
+ *  @return NULL.
+ **/
+static void *helper_worker(void *arg) {
+  struct Batch *batch = arg;
+  size_t chunk;
+  pthread_mutex_lock(&batch->lock);
+  while (batch->next_chunk < batch->num_chunks) {
+    // If the slot of the next chunk still holds results, wait for them to
+    // be written out
+    if (batch->next_chunk >= batch->next_written + batch->num_slots) {
+      pthread_cond_wait(&batch->is_slot_free, &batch->lock);
+    }
+    else {
+      chunk = batch->next_chunk++;
+      pthread_mutex_unlock(&batch->lock);
+      helper_run_chunk(batch, chunk);
+      pthread_mutex_lock(&batch->lock);
+      batch->slots[chunk % batch->num_slots].is_done = 1;
+      pthread_cond_broadcast(&batch->is_chunk_done);
+    }
+  }
+  pthread_mutex_unlock(&batch->lock);
+  return NULL;
+}
+
+/**
+ *  Run every QUERY OPERATION of a query file on worker threads.
+ *
+ *  @param database The database. It must not change while the batch runs.
+ *  @param file The query file. Holds one QUERY OPERATION per line.
+ *  @param num_threads The number of worker threads.
+ *  @param output The sink to print to, in the order of the file.
+ *  @return The number of lines read, or -1 on failure.
+ **/
+long batch_query(const struct Database *database, FILE *file, 
+		 int num_threads, struct Output *output) {
+  struct Batch batch;
+  pthread_t *threads;
+  char *text;
+  size_t chunk;
+  size_t i;
+  int num_started = 0;
+  batch.lines = helper_read_lines(file, &batch.num_lines, &text);
+  if (batch.lines == NULL) {
+    return -1;
+  }
+  batch.database = database;
+  batch.num_chunks = (batch.num_lines + BATCH_CHUNK_LINES - 1) / 
+    BATCH_CHUNK_LINES;
+  batch.num_slots = (size_t) num_threads * BATCH_WINDOW;
+  batch.next_chunk = 0;
+  batch.next_written = 0;
+  batch.slots = malloc(sizeof(struct BatchSlot) * batch.num_slots);
+  threads = malloc(sizeof(pthread_t) * num_threads);
+  if ((batch.slots == NULL) || (threads == NULL)) {
+    perror("malloc");
+    exit(1);
+  }
+  for (i = 0; i < batch.num_slots; i++) {
+    output_init_memory(&batch.slots[i].output);
+    batch.slots[i].num_errors = 0;
+    batch.slots[i].is_done = 0;
+  }
+  pthread_mutex_init(&batch.lock, NULL);
+  pthread_cond_init(&batch.is_slot_free, NULL);
+  pthread_cond_init(&batch.is_chunk_done, NULL);
+  // Start the worker threads
+  for ( ; num_started < num_threads; num_started++) {
+    if (pthread_create(&threads[num_started], NULL, helper_worker, 
+		       &batch) != 0) {
+      perror("pthread_create");
+      break;
+    }
+  }
+  // Write out the chunks in file order as they are done
+  for (chunk = 0; chunk < batch.num_chunks; chunk++) {
+    struct BatchSlot *slot = &batch.slots[chunk % batch.num_slots];
+    // If no worker thread could be started, run the chunk on this thread
+    if (num_started == 0) {
+      helper_run_chunk(&batch, chunk);
+      slot->is_done = 1;
+    }
+    pthread_mutex_lock(&batch.lock);
+    while (!slot->is_done) {
+      pthread_cond_wait(&batch.is_chunk_done, &batch.lock);
+    }
+    pthread_mutex_unlock(&batch.lock);
+    output_append(output, slot->output.buffer, slot->output.used);
+    for ( ; slot->num_errors > 0; slot->num_errors--) {
+      fprintf(stderr, ERROR_MSG);
+    }
+    output_reset(&slot->output);
+    // Hand the slot to the next chunk that needs it
+    pthread_mutex_lock(&batch.lock);
+    slot->is_done = 0;
+    batch.next_written++;
+    pthread_cond_broadcast(&batch.is_slot_free);
+    pthread_mutex_unlock(&batch.lock);
+  }
+  for (i = 0; i < (size_t) num_started; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  for (i = 0; i < batch.num_slots; i++) {
+    output_destroy(&batch.slots[i].output);
+  }
+  pthread_mutex_destroy(&batch.lock);
+  pthread_cond_destroy(&batch.is_slot_free);
+  pthread_cond_destroy(&batch.is_chunk_done);
+  free(threads);
+  free(batch.slots);
+  free(batch.lines);
+  free(text);
+  return (long) batch.num_lines;
+}
@@ -0,0 +1,28 @@
+/**
+ *  Parallel execution of query files against the image database.
+ **/
+
+#ifndef _BATCH_H
+#define _BATCH_H
+
+#include <stdio.h>
+
+#include "database.h"
+#include "output.h"
+
+// Number of lines of a query file handed to a worker thread at a time
+#define BATCH_CHUNK_LINES	512
+// Number of chunks each worker thread may finish ahead of the output
+#define BATCH_WINDOW	4
+
+
+/*
+ * Run every QUERY OPERATION of the given file on the given number of
+ * worker threads. Results are written to the sink in the order of the
+ * file; any other line is reported as an invalid command. The database
+ * must not change while the batch runs. Return the number of lines read,
+ * or -1 on failure.
+ */
+long batch_query(const struct Database *, FILE *, int, struct Output *);
+
+#endif /* _BATCH_H */
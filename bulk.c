@@ -0,0 +1,83 @@
+/**
+ *  Bulk loading of insert files into the image database. The whole file is
+ *  read first, in blocks, and the images are inserted in one sorted pass by
+ *  tree_bulk_insert.
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bulk.h"
+#include "reader.h"
+#include "utils.h"
+
+// Number of images the image array initially holds
+#define INITIAL_CAPACITY 1024
+
+/**
+ *  Read every INSERT OPERATION of an insert file and insert the images into
+ *  the tree. Any other line is reported as an invalid command.
+ *
+ *  @param tree A pointer to the tree.
+ *  @param file The insert file. Holds one INSERT OPERATION per line.
+ *  @param journal The journal to append the INSERT OPERATIONS to, or NULL.
+ *  @return The number of images read (including duplicates), but for any
+ *  that could not be journaled.
+ **/
+size_t bulk_load(struct Tree *tree, FILE *file, struct Journal *journal) {
+  // Holds the reader of the file, and a line of input
+  struct Reader reader;
+  char *line;
+  size_t length;
+  // char* array to hold the pointers to tokens
+  char *args[INPUT_ARG_MAX_NUM];
+  // Holds the images read so far
+  struct TreeImage *images = malloc(sizeof(struct TreeImage) * 
+				    INITIAL_CAPACITY);
+  size_t num_images = 0;
+  size_t capacity = INITIAL_CAPACITY;
+  // Holds the current depth level
+  int depth_level;
+  if (images == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+  // Keep reading lines until EOF is met
+  reader_init(&reader, fileno(file));
+  while ((line = reader_next_line(&reader, &length)) != NULL) {
+    // If we have an INSERT OPERATION
+    if ((tokenize(line, args) != -1) && (args[0][0] == INSERT)) {
+      // Journal the INSERT OPERATION before it is applied [An image that
+      // cannot be journaled is left out]
+      if ((journal != NULL) && (journal_append(journal, args) == -1)) {
+	continue;
+      }
+      // If the image array is full, double its capacity
+      if (num_images == capacity) {
+	capacity *= 2;
+	images = realloc(images, sizeof(struct TreeImage) * capacity);
+	if (images == NULL) {
+	  perror("realloc");
+	  exit(1);
+	}
+      }
+      // Intern the cargo [Attributes; filename]. The line buffer is 
+      // reused, but the interned copies live as long as the tree
+      for (depth_level = 0; depth_level < NUM_LEVELS; depth_level++) {
+	images[num_images].values[depth_level] = 
+	  intern(&tree->strings, args[depth_level + 1]);
+      }
+      num_images++;
+    }
+    // Else, the input must be invalid
+    else {
+      // Output an error message
+      fprintf(stderr, ERROR_MSG);
+    }
+  }
+  reader_destroy(&reader);
+  // Sort the images once and build the tree
+  tree_bulk_insert(tree, images, num_images);
+  free(images);
+  return num_images;
+}
@@ -0,0 +1,21 @@
+/**
+ *  Bulk loading of insert files into the image database.
+ **/
+
+#ifndef _BULK_H
+#define _BULK_H
+
+#include <stdio.h>
+
+#include "journal.h"
+#include "tree.h"
+
+
+/*
+ * Read every INSERT OPERATION of the given file and insert the images into
+ * the tree in one sorted pass. Each INSERT OPERATION is also appended to
+ * the journal, unless it is NULL. Return the number of images read.
+ */
+size_t bulk_load(struct Tree *, FILE *, struct Journal *);
+
+#endif /* _BULK_H */
@@ -0,0 +1,377 @@
+/**
+ *  Cache of the results of recent QUERY OPERATIONS. Skewed query traffic
+ *  asks for a few attribute values over and over, so their rendered result
+ *  lines are kept, keyed by the attribute values, and the least recently
+ *  used one is evicted once the cache is full. A change only drops the
+ *  entries it may affect: for an exact key, that is one hash lookup, and
+ *  only the entries with prefixes, ranges or * are matched one by one.
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cache.h"
+
+
+
+/**
+ *  A helper function that hashes the attribute values of an operation,
+ *  their NUL terminators included, and measures them.
+ *
+ *  @param values The tokens of the operation.
+ *  @param length Set to the length of the attribute values, their NUL
+ *  terminators included.
+ *  @return The FNV-1a hash of the attribute values.
+ **/
+static unsigned int helper_hash(char **values, size_t *length) {
+  unsigned int hash = FNV_OFFSET_BASIS;
+  const char *cur;
+  int i;
+  *length = 0;
+  for (i = 1; i <= NUM_ATTRIBUTES; i++) {
+    for (cur = values[i]; ; cur++) {
+      hash = (hash ^ (unsigned char) *cur) * FNV_PRIME;
+      if (*cur == '\0') {
+	break;
+      }
+    }
+    *length += cur - values[i] + 1;
+  }
+  return hash;
+}
+
+/**
+ *  A helper function that finds the entry of the attribute values of an
+ *  operation.
+ *
+ *  @param cache The cache.
+ *  @param values The tokens of the operation.
+ *  @param hash The hash of the attribute values.
+ *  @return The entry, or NULL if there is none.
+ **/
+static struct CacheEntry *helper_find(const struct QueryCache *cache,
+				      char **values, unsigned int hash) {
+  struct CacheEntry *cur = cache->buckets[hash & cache->mask];
+  const char *key;
+  int i;
+  for ( ; cur != NULL; cur = cur->next) {
+    if (cur->hash == hash) {
+      // Compare the attribute values one by one
+      key = cur->key;
+      for (i = 1; (i <= NUM_ATTRIBUTES) && (strcmp(key, values[i]) == 0);
+	   i++) {
+	key += strlen(key) + 1;
+      }
+      if (i > NUM_ATTRIBUTES) {
+	return cur;
+      }
+    }
+  }
+  return NULL;
+}
+
+/**
+ *  A helper function that checks if an INSERT [OR] DELETE OPERATION may
+ *  change the result of an entry.
+ *
+ *  @param entry The entry.
+ *  @param values The tokens of the operation.
+ *  @return 1 if every attribute value of the operation is * or matches the
+ *  entry; 0 otherwise.
+ **/
+static int helper_is_affected(const struct CacheEntry *entry, char **values) {
+  int i;
+  for (i = 0; i < NUM_ATTRIBUTES; i++) {
+    if ((strcmp(values[i + 1], MATCH_ANY) != 0) &&
+	((match_is_below(&entry->matches[i], values[i + 1])) ||
+	 (match_is_beyond(&entry->matches[i], values[i + 1])))) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/**
+ *  A helper function that makes an entry the most recently used one.
+ *
+ *  @param cache The cache.
+ *  @param entry The entry, not in the order of use.
+ **/
+static void helper_push_newest(struct QueryCache *cache,
+			       struct CacheEntry *entry) {
+  entry->newer = NULL;
+  entry->older = cache->newest;
+  if (cache->newest != NULL) {
+    cache->newest->newer = entry;
+  }
+  else {
+    cache->oldest = entry;
+  }
+  cache->newest = entry;
+}
+
+/**
+ *  A helper function that takes an entry out of the order of use.
+ *
+ *  @param cache The cache.
+ *  @param entry The entry.
+ **/
+static void helper_unlink_use(struct QueryCache *cache,
+			      struct CacheEntry *entry) {
+  if (entry->newer != NULL) {
+    entry->newer->older = entry->older;
+  }
+  else {
+    cache->newest = entry->older;
+  }
+  if (entry->older != NULL) {
+    entry->older->newer = entry->newer;
+  }
+  else {
+    cache->oldest = entry->newer;
+  }
+}
+
+/**
+ *  A helper function that drops an entry and releases its memory.
+ *
+ *  @param cache The cache.
+ *  @param entry The entry.
+ **/
+static void helper_remove(struct QueryCache *cache, struct CacheEntry *entry) {
+  struct CacheEntry **link = &cache->buckets[entry->hash & cache->mask];
+  // Take it out of its bucket
+  while (*link != entry) {
+    link = &(*link)->next;
+  }
+  *link = entry->next;
+  helper_unlink_use(cache, entry);
+  // Take it out of the entries that are not exact
+  if (!entry->is_exact) {
+    if (entry->next_inexact != NULL) {
+      entry->next_inexact->previous_inexact = entry->previous_inexact;
+    }
+    if (entry->previous_inexact != NULL) {
+      entry->previous_inexact->next_inexact = entry->next_inexact;
+    }
+    else {
+      cache->inexact = entry->next_inexact;
+    }
+  }
+  cache->count--;
+  free(entry);
+}
+
+/**
+ *  Initialize an empty cache.
+ *
+ *  @param cache The cache.
+ *  @param capacity The maximum number of entries [At least 1].
+ **/
+void cache_init(struct QueryCache *cache, size_t capacity) {
+  size_t num_buckets = 1;
+  memset(cache, 0, sizeof(struct QueryCache));
+  pthread_mutex_init(&cache->lock, NULL);
+  cache->capacity = capacity;
+  // At most one entry per bucket on average
+  while (num_buckets < capacity) {
+    num_buckets *= 2;
+  }
+  cache->buckets = calloc(num_buckets, sizeof(struct CacheEntry *));
+  if (cache->buckets == NULL) {
+    perror("calloc");
+    exit(1);
+  }
+  cache->mask = num_buckets - 1;
+}
+
+/**
+ *  Release all memory held by a cache.
+ *
+ *  @param cache The cache.
+ **/
+void cache_destroy(struct QueryCache *cache) {
+  cache_clear(cache);
+  free(cache->buckets);
+  pthread_mutex_destroy(&cache->lock);
+}
+
+/**
+ *  Look up the result of a QUERY OPERATION.
+ *
+ *  @param cache The cache.
+ *  @param values The tokens of the QUERY OPERATION.
+ *  @param output The sink to append the cached result to.
+ *  @return 1 on a hit; 0 on a miss.
+ **/
+int cache_lookup(struct QueryCache *cache, char **values,
+		 struct Output *output) {
+  size_t length;
+  unsigned int hash = helper_hash(values, &length);
+  struct CacheEntry *entry;
+  pthread_mutex_lock(&cache->lock);
+  entry = helper_find(cache, values, hash);
+  if (entry != NULL) {
+    cache->num_hits++;
+    if (cache->newest != entry) {
+      helper_unlink_use(cache, entry);
+      helper_push_newest(cache, entry);
+    }
+    // Copied under the lock, since another thread may evict the entry
+    output_append(output, entry->result, entry->result_length);
+  }
+  else {
+    cache->num_misses++;
+  }
+  pthread_mutex_unlock(&cache->lock);
+  return (entry != NULL);
+}
+
+/**
+ *  Cache the result of a QUERY OPERATION.
+ *
+ *  @param cache The cache.
+ *  @param values The tokens of the QUERY OPERATION.
+ *  @param result The rendered result.
+ *  @param result_length The length of the result.
+ **/
+void cache_store(struct QueryCache *cache, char **values, const char *result,
+		 size_t result_length) {
+  size_t key_length;
+  unsigned int hash = helper_hash(values, &key_length);
+  struct CacheEntry *entry;
+  char *key;
+  int i;
+  if (result_length > CACHE_MAX_RESULT) {
+    return;
+  }
+  pthread_mutex_lock(&cache->lock);
+  // Another thread of a batch may have stored it meanwhile
+  if (helper_find(cache, values, hash) == NULL) {
+    // Make room by evicting the least recently used entry
+    if (cache->count == cache->capacity) {
+      helper_remove(cache, cache->oldest);
+      cache->num_evicted++;
+    }
+    entry = malloc(sizeof(struct CacheEntry) + key_length + result_length);
+    if (entry == NULL) {
+      perror("malloc");
+      exit(1);
+    }
+    entry->hash = hash;
+    entry->is_exact = 1;
+    key = entry->data;
+    entry->key = key;
+    for (i = 0; i < NUM_ATTRIBUTES; i++) {
+      strcpy(key, values[i + 1]);
+      match_parse(&entry->matches[i], key);
+      entry->is_exact = entry->is_exact && entry->matches[i].is_exact;
+      key += strlen(key) + 1;
+    }
+    memcpy(key, result, result_length);
+    entry->result = key;
+    entry->result_length = result_length;
+    // Link it into its bucket, the order of use and, unless it is exact,
+    // the entries that are not exact
+    entry->next = cache->buckets[hash & cache->mask];
+    cache->buckets[hash & cache->mask] = entry;
+    helper_push_newest(cache, entry);
+    if (!entry->is_exact) {
+      entry->previous_inexact = NULL;
+      entry->next_inexact = cache->inexact;
+      if (cache->inexact != NULL) {
+	cache->inexact->previous_inexact = entry;
+      }
+      cache->inexact = entry;
+    }
+    cache->count++;
+  }
+  pthread_mutex_unlock(&cache->lock);
+}
+
+/**
+ *  Drop the entries an INSERT [OR] DELETE OPERATION may change.
+ *
+ *  @param cache The cache.
+ *  @param values The tokens of the operation.
+ **/
+void cache_invalidate(struct QueryCache *cache, char **values) {
+  struct CacheEntry *cur;
+  struct CacheEntry *next;
+  size_t length;
+  unsigned int hash = helper_hash(values, &length);
+  int has_any = 0;
+  int i;
+  for (i = 1; i <= NUM_ATTRIBUTES; i++) {
+    has_any = has_any || (strcmp(values[i], MATCH_ANY) == 0);
+  }
+  pthread_mutex_lock(&cache->lock);
+  // If every attribute value is exact, only the entry of these very values
+  // and the entries that are not exact can match
+  if (!has_any) {
+    cur = helper_find(cache, values, hash);
+    if (cur != NULL) {
+      helper_remove(cache, cur);
+      cache->num_invalidated++;
+    }
+    cur = cache->inexact;
+    for ( ; cur != NULL; cur = next) {
+      next = cur->next_inexact;
+      if (helper_is_affected(cur, values)) {
+	helper_remove(cache, cur);
+	cache->num_invalidated++;
+      }
+    }
+  }
+  // Else, a branch is deleted, and every entry is checked
+  else {
+    for (cur = cache->newest; cur != NULL; cur = next) {
+      next = cur->older;
+      if (helper_is_affected(cur, values)) {
+	helper_remove(cache, cur);
+	cache->num_invalidated++;
+      }
+    }
+  }
+  pthread_mutex_unlock(&cache->lock);
+}
+
+/**
+ *  Drop every entry of a cache.
+ *
+ *  @param cache The cache.
+ **/
+void cache_clear(struct QueryCache *cache) {
+  pthread_mutex_lock(&cache->lock);
+  while (cache->newest != NULL) {
+    helper_remove(cache, cache->newest);
+  }
+  pthread_mutex_unlock(&cache->lock);
+}
+
+/**
+ *  Print the statistics of a cache.
+ *
+ *  @param cache The cache.
+ *  @param output The sink to print to.
+ **/
+void cache_report(struct QueryCache *cache, struct Output *output) {
+  char buf[256];
+  unsigned long num_lookups;
+  int size;
+  pthread_mutex_lock(&cache->lock);
+  num_lookups = cache->num_hits + cache->num_misses;
+  size = snprintf(buf, sizeof(buf), "Query cache: %lu hits, %lu misses "
+		  "(%.1f%% hit rate), %lu invalidated, %lu evicted, %zu of "
+		  "%zu entries\n", cache->num_hits, cache->num_misses,
+		  (num_lookups > 0) ?
+		  (100.0 * cache->num_hits / num_lookups) : 0.0,
+		  cache->num_invalidated, cache->num_evicted, cache->count,
+		  cache->capacity);
+  pthread_mutex_unlock(&cache->lock);
+  if (size > 0) {
+    output_append(output, buf, ((size_t) size < sizeof(buf)) ?
+		  (size_t) size : (sizeof(buf) - 1));
+  }
+}
@@ -0,0 +1,100 @@
+/**
+ *  Cache of the results of recent QUERY OPERATIONS of the image database.
+ **/
+
+#ifndef _CACHE_H
+#define _CACHE_H
+
+#include <pthread.h>
+#include <stddef.h>
+
+#include "match.h"
+#include "output.h"
+#include "utils.h"
+
+// Default number of cached QUERY OPERATIONS
+#define CACHE_DEFAULT_CAPACITY	1024
+// Largest result that is cached, in bytes [Larger ones are rendered every
+// time, so a few broad queries cannot hold most of the memory]
+#define CACHE_MAX_RESULT	(1 << 16)
+
+
+struct CacheEntry {
+	// Hash of the attribute values of the QUERY OPERATION
+	unsigned int hash;
+	// Set if every attribute value is exact, so only an image with these
+	// very values can change the result
+	int is_exact;
+	// The attribute values, parsed [They point into the key]
+	struct AttributeMatch matches[NUM_ATTRIBUTES];
+	// The attribute values, each NUL-terminated, followed by the result
+	const char *key;
+	const char *result;
+	size_t result_length;
+	// Next entry of the same bucket
+	struct CacheEntry *next;
+	// Neighbours in order of use, from the most recently used
+	struct CacheEntry *newer;
+	struct CacheEntry *older;
+	// Neighbours among the entries that are not exact
+	struct CacheEntry *next_inexact;
+	struct CacheEntry *previous_inexact;
+	char data[];
+};
+
+struct QueryCache {
+	// Lookups come from the worker threads of a batch too
+	pthread_mutex_t lock;
+	// Maximum and current number of entries
+	size_t capacity;
+	size_t count;
+	// Chained hash table of the entries [Its size is a power of two]
+	struct CacheEntry **buckets;
+	size_t mask;
+	// The most and the least recently used entries
+	struct CacheEntry *newest;
+	struct CacheEntry *oldest;
+	// The entries that are not exact, checked on every change
+	struct CacheEntry *inexact;
+	unsigned long num_hits;
+	unsigned long num_misses;
+	unsigned long num_invalidated;
+	unsigned long num_evicted;
+};
+
+/*
+ * Initialize an empty cache of the given number of entries [At least 1].
+ */
+void cache_init(struct QueryCache *, size_t);
+void cache_destroy(struct QueryCache *);
+
+/*
+ * Append the cached result of the given tokens of a QUERY OPERATION to the
+ * sink. Return 1 on a hit, or 0 on a miss.
+ */
+int cache_lookup(struct QueryCache *, char **, struct Output *);
+
+/*
+ * Cache the result of the given tokens of a QUERY OPERATION, evicting the
+ * least recently used entry if the cache is full.
+ */
+void cache_store(struct QueryCache *, char **, const char *, size_t);
+
+/*
+ * Drop the entries whose results an INSERT [OR] DELETE OPERATION of the
+ * given tokens may change: those whose attribute values match its own,
+ * where a * of a DELETE OPERATION matches anything.
+ */
+void cache_invalidate(struct QueryCache *, char **);
+
+/*
+ * Drop every entry.
+ */
+void cache_clear(struct QueryCache *);
+
+/*
+ * Print the number of entries, hits, misses, invalidations and evictions.
+ */
+void cache_report(struct QueryCache *, struct Output *);
+
+#endif /* _CACHE_H */
@@ -0,0 +1,734 @@
+/**
+ *  The image database. Images live in a tree, except right after a 
+ *  snapshot is loaded or the tree is frozen into one: the snapshot is then
+ *  searched and printed in place, and only turned back into a tree (thawed)
+ *  by the next insert. A sharded database holds no images itself: it hands
+ *  every operation to its shards, and only keeps the query cache.
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bulk.h"
+#include "database.h"
+#include "reader.h"
+#include "shard.h"
+
+/**
+ *  A helper function that turns an open snapshot back into a tree, so that
+ *  images can be inserted.
+ *
+ *  @param database The database.
+ **/
+static void helper_thaw(struct Database *database) {
+  // If a snapshot is open
+  if (database->snapshot.data != NULL) {
+    // Copy its images into the (empty) tree and release it
+    snapshot_thaw(&database->snapshot, &database->tree);
+    snapshot_close(&database->snapshot);
+  }
+}
+
+/**
+ *  A helper function that plans the depth levels of the tree of a planned
+ *  database once its number of images has doubled since it was last 
+ *  planned. An open snapshot is planned once it is thawed.
+ *
+ *  @param database The database.
+ **/
+static void helper_plan(struct Database *database) {
+  if ((database->is_planned) && (database->snapshot.data == NULL) &&
+      (database->tree.num_images >= database->plan_size)) {
+    tree_plan(&database->tree);
+    database->plan_size = (database->tree.num_images * 2 > DATABASE_PLAN_MIN)
+      ? (database->tree.num_images * 2) : DATABASE_PLAN_MIN;
+  }
+}
+
+/**
+ *  A helper function that checks if a DELETE OPERATION may delete images of
+ *  the open snapshot, by counting the images with its attribute values. A 
+ *  delete that cannot leaves the snapshot open, rather than thawing it for
+ *  nothing.
+ *
+ *  @param database The database.
+ *  @param values The tokens of the DELETE OPERATION [Valid ones].
+ *  @return 1 if images may be deleted; 0 if none can be.
+ **/
+static int helper_may_delete(const struct Database *database, 
+			     char **values) {
+  // Holds the attribute values as the tokens of a QUERY OPERATION
+  char *query[INPUT_ARG_MAX_NUM];
+  int i;
+  if (database->snapshot.data == NULL) {
+    return 1;
+  }
+  query[0] = values[0];
+  for (i = 1; i <= NUM_ATTRIBUTES; i++) {
+    // A value that reads as a range of a QUERY OPERATION may not match 
+    // itself, so it is assumed to match [A prefix always matches itself]
+    if (strstr(values[i], MATCH_RANGE) != NULL) {
+      return 1;
+    }
+    query[i] = values[i];
+  }
+  // The filename is not counted, so an image is at most assumed to match
+  return snapshot_count(&database->snapshot, query) > 0;
+}
+
+/**
+ *  Initialize an empty database.
+ *
+ *  @param database The database.
+ **/
+void database_init(struct Database *database) {
+  tree_init(&database->tree);
+  // No snapshot is open
+  memset(&database->snapshot, 0, sizeof(struct Snapshot));
+  // No journal is open
+  memset(&database->journal, 0, sizeof(struct Journal));
+  database->journal.fd = -1;
+  // The depth levels are in attribute order until planned
+  database->is_planned = 0;
+  database->plan_size = 0;
+  // Caching is off until database_cache
+  database->cache = NULL;
+  render_init(&database->blocks);
+  // Images are not sharded until database_shard
+  database->shards = NULL;
+}
+
+/**
+ *  Release all memory held by a database.
+ *
+ *  @param database The database.
+ **/
+void database_destroy(struct Database *database) {
+  tree_destroy(&database->tree);
+  snapshot_close(&database->snapshot);
+  // Pending journal records are committed
+  journal_close(&database->journal);
+  database_cache(database, 0);
+  render_destroy(&database->blocks);
+  if (database->shards != NULL) {
+    shards_destroy(database->shards);
+    free(database->shards);
+    database->shards = NULL;
+  }
+}
+
+/**
+ *  Insert a new image into the database.
+ *
+ *  @param database The database.
+ *  @param values The tokens of the INSERT OPERATION.
+ *  @return 0 on success; -1 if the operation could not be journaled [It is
+ *  then not applied].
+ **/
+int database_insert(struct Database *database, char **values) {
+  // A sharded database queues the image [Its shard counts the INSERT
+  // OPERATION]
+  if (database->shards != NULL) {
+    shards_insert(database->shards, values);
+    if (database->cache != NULL) {
+      cache_invalidate(database->cache, values);
+    }
+    return 0;
+  }
+  STATS_START(start);
+  // If journaling is on, journal the INSERT OPERATION before applying it
+  if ((database->journal.fd != -1) && 
+      (journal_append(&database->journal, values) == -1)) {
+    return -1;
+  }
+  helper_thaw(database);
+  tree_insert(&database->tree, values);
+  helper_plan(database);
+  if (database->cache != NULL) {
+    cache_invalidate(database->cache, values);
+  }
+  render_invalidate(&database->blocks, values);
+  STATS_RECORD(INSERT, start);
+  return 0;
+}
+
+/**
+ *  Delete an image, or a branch of images, from the database.
+ *
+ *  @param database The database.
+ *  @param values The tokens of the DELETE OPERATION.
+ *  @return The number of images deleted, or -1 if the operation is 
+ *  invalid [OR] could not be journaled [It is then not applied].
+ **/
+long database_delete(struct Database *database, char **values) {
+  long result;
+  if (database->shards != NULL) {
+    result = shards_delete(database->shards, values);
+    if ((result > 0) && (database->cache != NULL)) {
+      cache_invalidate(database->cache, values);
+    }
+    return result;
+  }
+  STATS_START(start);
+  // Only trailing values may be *
+  if (tree_check_delete(values) == -1) {
+    return -1;
+  }
+  // If journaling is on, journal the DELETE OPERATION before applying it
+  if ((database->journal.fd != -1) && 
+      (journal_append(&database->journal, values) == -1)) {
+    return -1;
+  }
+  // An open snapshot is only thawed if images may be deleted
+  if (!helper_may_delete(database, values)) {
+    STATS_RECORD(DELETE, start);
+    return 0;
+  }
+  helper_thaw(database);
+  result = tree_delete(&database->tree, values);
+  helper_plan(database);
+  if ((result > 0) && (database->cache != NULL)) {
+    cache_invalidate(database->cache, values);
+  }
+  if (result > 0) {
+    render_invalidate(&database->blocks, values);
+  }
+  STATS_RECORD(DELETE, start);
+  return result;
+}
+
+/**
+ *  A helper function that prints all files with matching attribute values,
+ *  from the shards if sharded, from the snapshot if one is open, or else
+ *  from the tree.
+ *
+ *  @param database The database.
+ *  @param values The tokens of the QUERY OPERATION.
+ *  @param output The sink to print to.
+ **/
+static void helper_search(const struct Database *database, char **values,
+			  struct Output *output) {
+  if (database->shards != NULL) {
+    shards_search(database->shards, values, output);
+  }
+  else if (database->snapshot.data != NULL) {
+    snapshot_search(&database->snapshot, values, output);
+  }
+  else {
+    tree_search(&database->tree, values, output);
+  }
+}
+
+/**
+ *  Print all files with matching attribute values. Results of recent 
+ *  QUERY OPERATIONS are served from the cache, if caching is on.
+ *
+ *  @param database The database.
+ *  @param values The tokens of the QUERY OPERATION.
+ *  @param output The sink to print to.
+ **/
+void database_search(const struct Database *database, char **values,
+		     struct Output *output) {
+  // Collects the result to be cached
+  struct Output result;
+  STATS_START(start);
+  // If caching is off, the result goes straight to the sink
+  if (database->cache == NULL) {
+    helper_search(database, values, output);
+  }
+  // Else, unless it is cached, the result is collected, cached and copied
+  else if (!cache_lookup(database->cache, values, output)) {
+    output_init_memory(&result);
+    helper_search(database, values, &result);
+    cache_store(database->cache, values, result.buffer, result.used);
+    output_append(output, result.buffer, result.used);
+    output_destroy(&result);
+  }
+  STATS_RECORD(QUERY, start);
+}
+
+/**
+ *  Print one page of the files with matching attribute values.
+ *
+ *  @param database The database.
+ *  @param values The tokens of the QUERY OPERATION.
+ *  @param offset The number of matching files before the page.
+ *  @param limit The largest number of files of the page.
+ *  @param output The sink to print to.
+ **/
+void database_search_page(const struct Database *database, char **values,
+			  size_t offset, size_t limit, 
+			  struct Output *output) {
+  // A whole page is a QUERY OPERATION [Its result may be cached]
+  if ((offset == 0) && (limit == PAGE_ALL)) {
+    database_search(database, values, output);
+    return;
+  }
+  // A sharded database pages its shards [Each counts its QUERY OPERATION]
+  if (database->shards != NULL) {
+    shards_search_page(database->shards, values, offset, limit, output);
+    return;
+  }
+  STATS_START(start);
+  if (database->snapshot.data != NULL) {
+    snapshot_search_page(&database->snapshot, values, offset, limit, 
+			 output);
+  }
+  else {
+    tree_search_page(&database->tree, values, offset, limit, output);
+  }
+  STATS_RECORD(QUERY, start);
+}
+
+/**
+ *  Return the number of images with matching attribute values, from the 
+ *  shards if sharded, from the snapshot if one is open, or else from the 
+ *  tree.
+ *
+ *  @param database The database.
+ *  @param values The tokens of the QUERY OPERATION.
+ *  @return The number of matching images.
+ **/
+size_t database_count_matches(const struct Database *database, 
+			      char **values) {
+  if (database->shards != NULL) {
+    return shards_count(database->shards, values);
+  }
+  if (database->snapshot.data != NULL) {
+    return snapshot_count(&database->snapshot, values);
+  }
+  return tree_count(&database->tree, values);
+}
+
+/**
+ *  Print the number of images with matching attribute values.
+ *
+ *  @param database The database.
+ *  @param values The tokens of the COUNT OPERATION [Every value given].
+ *  @param output The sink to print to.
+ **/
+void database_count_query(const struct Database *database, char **values,
+			  struct Output *output) {
+  // Holds the number, as text
+  char buf[32];
+  int size;
+  STATS_START(start);
+  size = snprintf(buf, sizeof(buf), "%zu\n", 
+		  database_count_matches(database, values));
+  output_append(output, buf, size);
+  STATS_RECORD(COUNT, start);
+}
+
+/**
+ *  Print all images in the database.
+ *
+ *  @param database The database.
+ *  @param output The sink to print to.
+ **/
+void database_print(struct Database *database, struct Output *output) {
+  // A sharded database prints its shards [Each counts its PRINT OPERATION]
+  if (database->shards != NULL) {
+    shards_print(database->shards, output);
+    return;
+  }
+  STATS_START(start);
+  if (database->snapshot.data != NULL) {
+    snapshot_print(&database->snapshot, output);
+  }
+  else {
+    render_print(&database->blocks, &database->tree, output);
+  }
+  STATS_RECORD(PRINT, start);
+}
+
+/**
+ *  Print one page of the images in the database.
+ *
+ *  @param database The database.
+ *  @param offset The number of images before the page.
+ *  @param limit The largest number of images of the page.
+ *  @param output The sink to print to.
+ **/
+void database_print_page(struct Database *database, size_t offset, 
+			 size_t limit, struct Output *output) {
+  // A whole page is a PRINT OPERATION [Its blocks may be rendered already]
+  if ((offset == 0) && (limit == PAGE_ALL)) {
+    database_print(database, output);
+    return;
+  }
+  // A sharded database pages its shards [Each counts its PRINT OPERATION]
+  if (database->shards != NULL) {
+    shards_print_page(database->shards, offset, limit, output);
+    return;
+  }
+  STATS_START(start);
+  if (database->snapshot.data != NULL) {
+    snapshot_print_page(&database->snapshot, offset, limit, output);
+  }
+  else {
+    tree_print_page(&database->tree, offset, limit, output);
+  }
+  STATS_RECORD(PRINT, start);
+}
+
+/**
+ *  Print the statistics of the database.
+ *
+ *  @param database The database.
+ *  @param output The sink to print to.
+ **/
+void database_stats(const struct Database *database, struct Output *output) {
+  struct StatsShape shape;
+  STATS_START(start);
+  if (database->shards != NULL) {
+    shards_stats(database->shards, output);
+  }
+  else {
+    database_shape(database, &shape);
+    stats_report(output, &shape, &database->tree.arena);
+  }
+  if (database->cache != NULL) {
+    cache_report(database->cache, output);
+  }
+  if (database->shards == NULL) {
+    render_report(&database->blocks, output);
+  }
+  // An open snapshot is not filtered
+  if ((database->shards == NULL) && (database->snapshot.data == NULL)) {
+    filter_report(&database->tree.filter, database->tree.num_images, output);
+  }
+  STATS_RECORD(STATS, start);
+}
+
+/**
+ *  Return the number of images of an unsharded database.
+ *
+ *  @param database The database.
+ *  @return The number of images.
+ **/
+size_t database_count(const struct Database *database) {
+  // Every image of a snapshot is one node of its last depth level
+  if (database->snapshot.data != NULL) {
+    return database->snapshot.header->num_nodes[NUM_LEVELS - 1];
+  }
+  return database->tree.num_images;
+}
+
+/**
+ *  Set the shape of the tree, or of the open snapshot, of an unsharded 
+ *  database.
+ *
+ *  @param database The database.
+ *  @param shape Set to the shape.
+ **/
+void database_shape(const struct Database *database,
+		    struct StatsShape *shape) {
+  if (database->snapshot.data != NULL) {
+    snapshot_shape(&database->snapshot, shape);
+  }
+  else {
+    tree_shape(&database->tree, shape);
+  }
+}
+
+/**
+ *  A helper function that reports an operation a sharded database does not
+ *  support.
+ *
+ *  @param database The database.
+ *  @return 1 if the database is sharded; 0 otherwise.
+ **/
+static int helper_is_sharded(const struct Database *database) {
+  if (database->shards != NULL) {
+    fprintf(stderr, "Not supported with shards.\n");
+    return 1;
+  }
+  return 0;
+}
+
+/**
+ *  Bulk-load an insert file into the database.
+ *
+ *  @param database The database.
+ *  @param file The insert file.
+ *  @return The number of images read.
+ **/
+size_t database_bulk_load(struct Database *database, FILE *file) {
+  size_t result = 0;
+  // Holds the input read from the file
+  struct Reader reader;
+  char *line;
+  size_t length;
+  // char* array to hold the tokens of an INSERT OPERATION
+  char *values[INPUT_ARG_MAX_NUM];
+  // A sharded database queues every image for its shard [As bulk_load
+  // reads the file]
+  if (database->shards != NULL) {
+    reader_init(&reader, fileno(file));
+    while ((line = reader_next_line(&reader, &length)) != NULL) {
+      if ((tokenize(line, values) != -1) && (values[0][0] == INSERT)) {
+	shards_insert(database->shards, values);
+	result++;
+      }
+      else {
+	fprintf(stderr, ERROR_MSG);
+      }
+    }
+    reader_destroy(&reader);
+    if (database->cache != NULL) {
+      cache_clear(database->cache);
+    }
+    return result;
+  }
+  helper_thaw(database);
+  result = bulk_load(&database->tree, file, 
+		     (database->journal.fd != -1) ? &database->journal : NULL);
+  helper_plan(database);
+  if (database->cache != NULL) {
+    cache_clear(database->cache);
+  }
+  render_clear(&database->blocks);
+  return result;
+}
+
+/**
+ *  Write the database to a snapshot file.
+ *
+ *  @param database The database.
+ *  @param path The path of the snapshot file.
+ *  @return 0 on success; -1 on failure.
+ **/
+int database_save(const struct Database *database, const char *path) {
+  int result;
+  if (helper_is_sharded(database)) {
+    return -1;
+  }
+  STATS_START(start);
+  // If a snapshot is open, it already holds the snapshot image
+  if (database->snapshot.data != NULL) {
+    result = snapshot_copy(&database->snapshot, path);
+  }
+  else {
+    result = snapshot_write(&database->tree, path);
+  }
+  STATS_RECORD(SAVE, start);
+  return result;
+}
+
+/**
+ *  Replace the contents of the database with a snapshot file. The snapshot
+ *  is mapped into memory, not read. If it cannot be mapped, the database 
+ *  is unchanged. An open journal stays open, but its records are replaced
+ *  by an INSERT OPERATION for every image of the snapshot: they were 
+ *  applied to the former contents, and replaying them after a restart 
+ *  would not rebuild the loaded ones.
+ *
+ *  @param database The database.
+ *  @param path The path of the snapshot file.
+ *  @return 0 on success; -1 on failure.
+ **/
+int database_load(struct Database *database, const char *path) {
+  struct Snapshot snapshot;
+  if (helper_is_sharded(database)) {
+    return -1;
+  }
+  STATS_START(start);
+  int result = snapshot_map(&snapshot, path);
+  if (result == 0) {
+    // Drop the former contents [The new tree is planned once thawed]
+    tree_destroy(&database->tree);
+    snapshot_close(&database->snapshot);
+    database->snapshot = snapshot;
+    database->plan_size = 0;
+    // The records of the former contents are dropped, and the journal is
+    // compacted to the images of the snapshot, so replaying it rebuilds 
+    // the loaded contents
+    if ((database->journal.fd != -1) && 
+	((journal_truncate(&database->journal) == -1) ||
+	 (snapshot_journal(&snapshot, &database->journal) == -1))) {
+      result = -1;
+    }
+    if (database->cache != NULL) {
+      cache_clear(database->cache);
+    }
+    render_clear(&database->blocks);
+  }
+  STATS_RECORD(LOAD, start);
+  return result;
+}
+
+/**
+ *  Replace the tree of the database with a snapshot image built from it, 
+ *  held in memory. Its depth levels are flat arrays, laid out in the order
+ *  QUERY and PRINT OPERATIONS read them, so they run with fewer cache 
+ *  misses than on the nodes of the tree, until the next INSERT [OR] DELETE
+ *  thaws it. Freezing an open snapshot does nothing.
+ *
+ *  @param database The database.
+ *  @return 0 on success; -1 if the tree is too large to freeze.
+ **/
+int database_freeze(struct Database *database) {
+  int result = 0;
+  // A sharded database freezes its shards [Each counts its FREEZE 
+  // OPERATION]
+  if (database->shards != NULL) {
+    return shards_freeze(database->shards);
+  }
+  STATS_START(start);
+  if (database->snapshot.data == NULL) {
+    result = snapshot_freeze(&database->snapshot, &database->tree);
+    if (result == 0) {
+      // The tree is rebuilt [And planned again] once thawed
+      tree_destroy(&database->tree);
+      database->plan_size = 0;
+    }
+  }
+  STATS_RECORD(FREEZE, start);
+  return result;
+}
+
+/**
+ *  Replay a journal file on top of the database, and keep journaling every
+ *  later INSERT and DELETE OPERATION to it.
+ *
+ *  @param database The database.
+ *  @param path The path of the journal file.
+ *  @param batch_size The number of records per group commit.
+ *  @return 0 on success; -1 on failure.
+ **/
+int database_open_journal(struct Database *database, const char *path,
+			  int batch_size) {
+  // char* array to hold the tokens of a journaled operation
+  char *values[INPUT_ARG_MAX_NUM];
+  // Holds the result of opening the journal
+  int result;
+  if (helper_is_sharded(database)) {
+    return -1;
+  }
+  // Close any former journal
+  journal_close(&database->journal);
+  result = journal_open(&database->journal, path, batch_size);
+  if (result == 0) {
+    // Replay every journaled operation [Without journaling it again]
+    while (journal_replay(&database->journal, values)) {
+      helper_thaw(database);
+      if (values[0][0] == DELETE) {
+	tree_delete(&database->tree, values);
+      }
+      else {
+	tree_insert(&database->tree, values);
+      }
+    }
+    helper_plan(database);
+    if (database->cache != NULL) {
+      cache_clear(database->cache);
+    }
+    render_clear(&database->blocks);
+  }
+  return result;
+}
+
+/**
+ *  Plan the depth levels of the tree of the database from now on. A 
+ *  planned tree is rebuilt each time its number of images doubles, so the
+ *  rebuilds cost O(1) amortized per image.
+ *
+ *  @param database The database.
+ **/
+void database_plan(struct Database *database) {
+  if (database->shards != NULL) {
+    shards_plan(database->shards);
+    return;
+  }
+  database->is_planned = 1;
+  database->plan_size = 0;
+  helper_plan(database);
+}
+
+/**
+ *  Set the number of results of QUERY OPERATIONS the database caches. Any
+ *  cached result is dropped.
+ *
+ *  @param database The database.
+ *  @param capacity The number of results [0 turns caching off].
+ **/
+void database_cache(struct Database *database, size_t capacity) {
+  if (database->cache != NULL) {
+    cache_destroy(database->cache);
+    free(database->cache);
+    database->cache = NULL;
+  }
+  if (capacity > 0) {
+    database->cache = malloc(sizeof(struct QueryCache));
+    if (database->cache == NULL) {
+      perror("malloc");
+      exit(1);
+    }
+    cache_init(database->cache, capacity);
+  }
+}
+
+/**
+ *  Set the false positive rate of the query filter of the database.
+ *
+ *  @param database The database.
+ *  @param rate The false positive rate [0 turns the filter off].
+ **/
+void database_filter(struct Database *database, double rate) {
+  if (database->shards != NULL) {
+    shards_filter(database->shards, rate);
+  }
+  else {
+    tree_filter(&database->tree, rate);
+  }
+}
+
+/**
+ *  Split the images of an empty database over shards from now on.
+ *
+ *  @param database The database.
+ *  @param num_shards The number of shards.
+ **/
+void database_shard(struct Database *database, int num_shards) {
+  database->shards = malloc(sizeof(struct Shards));
+  if (database->shards == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+  shards_init(database->shards, num_shards);
+}
+
+/**
+ *  Wait for the queued images of the shards of a database, if sharded.
+ *
+ *  @param database The database.
+ **/
+void database_drain(struct Database *database) {
+  if (database->shards != NULL) {
+    shards_drain(database->shards);
+  }
+}
+
+/**
+ *  Fold the journal into a new snapshot file. The journal is only emptied
+ *  once the snapshot is safely in place; should a crash happen in between,
+ *  replaying the journal on top of the new snapshot is harmless, since
+ *  inserts are idempotent.
+ *
+ *  @param database The database.
+ *  @param path The path of the snapshot file.
+ *  @return 0 on success; -1 on failure.
+ **/
+int database_compact(struct Database *database, const char *path) {
+  if (helper_is_sharded(database)) {
+    return -1;
+  }
+  STATS_START(start);
+  int result = database_save(database, path);
+  if ((result == 0) && (database->journal.fd != -1)) {
+    result = journal_truncate(&database->journal);
+  }
+  STATS_RECORD(COMPACT, start);
+  return result;
+}
@@ -0,0 +1,168 @@
+/**
+ *  The image database: a tree of images, or a snapshot of one.
+ **/
+
+#ifndef _DATABASE_H
+#define _DATABASE_H
+
+#include <stdio.h>
+
+#include "cache.h"
+#include "journal.h"
+#include "render.h"
+#include "snapshot.h"
+#include "tree.h"
+
+struct Shards;
+
+// Smallest number of images at which a planned database is planned again
+#define DATABASE_PLAN_MIN	64
+
+
+struct Database {
+	// Holds the images, unless a snapshot is open
+	struct Tree tree;
+	// Holds the images after a snapshot was loaded or the tree was frozen,
+	// until the next insert
+	struct Snapshot snapshot;
+	// Journal of the INSERT and DELETE OPERATIONS since the last snapshot
+	// [Its fd is -1 if journaling is off]
+	struct Journal journal;
+	// Indicates if the depth levels of the tree are planned, and the number
+	// of images at which they are planned next
+	int is_planned;
+	size_t plan_size;
+	// Holds the results of recent QUERY OPERATIONS [NULL if caching is off]
+	struct QueryCache *cache;
+	// Holds the output of the last PRINT OPERATION, by Attribute 1 (A1)
+	struct RenderCache blocks;
+	// Holds the images instead, split over shards [NULL unless sharded]
+	struct Shards *shards;
+};
+
+void database_init(struct Database *);
+void database_destroy(struct Database *);
+
+/*
+ * INSERT, QUERY and PRINT OPERATIONS. Same arguments as the tree functions.
+ * PRINT OPERATIONS only render again what changed since the last one. An 
+ * INSERT OPERATION returns 0, or -1 if it could not be journaled [It is 
+ * then not applied].
+ */
+int database_insert(struct Database *, char **);
+void database_search(const struct Database *, char **, struct Output *);
+void database_print(struct Database *, struct Output *);
+
+/*
+ * QUERY and PRINT OPERATIONS of one page: the given number of results are
+ * skipped, and at most the given number output [See tree_search_page]. A
+ * whole page [Offset 0; limit PAGE_ALL] is served as by database_search 
+ * and database_print; any other page is neither cached nor rendered ahead.
+ */
+void database_search_page(const struct Database *, char **, size_t, size_t,
+			  struct Output *);
+void database_print_page(struct Database *, size_t, size_t, struct Output *);
+
+/*
+ * COUNT OPERATION: Print the number of images matching the tokens of a 
+ * QUERY OPERATION.
+ */
+void database_count_query(const struct Database *, char **, 
+			  struct Output *);
+
+/*
+ * Return the number of images matching the tokens of a QUERY OPERATION.
+ */
+size_t database_count_matches(const struct Database *, char **);
+
+/*
+ * DELETE OPERATION. Same arguments and return value as tree_delete; also 
+ * -1 if it could not be journaled [It is then not applied].
+ */
+long database_delete(struct Database *, char **);
+
+/*
+ * STATS OPERATION: Print operation counts and latencies, hot-path counters,
+ * allocations and the shape of the tree.
+ */
+void database_stats(const struct Database *, struct Output *);
+
+/*
+ * Bulk-load an insert file. Return the number of images read.
+ */
+size_t database_bulk_load(struct Database *, FILE *);
+
+/*
+ * SAVE and LOAD OPERATIONS. Return 0 on success, -1 on failure.
+ */
+int database_save(const struct Database *, const char *);
+int database_load(struct Database *, const char *);
+
+/*
+ * FREEZE OPERATION: Turn the tree into a snapshot image in memory, which 
+ * serves QUERY and PRINT OPERATIONS until the next INSERT [OR] DELETE. 
+ * Return 0 on success, -1 on failure.
+ */
+int database_freeze(struct Database *);
+
+/*
+ * Replay a journal file on top of the database and journal every later
+ * INSERT and DELETE OPERATION to it, syncing after each batch of the given
+ * size.
+ * Return 0 on success, -1 on failure.
+ */
+int database_open_journal(struct Database *, const char *, int);
+
+/*
+ * Order the attribute depth levels of the tree by increasing number of 
+ * distinct values [See tree_plan] now, and again whenever the number of 
+ * images doubles. Output is unchanged.
+ */
+void database_plan(struct Database *);
+
+/*
+ * Cache the results of up to the given number of QUERY OPERATIONS from now
+ * on [0 turns caching off]. INSERT and DELETE OPERATIONS drop the results
+ * they may change.
+ */
+void database_cache(struct Database *, size_t);
+
+/*
+ * Size the query filter for the given false positive rate from now on [0
+ * turns it off]. QUERY OPERATIONS of exact attribute values that it rules
+ * out print (NULL) without walking the tree.
+ */
+void database_filter(struct Database *, double);
+
+/*
+ * Split the images of the empty database over the given number of shards,
+ * each inserting in its own thread [See shards_init]. SAVE, LOAD and 
+ * COMPACT OPERATIONS and journaling are then not supported.
+ */
+void database_shard(struct Database *, int);
+
+/*
+ * Wait until every queued image of a sharded database is inserted, so that
+ * several threads may then read it [See batch_query]. Nothing to do for an
+ * unsharded database.
+ */
+void database_drain(struct Database *);
+
+/*
+ * Return the number of images of an unsharded database.
+ */
+size_t database_count(const struct Database *);
+
+/*
+ * Set the shape of the tree, or of the open snapshot, of an unsharded 
+ * database.
+ */
+void database_shape(const struct Database *, struct StatsShape *);
+
+/*
+ * COMPACT OPERATION: Write the database to a snapshot file, then empty the
+ * journal. Return 0 on success, -1 on failure.
+ */
+int database_compact(struct Database *, const char *);
+
+#endif /* _DATABASE_H */
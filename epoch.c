@@ -0,0 +1,153 @@
+/**
+ *  Epoch-based reclamation. The writer never frees memory that readers may
+ *  reach; it retires it, tagged with the current global epoch. A reader 
+ *  announces the global epoch when it starts reading. Memory retired in an
+ *  epoch was unlinked before any reader that announced a later epoch 
+ *  started, so it can be reused once every active reader announced a 
+ *  later epoch.
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "epoch.h"
+
+/**
+ *  Initialize epochs.
+ *
+ *  @param epochs The epochs.
+ *  @param arena The arena that receives retired memory.
+ **/
+void epoch_init(struct Epochs *epochs, struct Arena *arena) {
+  int i;
+  // Epoch 0 means "not reading", so the first epoch is 1
+  epochs->global = 1;
+  for (i = 0; i < EPOCH_MAX_READERS; i++) {
+    epochs->readers[i] = 0;
+  }
+  epochs->num_readers = 0;
+  // The retired list is allocated by the first retirement
+  epochs->retired = NULL;
+  epochs->num_retired = 0;
+  epochs->capacity = 0;
+  epochs->arena = arena;
+}
+
+/**
+ *  Register a reader thread.
+ *
+ *  @param epochs The epochs.
+ *  @return The number of the reader, or -1 if there are too many readers.
+ **/
+int epoch_register(struct Epochs *epochs) {
+  int result = __atomic_fetch_add(&epochs->num_readers, 1, __ATOMIC_SEQ_CST);
+  if (result >= EPOCH_MAX_READERS) {
+    result = -1;
+  }
+  return result;
+}
+
+/**
+ *  Mark the start of a read. The announced epoch must still be current 
+ *  once it is visible to the writer, or the writer may already have 
+ *  judged this reader to be idle, so it is announced again until it is.
+ *
+ *  @param epochs The epochs.
+ *  @param reader The number of the reader.
+ **/
+void epoch_enter(struct Epochs *epochs, int reader) {
+  unsigned long epoch;
+  do {
+    epoch = __atomic_load_n(&epochs->global, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&epochs->readers[reader], epoch, __ATOMIC_SEQ_CST);
+  } while (__atomic_load_n(&epochs->global, __ATOMIC_SEQ_CST) != epoch);
+}
+
+/**
+ *  Mark the end of a read.
+ *
+ *  @param epochs The epochs.
+ *  @param reader The number of the reader.
+ **/
+void epoch_exit(struct Epochs *epochs, int reader) {
+  __atomic_store_n(&epochs->readers[reader], 0, __ATOMIC_RELEASE);
+}
+
+/**
+ *  Retire memory unlinked by the writer.
+ *
+ *  @param epochs The epochs.
+ *  @param ptr The memory.
+ *  @param size The size of the memory.
+ **/
+void epoch_retire(struct Epochs *epochs, void *ptr, size_t size) {
+  // If there are no readers, the memory can be reused right away
+  if (__atomic_load_n(&epochs->num_readers, __ATOMIC_SEQ_CST) == 0) {
+    arena_free(epochs->arena, ptr, size);
+    return;
+  }
+  // If the retired list is full, try to empty it before growing it
+  if (epochs->num_retired == epochs->capacity) {
+    epoch_collect(epochs);
+  }
+  if (epochs->num_retired == epochs->capacity) {
+    epochs->capacity = (epochs->capacity == 0) ? EPOCH_INITIAL_RETIRED :
+      (epochs->capacity * 2);
+    epochs->retired = realloc(epochs->retired, sizeof(struct EpochRetired) *
+			      epochs->capacity);
+    if (epochs->retired == NULL) {
+      perror("realloc");
+      exit(1);
+    }
+  }
+  epochs->retired[epochs->num_retired].ptr = ptr;
+  epochs->retired[epochs->num_retired].size = size;
+  epochs->retired[epochs->num_retired].epoch = epochs->global;
+  epochs->num_retired++;
+}
+
+/**
+ *  Hand back every retired allocation that no reader can hold any more.
+ *
+ *  @param epochs The epochs.
+ **/
+void epoch_collect(struct Epochs *epochs) {
+  // Holds the oldest epoch announced by an active reader
+  unsigned long oldest;
+  unsigned long epoch;
+  size_t i;
+  size_t num_kept = 0;
+  int reader;
+  // Start a new epoch. Readers that start from now on cannot reach 
+  // anything retired so far
+  oldest = __atomic_add_fetch(&epochs->global, 1, __ATOMIC_SEQ_CST);
+  for (reader = 0; (reader < epochs->num_readers) && 
+	 (reader < EPOCH_MAX_READERS); reader++) {
+    epoch = __atomic_load_n(&epochs->readers[reader], __ATOMIC_SEQ_CST);
+    if ((epoch != 0) && (epoch < oldest)) {
+      oldest = epoch;
+    }
+  }
+  // Hand back what was retired before the oldest active reader started,
+  // and keep the rest in order
+  for (i = 0; i < epochs->num_retired; i++) {
+    if (epochs->retired[i].epoch < oldest) {
+      arena_free(epochs->arena, epochs->retired[i].ptr, 
+		 epochs->retired[i].size);
+    }
+    else {
+      epochs->retired[num_kept++] = epochs->retired[i];
+    }
+  }
+  epochs->num_retired = num_kept;
+}
+
+/**
+ *  Release the list of retired allocations.
+ *
+ *  @param epochs The epochs.
+ **/
+void epoch_destroy(struct Epochs *epochs) {
+  free(epochs->retired);
+  epoch_init(epochs, epochs->arena);
+}
@@ -0,0 +1,90 @@
+/**
+ *  Epoch-based reclamation, so that one writer can replace memory that
+ *  concurrent readers may still be using.
+ *
+ *  Within the program itself, no reader runs alongside the writer: the 
+ *  server is a single thread, a batch runs against a database that does 
+ *  not change, and sharded reads wait until every ingest thread involved 
+ *  is drained. None registers, so the writer keeps changing memory in 
+ *  place. Only the concurrency stress test ["Testing Files/stress.c"] 
+ *  registers readers, and exercises the paths that retire memory.
+ **/
+
+#ifndef _EPOCH_H
+#define _EPOCH_H
+
+#include <stddef.h>
+
+#include "arena.h"
+
+// Maximum number of registered reader threads
+#define EPOCH_MAX_READERS	64
+// Initial number of retired allocations held before they are collected
+#define EPOCH_INITIAL_RETIRED	256
+
+// Store a pointer or count after everything it refers to was written, and
+// load it so that everything written before the store is visible
+#define ATOMIC_PUBLISH(field, value) \
+  __atomic_store_n(&(field), (value), __ATOMIC_RELEASE)
+#define ATOMIC_READ(field) __atomic_load_n(&(field), __ATOMIC_ACQUIRE)
+
+
+// An allocation that was unlinked by the writer, and the epoch it was
+// unlinked in
+struct EpochRetired {
+	void *ptr;
+	size_t size;
+	unsigned long epoch;
+};
+
+struct Epochs {
+	// Incremented by the writer every time it collects retired memory
+	unsigned long global;
+	// The epoch each reader entered [0 while it is not reading]
+	unsigned long readers[EPOCH_MAX_READERS];
+	int num_readers;
+	// Retired allocations, in the order they were retired
+	struct EpochRetired *retired;
+	size_t num_retired;
+	size_t capacity;
+	// Receives retired allocations once no reader can hold them
+	struct Arena *arena;
+};
+
+/*
+ * Initialize epochs whose retired memory is handed back to the given arena.
+ */
+void epoch_init(struct Epochs *, struct Arena *);
+
+/*
+ * Register a reader thread. Readers must be registered before they run
+ * alongside the writer. Return the reader's number, or -1 if there are
+ * too many readers.
+ */
+int epoch_register(struct Epochs *);
+
+/*
+ * Mark the start and end of a read by the given reader. Memory the reader
+ * reaches in between is not reused until the read ends.
+ */
+void epoch_enter(struct Epochs *, int);
+void epoch_exit(struct Epochs *, int);
+
+/*
+ * Hand memory unlinked by the writer back to the arena, as soon as no 
+ * reader can hold it. Writer only.
+ */
+void epoch_retire(struct Epochs *, void *, size_t);
+
+/*
+ * Hand back every retired allocation that no reader can hold any more.
+ * Writer only.
+ */
+void epoch_collect(struct Epochs *);
+
+/*
+ * Release the list of retired allocations. Their memory stays in the arena.
+ */
+void epoch_destroy(struct Epochs *);
+
+#endif /* _EPOCH_H */
@@ -0,0 +1,360 @@
+/**
+ *  Negative query filter of the image database. Many QUERY OPERATIONS name
+ *  an exact value of every attribute, and find nothing; each still walks a
+ *  sibling node list per depth level before it gives up. A blocked Bloom
+ *  filter of the attribute tuples of the images answers most of them
+ *  without touching the tree: every tuple sets a few bits of one 512-bit
+ *  block [One cache line], so a check costs one cache miss at most.
+ *
+ *  A Bloom filter cannot forget a tuple, so deleted tuples only count as
+ *  stale, and still pass; the filter is rebuilt from the tree once most of
+ *  its tuples are stale, or once it holds as many tuples as it was sized
+ *  for. New blocks are filled before they are published, and the former
+ *  blocks are retired, since readers may still be checking them.
+ **/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "filter.h"
+#include "match.h"
+#include "tree.h"
+
+// Largest number of bits set per tuple
+#define FILTER_MAX_HASHES	16
+// Largest number of bits per tuple
+#define FILTER_MAX_BITS	64
+
+
+/**
+ *  A helper function that hashes an attribute tuple, from the hashes of
+ *  its interned values.
+ *
+ *  @param values The interned values, in attribute order.
+ *  @return The 64-bit hash of the tuple.
+ **/
+static uint64_t helper_hash(const struct InternedString **values) {
+  uint64_t hash = 0x9e3779b97f4a7c15ull;
+  int attribute;
+  for (attribute = 0; attribute < NUM_ATTRIBUTES; attribute++) {
+    hash = (hash ^ values[attribute]->hash) * 0x100000001b3ull;
+  }
+  // Mix every bit into every other [The splitmix64 finalizer]
+  hash = (hash ^ (hash >> 30)) * 0xbf58476d1ce4e5b9ull;
+  hash = (hash ^ (hash >> 27)) * 0x94d049bb133111ebull;
+  return hash ^ (hash >> 31);
+}
+
+/**
+ *  A helper function that finds the block of a tuple, and the first bit and
+ *  the step of the bits it sets in that block.
+ *
+ *  @param blocks The blocks.
+ *  @param hash The hash of the tuple.
+ *  @param bit Set to the first bit.
+ *  @param step Set to the step between bits.
+ *  @return The first word of the block.
+ **/
+static uint64_t *helper_block(const struct FilterBlocks *blocks,
+			      uint64_t hash, uint32_t *bit, uint32_t *step) {
+  // The high half picks the block, without a division
+  size_t block = (size_t) (((hash >> 32) * blocks->num_blocks) >> 32);
+  // The step comes from the hash mixed again, so tuples of the same block
+  // do not share it
+  uint64_t mixed = hash * 0xff51afd7ed558ccdull;
+  *bit = (uint32_t) hash;
+  *step = (uint32_t) (mixed ^ (mixed >> 33)) | 1;
+  return blocks->words + block * FILTER_BLOCK_WORDS;
+}
+
+/**
+ *  A helper function that estimates the false positive rate of a blocked 
+ *  Bloom filter. The number of tuples of a block is Poisson distributed, 
+ *  and a block of more tuples has a higher rate than the filter overall.
+ *
+ *  @param num_hashes The number of bits set per tuple.
+ *  @param load The mean number of tuples per block.
+ *  @return The false positive rate.
+ **/
+static double helper_rate(int num_hashes, double load) {
+  double result = 0;
+  // Probability that a block holds num_tuples tuples
+  double weight = exp(-load);
+  int num_tuples;
+  for (num_tuples = 0; num_tuples < load + 10 * sqrt(load) + 20; 
+       num_tuples++) {
+    result += weight * pow(1 - pow(1 - 1.0 / FILTER_BLOCK_BITS, 
+				   num_hashes * num_tuples), num_hashes);
+    weight *= load / (num_tuples + 1);
+  }
+  return result;
+}
+
+/**
+ *  A helper function that allocates empty blocks for a number of tuples.
+ *
+ *  @param filter The query filter.
+ *  @param capacity The number of tuples.
+ *  @return The blocks.
+ **/
+static struct FilterBlocks *helper_alloc_blocks(struct QueryFilter *filter,
+						size_t capacity) {
+  // Bits per tuple of a plain Bloom filter of the rate, and the number of
+  // bits set per tuple that gets closest to it
+  double bits = -log(filter->rate) / (M_LN2 * M_LN2);
+  long num_hashes = lround(bits * M_LN2);
+  size_t num_blocks;
+  size_t size;
+  struct FilterBlocks *result;
+  num_hashes = (num_hashes < 1) ? 1 : 
+    ((num_hashes > FILTER_MAX_HASHES) ? FILTER_MAX_HASHES : num_hashes);
+  // A blocked filter needs a few more bits for the same rate
+  while ((bits < FILTER_MAX_BITS) &&
+	 (helper_rate(num_hashes, FILTER_BLOCK_BITS / bits) > filter->rate)) {
+    bits += 0.25;
+  }
+  num_blocks = (size_t) ceil(bits * capacity / FILTER_BLOCK_BITS);
+  if (num_blocks == 0) {
+    num_blocks = 1;
+  }
+  // Room to align the blocks to a cache line
+  size = sizeof(struct FilterBlocks) + 64 +
+    num_blocks * FILTER_BLOCK_WORDS * sizeof(uint64_t);
+  result = arena_alloc(filter->epochs->arena, size);
+  result->size = size;
+  result->num_blocks = num_blocks;
+  result->num_hashes = num_hashes;
+  result->words = (uint64_t *)
+    (((uintptr_t) (result + 1) + 63) & ~(uintptr_t) 63);
+  memset(result->words, 0, num_blocks * FILTER_BLOCK_WORDS *
+	 sizeof(uint64_t));
+  filter->capacity = capacity;
+  return result;
+}
+
+/**
+ *  A helper function that sets the bits of a tuple.
+ *
+ *  @param blocks The blocks to set them in.
+ *  @param values The interned values of the tuple, in attribute order.
+ **/
+static void helper_set(struct FilterBlocks *blocks,
+		       const struct InternedString **values) {
+  uint32_t bit;
+  uint32_t step;
+  uint64_t *words = helper_block(blocks, helper_hash(values), &bit, &step);
+  int i;
+  for (i = 0; i < blocks->num_hashes; i++, bit += step) {
+    // The top 9 bits pick one of the bits of the block [Readers may be
+    // checking the same word]
+    __atomic_fetch_or(&words[bit >> 29], 1ull << ((bit >> 23) & 63),
+		      __ATOMIC_RELAXED);
+  }
+}
+
+/**
+ *  A helper function that adds the tuple of every node of the last
+ *  attribute depth level below a node to new blocks, and counts it.
+ *
+ *  @param filter The query filter.
+ *  @param blocks The new blocks [NULL to only count the tuples].
+ *  @param tree A pointer to the tree.
+ *  @param node The node.
+ *  @param depth_level The depth level of its child nodes.
+ *  @param values Holds the values of the path to the node, in attribute
+ *  order.
+ **/
+static void helper_add_branch(struct QueryFilter *filter,
+			      struct FilterBlocks *blocks,
+			      const struct Tree *tree,
+			      const struct TreeNode *node, int depth_level,
+			      const struct InternedString **values) {
+  const struct TreeNode *child;
+  if (depth_level == NUM_ATTRIBUTES) {
+    if (blocks != NULL) {
+      helper_set(blocks, values);
+    }
+    filter->count++;
+    return;
+  }
+  for (child = node->child; child != NULL; child = child->sibling) {
+    values[tree->order[depth_level]] = child->value;
+    helper_add_branch(filter, blocks, tree, child, depth_level + 1, values);
+  }
+}
+
+/**
+ *  Initialize an empty query filter.
+ *
+ *  @param filter The query filter.
+ *  @param epochs The epochs whose arena holds the blocks.
+ *  @param rate The false positive rate to size the filter for [0 turns it
+ *  off].
+ **/
+void filter_init(struct QueryFilter *filter, struct Epochs *epochs,
+		 double rate) {
+  memset(filter, 0, sizeof(struct QueryFilter));
+  filter->epochs = epochs;
+  filter->rate = rate;
+}
+
+/**
+ *  Add the attribute tuple of a new image to the filter of a tree.
+ *
+ *  @param filter The query filter.
+ *  @param tree A pointer to the tree, to rebuild the filter from once it is
+ *  full. Should the new image be reachable from the root node already, it
+ *  counts twice.
+ *  @param values The interned values of the tuple, in attribute order.
+ **/
+void filter_add(struct QueryFilter *filter, const struct Tree *tree,
+		const struct InternedString **values) {
+  if (filter->rate <= 0) {
+    return;
+  }
+  if ((filter->blocks == NULL) || (filter->count >= filter->capacity)) {
+    filter_rebuild(filter, tree, filter->rate);
+  }
+  helper_set(filter->blocks, values);
+  filter->count++;
+}
+
+/**
+ *  Count one attribute tuple of the filter as deleted.
+ *
+ *  @param filter The query filter.
+ **/
+void filter_remove(struct QueryFilter *filter) {
+  if (filter->blocks != NULL) {
+    filter->num_stale++;
+  }
+}
+
+/**
+ *  Rebuild the filter of a tree once most of its tuples are deleted.
+ *
+ *  @param filter The query filter.
+ *  @param tree A pointer to the tree.
+ **/
+void filter_collect(struct QueryFilter *filter, const struct Tree *tree) {
+  if ((filter->blocks != NULL) && (filter->num_stale * 2 > filter->count)) {
+    filter_rebuild(filter, tree, filter->rate);
+  }
+}
+
+/**
+ *  Rebuild a filter from the tuples of a tree.
+ *
+ *  @param filter The query filter.
+ *  @param tree A pointer to the tree.
+ *  @param rate The false positive rate to size the filter for [0 turns it
+ *  off].
+ **/
+void filter_rebuild(struct QueryFilter *filter, const struct Tree *tree,
+		    double rate) {
+  struct FilterBlocks *former = filter->blocks;
+  struct FilterBlocks *blocks = NULL;
+  // Holds the values of a path, in attribute order
+  const struct InternedString *values[NUM_ATTRIBUTES];
+  filter->rate = rate;
+  filter->count = 0;
+  filter->num_stale = 0;
+  filter->capacity = 0;
+  if (rate > 0) {
+    // Count the tuples, then size the blocks for twice as many
+    helper_add_branch(filter, NULL, tree, &tree->root, 0, values);
+    blocks = helper_alloc_blocks(filter, 
+				 (filter->count * 2 > FILTER_INITIAL_CAPACITY)
+				 ? (filter->count * 2) : FILTER_INITIAL_CAPACITY);
+    filter->count = 0;
+    helper_add_branch(filter, blocks, tree, &tree->root, 0, values);
+  }
+  ATOMIC_PUBLISH(filter->blocks, blocks);
+  // Hand the former blocks back to the arena once no reader holds them
+  if (former != NULL) {
+    epoch_retire(filter->epochs, former, former->size);
+  }
+}
+
+/**
+ *  Check the attribute values of a QUERY OPERATION against a filter.
+ *
+ *  @param filter The query filter.
+ *  @param strings The intern table of the tree.
+ *  @param values The tokens of the QUERY OPERATION.
+ *  @return 0 if no image can match; 1 if one may; -1 if the filter does not
+ *  apply.
+ **/
+int filter_check(const struct QueryFilter *filter,
+		 const struct InternTable *strings, char **values) {
+  const struct FilterBlocks *blocks = ATOMIC_READ(filter->blocks);
+  const struct InternedString *keys[NUM_ATTRIBUTES];
+  struct AttributeMatch match;
+  const uint64_t *words;
+  uint32_t bit;
+  uint32_t step;
+  int i;
+  if (blocks == NULL) {
+    return -1;
+  }
+  // Only a tuple of exact values is in the filter
+  for (i = 0; i < NUM_ATTRIBUTES; i++) {
+    match_parse(&match, values[i + 1]);
+    if (!match.is_exact) {
+      return -1;
+    }
+  }
+  STATS_COUNT(STATS_FILTER_CHECKS, 1);
+  // A value that was never interned is in no tuple
+  for (i = 0; i < NUM_ATTRIBUTES; i++) {
+    keys[i] = intern_find(strings, values[i + 1]);
+    if (keys[i] == NULL) {
+      STATS_COUNT(STATS_FILTER_REJECTS, 1);
+      return 0;
+    }
+  }
+  words = helper_block(blocks, helper_hash(keys), &bit, &step);
+  for (i = 0; i < blocks->num_hashes; i++, bit += step) {
+    if ((__atomic_load_n(&words[bit >> 29], __ATOMIC_RELAXED) &
+	 (1ull << ((bit >> 23) & 63))) == 0) {
+      STATS_COUNT(STATS_FILTER_REJECTS, 1);
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/**
+ *  Print the statistics of a query filter.
+ *
+ *  @param filter The query filter.
+ *  @param num_images The number of images of the tree.
+ *  @param output The sink to print to.
+ **/
+void filter_report(const struct QueryFilter *filter, size_t num_images,
+		   struct Output *output) {
+  char buf[256];
+  double rate;
+  size_t num_bytes;
+  int size;
+  if (filter->blocks == NULL) {
+    output_puts(output, "Query filter: off\n");
+    return;
+  }
+  num_bytes = filter->blocks->num_blocks * FILTER_BLOCK_BITS / 8;
+  rate = helper_rate(filter->blocks->num_hashes, (double) filter->count /
+		     filter->blocks->num_blocks);
+  size = snprintf(buf, sizeof(buf), "Query filter: %zu of %zu tuples (%zu "
+		  "stale), %d bits each, %zu bytes (%.0f per million images),"
+		  " false positive rate %.3g%% (sized for %.3g%%)\n",
+		  filter->count, filter->capacity, filter->num_stale,
+		  filter->blocks->num_hashes, num_bytes, (num_images > 0) ?
+		  (num_bytes * 1e6 / num_images) : 0.0, rate * 100,
+		  filter->rate * 100);
+  if (size > 0) {
+    output_append(output, buf, ((size_t) size < sizeof(buf)) ?
+		  (size_t) size : (sizeof(buf) - 1));
+  }
+}
@@ -0,0 +1,98 @@
+/**
+ *  Negative query filter of the image database.
+ **/
+
+#ifndef _FILTER_H
+#define _FILTER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "epoch.h"
+#include "intern.h"
+#include "output.h"
+
+// Number of bits of a block of a query filter [One cache line]
+#define FILTER_BLOCK_BITS	512
+#define FILTER_BLOCK_WORDS	(FILTER_BLOCK_BITS / 64)
+// Number of tuples a query filter is first sized for
+#define FILTER_INITIAL_CAPACITY	1024
+// False positive rate a query filter is sized for, unless set otherwise
+#define FILTER_DEFAULT_RATE	0.01
+
+struct Tree;
+
+// The bits of a query filter, replaced as a whole when it is rebuilt
+struct FilterBlocks {
+	// Size of the whole allocation
+	size_t size;
+	size_t num_blocks;
+	// Number of bits set per tuple
+	int num_hashes;
+	// The blocks, aligned to a cache line within the allocation
+	uint64_t *words;
+};
+
+struct QueryFilter {
+	// Blocked Bloom filter of the attribute tuples of the images [NULL if
+	// the filter is off]
+	struct FilterBlocks *blocks;
+	// False positive rate the filter is sized for [0 turns it off]
+	double rate;
+	// Number of tuples it is sized for, number added, and number of those
+	// deleted since [Their bits stay set until it is rebuilt]
+	size_t capacity;
+	size_t count;
+	size_t num_stale;
+	// Their arena holds the blocks
+	struct Epochs *epochs;
+};
+
+/*
+ * Initialize an empty query filter of the given false positive rate whose
+ * memory comes from the arena of the given epochs. Its blocks are
+ * allocated by the first tuple.
+ */
+void filter_init(struct QueryFilter *, struct Epochs *, double);
+
+/*
+ * Add the attribute tuple of a new image [Interned values, in attribute
+ * order] to the filter of a tree, rebuilding the filter from the tree once
+ * it is full. Writer only.
+ */
+void filter_add(struct QueryFilter *, const struct Tree *,
+		const struct InternedString **);
+
+/*
+ * Count one attribute tuple as deleted [Its bits stay set]. Writer only.
+ */
+void filter_remove(struct QueryFilter *);
+
+/*
+ * Rebuild the filter from the tree if most of its tuples are deleted.
+ * Writer only.
+ */
+void filter_collect(struct QueryFilter *, const struct Tree *);
+
+/*
+ * Rebuild the filter from the tuples of a tree, sized for twice as many,
+ * at the given false positive rate [0 turns the filter off]. Writer only.
+ */
+void filter_rebuild(struct QueryFilter *, const struct Tree *, double);
+
+/*
+ * Check the attribute values of a QUERY OPERATION against the filter.
+ * Return 0 if no image can match; 1 if one may; -1 if the filter does not
+ * apply [It is off, or a value is not exact]. May run alongside the
+ * writer, within an epoch.
+ */
+int filter_check(const struct QueryFilter *, const struct InternTable *,
+		 char **);
+
+/*
+ * Print the size, load and estimated false positive rate of the filter,
+ * and its memory per million images of the given number.
+ */
+void filter_report(const struct QueryFilter *, size_t, struct Output *);
+
+#endif /* _FILTER_H */
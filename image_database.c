@@ -5,32 +5,80 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
 
-#include "tree.h"
+#include "batch.h"
+#include "database.h"
+#include "reader.h"
+#include "server.h"
 #include "utils.h"
 
-// Symbol for INSERT OPERATION: Add new image to database
-#define INSERT 5
-// Symbol for QUERY OPERATION: Search for image in database
-#define QUERY 4
-// Symbol for PRINT OPERATION: Output all images in database
-#define PRINT 1
-// Error message
-#define ERROR_MSG "Invalid command.\n"
+// Command line usage
+#define USAGE_MSG "Usage: %s [-l <SNAPSHOT FILE>] [-j <JOURNAL FILE> " \
+  "[-g <BATCH SIZE>]] [-b <INSERT FILE>] [-o] [-f] [-c <ENTRIES>] " \
+  "[-e <RATE>] [-n <SHARDS>] [-q <QUERY FILE> [-t <THREADS>]] " \
+  "[-s <SOCKET PATH>]\n"
 
 /**
  *  Based on user input, either: Insert an image into the database (INSERT);
+ *  Delete an image [OR] a branch of images from the database (DELETE);
  *  Output all image filenames matching specified attributes (QUERY); 
  *  Output all image filenames with their respective attributes found in the
- *  database (PRINT). Program ends when EOF (Ctrl-D) is entered.
+ *  database (PRINT); Output statistics of the database (STATS); Write the
+ *  database to a snapshot file (SAVE); Replace the database with a 
+ *  snapshot file (LOAD); Fold the journal into a snapshot file (COMPACT);
+ *  Flatten the database into a snapshot image in memory (FREEZE); Output 
+ *  the number of images matching specified attributes (COUNT).
+ *  Program ends when EOF (Ctrl-D) is entered.
  * 
  *  ===========================================================================
  *  NOTE THE FOLLOWING: 
  *  ===========================================================================
+ *  OPTIONS (applied in this order, before any user input is read):
+ *  -l <SNAPSHOT FILE>: Load a snapshot file, as with LOAD.
+ *  -j <JOURNAL FILE>: Replay the journal file, then append every INSERT 
+ *  and DELETE OPERATION to it.
+ *  -g <BATCH SIZE>: Sync the journal after every BATCH SIZE INSERT and 
+ *  DELETE OPERATIONS (group commit). Defaults to 128.
+ *  -b <INSERT FILE>: Bulk-load the INSERT OPERATIONS of the file, sorted in
+ *  one pass.
+ *  -o: Store the attributes in the tree in order of increasing number of 
+ *  distinct values, planned from the images loaded so far and again each 
+ *  time the number of images doubles. Output is unchanged, but QUERY and 
+ *  PRINT sort their results.
+ *  -f: Freeze the database, as with FREEZE.
+ *  -c <ENTRIES>: Cache the results of up to ENTRIES recent QUERY 
+ *  OPERATIONS, 0 for none. Defaults to 1024. INSERT and DELETE OPERATIONS
+ *  drop only the results they may change.
+ *  -e <RATE>: Size the filter that rules out QUERY OPERATIONS of exact
+ *  attribute values no image has for a false positive rate of RATE, 0 for
+ *  no filter. Defaults to 0.01 [About 1.2 MB per million distinct 
+ *  attribute tuples, up to twice that as it fills].
+ *  -n <SHARDS>: Split the images over SHARDS databases by ranges of 
+ *  Attribute 1, each inserting in its own thread while user input is read.
+ *  Output is unchanged. Cannot be combined with -l or -j; SAVE, LOAD and
+ *  COMPACT are then not supported.
+ *  -q <QUERY FILE>: Run the QUERY OPERATIONS of the file in parallel, and
+ *  output their results in the order of the file.
+ *  -t <THREADS>: Number of worker threads for the query file. Defaults to
+ *  the number of online processors.
+ *  -s <SOCKET PATH>: Serve INSERT, DELETE, QUERY, PRINT, STATS, FREEZE and
+ *  COUNT OPERATIONS to clients on a Unix domain socket instead of reading
+ *  user input, until SIGINT or SIGTERM. Clients may pipeline requests; each
+ *  QUERY and COUNT OPERATION is answered with one line, and invalid input 
+ *  with the error message.
+ *  ===========================================================================
  *  INPUT SYNTAX:
  *  INSERT: i <ATTRIBUTE 1> <ATTRIBUTE 2> <ATTRIBUTE 3> <FILENAME>
- *  QUERY: q <ATTRIBUTE 1> <ATTRIBUTE 2> <ATTRIBUTE 3>
- *  PRINT: p
+ *  DELETE: d <ATTRIBUTE 1> <ATTRIBUTE 2> <ATTRIBUTE 3> <FILENAME>
+ *  QUERY: q <ATTRIBUTE 1> <ATTRIBUTE 2> <ATTRIBUTE 3> [<OFFSET> [<LIMIT>]]
+ *  PRINT: p [<OFFSET> [<LIMIT>]]
+ *  STATS: s
+ *  SAVE: w <SNAPSHOT FILE>
+ *  LOAD: l <SNAPSHOT FILE>
+ *  COMPACT: k <SNAPSHOT FILE>
+ *  FREEZE: f
+ *  COUNT: c <ATTRIBUTE 1> [<ATTRIBUTE 2> [<ATTRIBUTE 3>]]
  *  ===========================================================================
  *  OUTPUT SYNTAX:
  *  QUERY: <FILENAME 1> <FILENAME 2> ... <FILENAME n>, where n is the number of
@@ -38,55 +86,297 @@
  *  PRINT: LINE 1: <ATTRIBUTE 1> <ATTRIBUTE 2> <ATTRIBUTE 3> <FILENAME 1>
  *         LINE 2: <ATTRIBUTE 1> <ATTRIBUTE 2> <ATTRIBUTE 3> <FILENAME 2>
  *         LINE n: <ATTRIBUTE 1> <ATTRIBUTE 2> <ATTRIBUTE 3> <FILENAME n>
+ *  COUNT: <n>, where n is the number of images that match the specified 
+ *  attributes.
+ *  STATS: The count, latency percentiles and latency histogram of each
+ *  operation; nodes visited, string comparisons and sort swaps; arena 
+ *  allocations; the number of nodes and largest fanout of each depth level.
  *  ===========================================================================
+ *  > Images have NUM_ATTRIBUTES attributes [3 unless built otherwise], and
+ *  every OPERATION above but COUNT takes one value per attribute
  *  > If user input is invalid, outputs "Invalid command."
  *  > If there are no images in the database that match the specified
  *  attributes, QUERY outputs (NULL)
  *  > If there are no images in the database, PRINT outputs (NULL)
+ *  > DELETE outputs nothing. Trailing DELETE values may be *, to delete 
+ *  every image below the values before them (e.g., d a b * * deletes every
+ *  image whose first two attributes are a and b); a value after a * is 
+ *  invalid. Nodes left without images are removed and their memory reused
+ *  > A QUERY attribute may be: a value; * (any value); a prefix followed by
+ *  *; or an inclusive range <LOWER>..<UPPER>, where either bound may be left
+ *  out. Matching filenames are output in the same order as PRINT
  *  > PRINT outputs filename info in alphabetical order
+ *  > A loaded snapshot is searched and printed in place, without being read
+ *  into a tree, until the next INSERT
+ *  > QUERY and PRINT skip the first OFFSET results and output at most 
+ *  LIMIT of the rest [Every one if left out], as a page of the output 
+ *  without them; an empty page outputs (NULL). Results before the page are
+ *  skipped by the number of images below each node, so a deep page costs 
+ *  about as much as the first, unless the attributes are planned (-o)
+ *  > COUNT attributes are QUERY attributes; the ones left out are *. Nodes
+ *  all of whose images match are counted without being walked
+ *  > FREEZE outputs nothing. A frozen database is searched and printed like
+ *  a loaded snapshot, until the next INSERT [OR] DELETE rebuilds its tree
  **/
-int main(void) {
-        // char array to hold a line of input
-	char buf[BUFFER_SIZE] = {'\0'};
+int main(int argc, char **argv) {
+        // Reader of user input, and a line of it
+	struct Reader reader;
+	char *line = NULL;
+	size_t length;
         // char* array to hold the pointers to tokens
 	char *args[INPUT_ARG_MAX_NUM];
-        // the root of the tree
-        struct TreeNode root;
-        root.value = "";
-        root.child = NULL;
-        root.sibling = NULL;
-	// Reference to the root of the tree
-	struct TreeNode *root_ptr = &root;
+        // the database
+        struct Database database;
+        database_init(&database);
+	// Reference to the database
+	struct Database *root_ptr = &database;
+	// Buffered standard output
+	struct Output output;
+	// Indicates if results must be shown as soon as they are ready
+	int is_interactive = isatty(STDOUT_FILENO);
+	// Holds the current command line option
+	int option;
+	// Hold the files named by the command line options
+	const char *snapshot_path = NULL;
+	const char *journal_path = NULL;
+	const char *bulk_path = NULL;
+	// Holds the number of journal records per group commit
+	int batch_size = JOURNAL_DEFAULT_BATCH;
+	// Holds an insert file to bulk-load
+	FILE *bulk_file;
+	// Indicates if the depth levels are to be planned
+	int is_planned = 0;
+	// Indicates if the database is to be frozen once loaded
+	int is_frozen = 0;
+	// Holds the number of cached QUERY OPERATIONS
+	long cache_size = CACHE_DEFAULT_CAPACITY;
+	// Holds a query file to run in parallel
+	const char *query_path = NULL;
+	FILE *query_file;
+	// Holds the number of worker threads for the query file
+	int num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	// Holds the false positive rate of the query filter
+	double filter_rate = FILTER_DEFAULT_RATE;
+	// Holds the number of shards [0 if not sharded]
+	int num_shards = 0;
+	// Holds the socket to serve the database on
+	const char *socket_path = NULL;
+	// Holds the exit status
+	int status = 0;
+	// Process the command line options
+	while ((option = getopt(argc, argv, "l:j:g:b:ofc:e:n:q:t:s:")) != -1) {
+	  // If we are given a snapshot file
+	  if (option == 'l') {
+	    snapshot_path = optarg;
+	  }
+	  // Else, if we are given a journal file
+	  else if (option == 'j') {
+	    journal_path = optarg;
+	  }
+	  // Else, if we are given a group commit size
+	  else if ((option == 'g') && (atoi(optarg) > 0)) {
+	    batch_size = atoi(optarg);
+	  }
+	  // Else, if we are given an insert file
+	  else if (option == 'b') {
+	    bulk_path = optarg;
+	  }
+	  // Else, if the depth levels are to be planned
+	  else if (option == 'o') {
+	    is_planned = 1;
+	  }
+	  // Else, if the database is to be frozen
+	  else if (option == 'f') {
+	    is_frozen = 1;
+	  }
+	  // Else, if we are given a cache size
+	  else if ((option == 'c') && (atol(optarg) >= 0)) {
+	    cache_size = atol(optarg);
+	  }
+	  // Else, if we are given a false positive rate
+	  else if ((option == 'e') && (atof(optarg) >= 0) && 
+		   (atof(optarg) < 1)) {
+	    filter_rate = atof(optarg);
+	  }
+	  // Else, if we are given a number of shards
+	  else if ((option == 'n') && (atoi(optarg) > 0)) {
+	    num_shards = atoi(optarg);
+	  }
+	  // Else, if we are given a query file
+	  else if (option == 'q') {
+	    query_path = optarg;
+	  }
+	  // Else, if we are given a number of worker threads
+	  else if ((option == 't') && (atoi(optarg) > 0)) {
+	    num_threads = atoi(optarg);
+	  }
+	  // Else, if we are given a socket to serve on
+	  else if (option == 's') {
+	    socket_path = optarg;
+	  }
+	  // Else, the option is unknown
+	  else {
+	    fprintf(stderr, USAGE_MSG, argv[0]);
+	    return 1;
+	  }
+	}
+	// Shards hold no snapshot [OR] journal
+	if ((num_shards > 0) && ((snapshot_path != NULL) || 
+				 (journal_path != NULL))) {
+	  fprintf(stderr, USAGE_MSG, argv[0]);
+	  return 1;
+	}
+	if (num_shards > 0) {
+	  database_shard(root_ptr, num_shards);
+	}
+	// Filter QUERY OPERATIONS, and cache their results
+	database_filter(root_ptr, filter_rate);
+	database_cache(root_ptr, cache_size);
+	// Load the snapshot file
+	if ((snapshot_path != NULL) && 
+	    (database_load(root_ptr, snapshot_path) != 0)) {
+	  return 1;
+	}
+	// Replay the journal file on top of it
+	if ((journal_path != NULL) &&
+	    (database_open_journal(root_ptr, journal_path, batch_size) != 0)) {
+	  return 1;
+	}
+	// Bulk-load the insert file
+	if (bulk_path != NULL) {
+	  bulk_file = fopen(bulk_path, "r");
+	  if (bulk_file == NULL) {
+	    perror("fopen");
+	    return 1;
+	  }
+	  database_bulk_load(root_ptr, bulk_file);
+	  fclose(bulk_file);
+	}
+	// Plan the depth levels of what was loaded, and from then on
+	if (is_planned) {
+	  database_plan(root_ptr);
+	}
+	// Freeze what was loaded
+	if ((is_frozen) && (database_freeze(root_ptr) != 0)) {
+	  return 1;
+	}
+	// Results are buffered and written out in large chunks
+	output_init_fd(&output, STDOUT_FILENO);
+	// Run the query file. The database does not change until it is done
+	if (query_path != NULL) {
+	  query_file = fopen(query_path, "r");
+	  if (query_file == NULL) {
+	    perror("fopen");
+	    return 1;
+	  }
+	  if (num_threads < 1) {
+	    num_threads = 1;
+	  }
+	  // Every shard is drained first, so the worker threads only read
+	  database_drain(root_ptr);
+	  if (batch_query(root_ptr, query_file, num_threads, &output) == -1) {
+	    return 1;
+	  }
+	  fclose(query_file);
+	}
+	// Serve the database on the socket instead of reading user input
+	if (socket_path != NULL) {
+	  output_flush(&output);
+	  status = (server_run(root_ptr, socket_path) == 0) ? 0 : 1;
+	}
         // Holds the number of tokens from valid user input
 	int num_tokens;
-	// Obtain 1st user input
-	char *is_NULL = fgets(buf, BUFFER_SIZE, stdin);  
+	// Holds the page of a QUERY [OR] PRINT OPERATION
+	size_t offset;
+	size_t limit;
+	// Obtain 1st user input [None while serving on a socket]
+	reader_init(&reader, STDIN_FILENO);
+	if (socket_path == NULL) {
+	  line = reader_next_line(&reader, &length);
+	}
 	// Keep receiving user input until EOF (Ctrl-D) is met
-	while (is_NULL != NULL) {
+	while (line != NULL) {
 	  // Parse the input
-	  num_tokens = tokenize(buf, args);
-	  // If we have an INSERT OPERATION
-	  if (num_tokens == INSERT) {
-	    // Call the insert function
-	    tree_insert(root_ptr, args);
+	  num_tokens = tokenize(line, args);
+	  // If the input is invalid
+	  if (num_tokens == -1) {
+	    // Output an error message
+	    fprintf(stderr, ERROR_MSG);
+	  }
+	  // Else, if we have an INSERT OPERATION
+	  else if (args[0][0] == INSERT) {
+	    // Call the insert function [It fails if it cannot be journaled]
+	    if (database_insert(root_ptr, args) == -1) {
+	      fprintf(stderr, ERROR_MSG);
+	    }
+	  }
+	  // Else, if we have a DELETE OPERATION
+	  else if (args[0][0] == DELETE) {
+	    // Call the delete function [A value after a * is invalid, and it
+	    // fails if it cannot be journaled]
+	    if (database_delete(root_ptr, args) == -1) {
+	      fprintf(stderr, ERROR_MSG);
+	    }
+	  }
+	  // Else, if we have a QUERY [OR] PRINT OPERATION with an invalid
+	  // page
+	  else if (((args[0][0] == QUERY) || (args[0][0] == PRINT)) &&
+		   (tokenize_page(args, num_tokens, &offset, &limit) == -1)) {
+	    fprintf(stderr, ERROR_MSG);
 	  }
 	  // Else, if we have a QUERY OPERATION
-	  else if (num_tokens == QUERY) {
+	  else if (args[0][0] == QUERY) {
 	    // Call the query function
-	    tree_search(root_ptr, args);
+	    database_search_page(root_ptr, args, offset, limit, &output);
 	  }
 	  // Else, if we have a PRINT OPERATION
-	  else if (num_tokens == PRINT) {
+	  else if (args[0][0] == PRINT) {
 	    // Call the print function
-	    tree_print(root_ptr);
+	    database_print_page(root_ptr, offset, limit, &output);
 	  }
-	  // Else, the input must be invalid
+	  // Else, if we have a COUNT OPERATION
+	  else if (args[0][0] == COUNT) {
+	    // Call the count function
+	    database_count_query(root_ptr, args, &output);
+	  }
+	  // Else, if we have a STATS OPERATION
+	  else if (args[0][0] == STATS) {
+	    // Call the stats function
+	    database_stats(root_ptr, &output);
+	  }
+	  // Else, if we have a SAVE OPERATION
+	  else if (args[0][0] == SAVE) {
+	    // Call the save function
+	    database_save(root_ptr, args[1]);
+	  }
+	  // Else, if we have a LOAD OPERATION
+	  else if (args[0][0] == LOAD) {
+	    // Call the load function
+	    database_load(root_ptr, args[1]);
+	  }
+	  // Else, if we have a FREEZE OPERATION
+	  else if (args[0][0] == FREEZE) {
+	    // Call the freeze function
+	    if (database_freeze(root_ptr) == -1) {
+	      fprintf(stderr, ERROR_MSG);
+	    }
+	  }
+	  // Else, we have a COMPACT OPERATION
 	  else {
-	    // Output an error message
-	    fprintf(stderr, ERROR_MSG);
+	    // Call the compact function
+	    database_compact(root_ptr, args[1]);
 	  }
 	  // Receive the next user input
-	  is_NULL = fgets(buf, BUFFER_SIZE, stdin);
+	  // On a terminal, show the results before waiting for more input
+	  if (is_interactive) {
+	    output_flush(&output);
+	  }
+	  line = reader_next_line(&reader, &length);
         }
-	return 0;
+	reader_destroy(&reader);
+	// Write out any buffered results
+	output_destroy(&output);
+	// Release the database
+	database_destroy(root_ptr);
+	return status;
 }
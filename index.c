@@ -0,0 +1,242 @@
+/**
+ *  Per-attribute inverted indexes of the image database. Each depth level 
+ *  of attributes has an index that maps a cargo value to every node of that
+ *  level holding it, so queries that leave earlier attributes open can 
+ *  start straight at the matching nodes instead of walking the whole tree.
+ *  Once no node holds a cargo value, its slot is marked with intern_deleted
+ *  until the slots are rebuilt, since readers may be probing past it.
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "index.h"
+#include "tree.h"
+
+/**
+ *  A helper function that compares two nodes of the same depth level by 
+ *  the cargo of their paths from the root node. Sibling nodes never share
+ *  cargo, so the first differing node on the paths decides the order.
+ *
+ *  @param a The first node.
+ *  @param b The second node.
+ *  @return A negative, zero or positive value if the first node sorts 
+ *  before, equal to or after the second node.
+ **/
+static int helper_compare_paths(const struct TreeNode *a, 
+				const struct TreeNode *b) {
+  // Holds the paths, from the given nodes up to the first depth level 
+  // nodes
+  const struct TreeNode *path_a[NUM_LEVELS];
+  const struct TreeNode *path_b[NUM_LEVELS];
+  int depth_level = 0;
+  int result = 0;
+  // Both nodes are on the same depth level, so their paths are as long
+  for ( ; a->parent != NULL; a = a->parent, b = b->parent) {
+    path_a[depth_level] = a;
+    path_b[depth_level] = b;
+    depth_level++;
+  }
+  // Compare from the first depth level downwards until the paths part
+  while ((depth_level > 0) && (result == 0)) {
+    depth_level--;
+    if (path_a[depth_level] != path_b[depth_level]) {
+      result = STATS_STRCMP(path_a[depth_level]->value->text, 
+		      path_b[depth_level]->value->text);
+    }
+  }
+  return result;
+}
+
+/**
+ *  A helper function that finds the slot of a cargo value in the index.
+ *
+ *  @param slots The slots of the attribute index.
+ *  @param value The interned cargo to look for.
+ *  @return The index of the slot holding the cargo, or of the empty slot 
+ *  where it belongs.
+ **/
+static size_t helper_find_slot(const struct IndexSlots *slots,
+			       const struct InternedString *value) {
+  size_t mask = slots->capacity - 1;
+  size_t slot = value->hash & mask;
+  const struct InternedString *cur;
+  // Interned cargo is recognized by its address
+  while (((cur = ATOMIC_READ(slots->slots[slot].value)) != NULL) && 
+	 (cur != value)) {
+    slot = (slot + 1) & mask;
+  }
+  return slot;
+}
+
+/**
+ *  A helper function that allocates an empty slot array.
+ *
+ *  @param index The attribute index.
+ *  @param capacity The number of slots (a power of two).
+ *  @return The slot array.
+ **/
+static struct IndexSlots *helper_alloc_slots(struct AttributeIndex *index, 
+					     size_t capacity) {
+  size_t size = sizeof(struct IndexSlots) + 
+    sizeof(struct IndexPostings) * capacity;
+  struct IndexSlots *result = arena_alloc(index->epochs->arena, size);
+  memset(result, 0, size);
+  result->capacity = capacity;
+  return result;
+}
+
+/**
+ *  A helper function that rebuilds the slots of the index without the
+ *  emptied slots, doubling their number unless enough slots were emptied.
+ *  The new slots are filled before they are published, and the former 
+ *  slots are retired, since readers may still be probing them.
+ *
+ *  @param index The attribute index.
+ **/
+static void helper_grow(struct AttributeIndex *index) {
+  struct IndexSlots *former = index->slots;
+  struct IndexSlots *slots = helper_alloc_slots(index, 
+						((index->count + 1) * 4 > 
+						 former->capacity) ? 
+						(former->capacity * 2) :
+						former->capacity);
+  size_t i;
+  // Move every postings entry into the new slots [Posting arrays are kept]
+  for (i = 0; i < former->capacity; i++) {
+    if ((former->slots[i].value != NULL) && 
+	(former->slots[i].value != &intern_deleted)) {
+      slots->slots[helper_find_slot(slots, former->slots[i].value)] = 
+	former->slots[i];
+    }
+  }
+  ATOMIC_PUBLISH(index->slots, slots);
+  index->num_deleted = 0;
+  // Hand the former slots back to the arena once no reader holds them
+  epoch_retire(index->epochs, former, sizeof(struct IndexSlots) + 
+	       sizeof(struct IndexPostings) * former->capacity);
+}
+
+/**
+ *  Initialize an empty attribute index.
+ *
+ *  @param index The attribute index.
+ *  @param epochs The epochs whose arena holds the slots and the posting 
+ *  arrays.
+ **/
+void index_init(struct AttributeIndex *index, struct Epochs *epochs) {
+  index->epochs = epochs;
+  // Slots are allocated by the first call to index_add
+  index->slots = NULL;
+  index->count = 0;
+  index->num_deleted = 0;
+}
+
+/**
+ *  Add a node to the postings of its cargo, at its sorted position. Nodes
+ *  usually arrive in sorted order, so the last posting is checked before
+ *  falling back to a binary search.
+ *
+ *  @param index The attribute index.
+ *  @param node The node to add. Its parent nodes must already be connected.
+ **/
+void index_add(struct AttributeIndex *index, struct TreeNode *node) {
+  struct IndexPostings *postings;
+  size_t slot;
+  // Holds the search range [low, high) of the sorted position
+  size_t low = 0;
+  size_t high;
+  // If this is the first node, allocate the slots
+  if (index->slots == NULL) {
+    ATOMIC_PUBLISH(index->slots, 
+		   helper_alloc_slots(index, INDEX_INITIAL_CAPACITY));
+  }
+  slot = helper_find_slot(index->slots, node->value);
+  // If no node holds this cargo yet, start its postings
+  if (index->slots->slots[slot].value == NULL) {
+    // Keep the table at most half full, emptied slots included
+    if ((index->count + index->num_deleted + 1) * 2 > 
+	index->slots->capacity) {
+      helper_grow(index);
+      slot = helper_find_slot(index->slots, node->value);
+    }
+    // The postings are complete before their cargo is published
+    index->slots->slots[slot].nodes = &nodes_empty;
+    ATOMIC_PUBLISH(index->slots->slots[slot].value, node->value);
+    index->count++;
+  }
+  postings = &index->slots->slots[slot];
+  high = postings->nodes->count;
+  // If the node does not follow the last posting, binary search its place
+  if ((high > 0) && 
+      (helper_compare_paths(postings->nodes->nodes[high - 1], node) > 0)) {
+    while (low < high) {
+      size_t middle = low + ((high - low) / 2);
+      if (helper_compare_paths(postings->nodes->nodes[middle], node) < 0) {
+	low = middle + 1;
+      }
+      else {
+	high = middle;
+      }
+    }
+  }
+  nodes_insert(&postings->nodes, high, node, index->epochs);
+}
+
+/**
+ *  Remove a node from the postings of its cargo. Its position is found with
+ *  a binary search, as nodes are sorted by their paths.
+ *
+ *  @param index The attribute index.
+ *  @param node The node to remove. Its parent nodes must not be released
+ *  yet.
+ **/
+void index_remove(struct AttributeIndex *index, struct TreeNode *node) {
+  struct IndexPostings *postings = 
+    &index->slots->slots[helper_find_slot(index->slots, node->value)];
+  // Holds the search range [low, high) of the position
+  size_t low = 0;
+  size_t high = postings->nodes->count;
+  while (low < high) {
+    size_t middle = low + ((high - low) / 2);
+    if (helper_compare_paths(postings->nodes->nodes[middle], node) < 0) {
+      low = middle + 1;
+    }
+    else {
+      high = middle;
+    }
+  }
+  nodes_remove(&postings->nodes, low, index->epochs);
+  // If no node holds the cargo any more, mark its slot [The cargo may be
+  // released next]
+  if (postings->nodes->count == 0) {
+    ATOMIC_PUBLISH(postings->value, &intern_deleted);
+    index->count--;
+    index->num_deleted++;
+  }
+}
+
+/**
+ *  Return the postings of a cargo value. Readers may call this while the
+ *  writer adds nodes, within an epoch.
+ *
+ *  @param index The attribute index.
+ *  @param value The interned cargo to look for.
+ *  @return The postings of the cargo, or NULL if no node holds it.
+ **/
+const struct NodeArray *index_find(const struct AttributeIndex *index,
+				   const struct InternedString *value) {
+  // Holds the slots [Loaded once, as the writer may replace them]
+  const struct IndexSlots *slots = ATOMIC_READ(index->slots);
+  size_t slot;
+  const struct NodeArray *result = NULL;
+  if (slots != NULL) {
+    slot = helper_find_slot(slots, value);
+    // An empty [OR] emptied slot means no node holds the cargo
+    if (ATOMIC_READ(slots->slots[slot].value) == value) {
+      result = ATOMIC_READ(slots->slots[slot].nodes);
+    }
+  }
+  return result;
+}
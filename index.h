@@ -0,0 +1,67 @@
+/**
+ *  Per-attribute inverted indexes of the image database.
+ **/
+
+#ifndef _INDEX_H
+#define _INDEX_H
+
+#include <stddef.h>
+
+#include "epoch.h"
+#include "intern.h"
+#include "nodes.h"
+
+// Initial number of slots of an attribute index (a power of two)
+#define INDEX_INITIAL_CAPACITY	256
+
+
+
+// Every node of one depth level that holds the same cargo
+struct IndexPostings {
+	const struct InternedString *value;
+	// Sorted by the cargo of the path from the root node to each node
+	struct NodeArray *nodes;
+};
+
+// The slots of an attribute index, replaced as a whole when it grows
+struct IndexSlots {
+	size_t capacity;
+	struct IndexPostings slots[];
+};
+
+struct AttributeIndex {
+	// Open addressing hash table of postings, keyed by interned cargo
+	struct IndexSlots *slots;
+	size_t count;
+	// Number of slots whose postings emptied, until the slots are rebuilt
+	size_t num_deleted;
+	// Their arena holds the slots and the posting arrays
+	struct Epochs *epochs;
+};
+
+/*
+ * Initialize an empty attribute index whose memory comes from the arena of
+ * the given epochs.
+ */
+void index_init(struct AttributeIndex *, struct Epochs *);
+
+/*
+ * Add a node to the postings of its cargo. The node's parent nodes must
+ * already be connected to it. Writer only.
+ */
+void index_add(struct AttributeIndex *, struct TreeNode *);
+
+/*
+ * Remove a node from the postings of its cargo. Its parent nodes must not
+ * be released yet. Writer only.
+ */
+void index_remove(struct AttributeIndex *, struct TreeNode *);
+
+/*
+ * Return the postings of an interned cargo, or NULL if no node holds it.
+ * May run alongside index_add, within an epoch.
+ */
+const struct NodeArray *index_find(const struct AttributeIndex *,
+				   const struct InternedString *);
+
+#endif /* _INDEX_H */
@@ -0,0 +1,228 @@
+/**
+ *  String interning for the cargo of the image database. Every distinct 
+ *  string is stored once, so equal strings share one address and can be
+ *  compared by pointer. Strings count the nodes holding them, and are 
+ *  released with the last one; their slot is marked as released rather
+ *  than emptied, since readers may be probing past it.
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "intern.h"
+#include "utils.h"
+
+
+const struct InternedString intern_deleted = {0, 0, 0};
+
+/**
+ *  Hash a string as it is interned, and measure its length.
+ *
+ *  @param value The string to hash.
+ *  @param length Set to the length of the string.
+ *  @return The FNV-1a hash of the string.
+ **/
+unsigned int intern_hash(const char *value, size_t *length) {
+  unsigned int hash = FNV_OFFSET_BASIS;
+  const char *cur = value;
+  for ( ; *cur != '\0'; cur++) {
+    hash = (hash ^ (unsigned char) *cur) * FNV_PRIME;
+  }
+  *length = cur - value;
+  return hash;
+}
+
+/**
+ *  A helper function that finds the slot of a string in the table. The hash
+ *  and length are compared first, so mismatching strings are almost always
+ *  rejected without comparing their text.
+ *
+ *  @param slots The slots of the intern table.
+ *  @param value The string to look for.
+ *  @param hash The hash of the string.
+ *  @param length The length of the string.
+ *  @return The index of the slot holding the string, or of the empty slot
+ *  where it belongs.
+ **/
+static size_t helper_find_slot(const struct InternSlots *slots, 
+			       const char *value, unsigned int hash,
+			       size_t length) {
+  size_t mask = slots->capacity - 1;
+  size_t slot = hash & mask;
+  const struct InternedString *cur;
+  // Keep probing until we hit an empty slot [OR] the matching string
+  while ((cur = ATOMIC_READ(slots->slots[slot])) != NULL) {
+    if ((cur != &intern_deleted) && (cur->hash == hash) && 
+	(cur->length == length) && (memcmp(cur->text, value, length) == 0)) {
+      break;
+    }
+    slot = (slot + 1) & mask;
+  }
+  return slot;
+}
+
+/**
+ *  A helper function that allocates an empty slot array.
+ *
+ *  @param table The intern table.
+ *  @param capacity The number of slots (a power of two).
+ *  @return The slot array.
+ **/
+static struct InternSlots *helper_alloc_slots(struct InternTable *table, 
+					      size_t capacity) {
+  size_t size = sizeof(struct InternSlots) + 
+    sizeof(struct InternedString *) * capacity;
+  struct InternSlots *result = arena_alloc(table->epochs->arena, size);
+  memset(result, 0, size);
+  result->capacity = capacity;
+  return result;
+}
+
+/**
+ *  A helper function that rebuilds the slots of the table without the 
+ *  released slots, doubling their number unless enough slots were 
+ *  released. The new slots are filled before they are published, and the 
+ *  former slots are retired, since readers may still be probing them.
+ *
+ *  @param table The intern table.
+ **/
+static void helper_grow(struct InternTable *table) {
+  struct InternSlots *former = table->slots;
+  struct InternSlots *slots = helper_alloc_slots(table, 
+						 ((table->count + 1) * 4 > 
+						  former->capacity) ?
+						 (former->capacity * 2) :
+						 former->capacity);
+  size_t i;
+  // Move every string into the new slots [The stored hash is reused]
+  for (i = 0; i < former->capacity; i++) {
+    const struct InternedString *cur = former->slots[i];
+    if ((cur != NULL) && (cur != &intern_deleted)) {
+      slots->slots[helper_find_slot(slots, cur->text, cur->hash, 
+				    cur->length)] = cur;
+    }
+  }
+  ATOMIC_PUBLISH(table->slots, slots);
+  table->num_deleted = 0;
+  // Hand the former slots back to the arena once no reader holds them
+  epoch_retire(table->epochs, former, sizeof(struct InternSlots) + 
+	       sizeof(struct InternedString *) * former->capacity);
+}
+
+/**
+ *  Initialize an empty intern table.
+ *
+ *  @param table The intern table.
+ *  @param epochs The epochs whose arena holds the interned strings and the
+ *  slots.
+ **/
+void intern_init(struct InternTable *table, struct Epochs *epochs) {
+  table->epochs = epochs;
+  // Slots are allocated by the first call to intern
+  table->slots = NULL;
+  table->count = 0;
+  table->num_deleted = 0;
+}
+
+/**
+ *  Return the single interned copy of a string, interning it if required.
+ *  Writer only.
+ *
+ *  @param table The intern table.
+ *  @param value The string to intern.
+ *  @return The interned copy of the string.
+ **/
+const struct InternedString *intern(struct InternTable *table,
+				    const char *value) {
+  size_t length;
+  unsigned int hash = intern_hash(value, &length);
+  size_t slot;
+  struct InternedString *result;
+  // If this is the first string, allocate the slots
+  if (table->slots == NULL) {
+    ATOMIC_PUBLISH(table->slots, 
+		   helper_alloc_slots(table, INTERN_INITIAL_CAPACITY));
+  }
+  slot = helper_find_slot(table->slots, value, hash, length);
+  // If the string has been interned already
+  if (table->slots->slots[slot] != NULL) {
+    return table->slots->slots[slot];
+  }
+  // Keep the table at most half full, released slots included
+  if ((table->count + table->num_deleted + 1) * 2 > 
+      table->slots->capacity) {
+    helper_grow(table);
+    slot = helper_find_slot(table->slots, value, hash, length);
+  }
+  // Store the string and its precomputed hash and length, then publish it
+  result = arena_alloc(table->epochs->arena, sizeof(struct InternedString) +
+		       length + 1);
+  result->hash = hash;
+  result->length = length;
+  result->num_references = 0;
+  memcpy(result->text, value, length + 1);
+  ATOMIC_PUBLISH(table->slots->slots[slot], 
+		 (const struct InternedString *) result);
+  table->count++;
+  return result;
+}
+
+/**
+ *  Count one more node holding an interned string. Writer only.
+ *
+ *  @param value The interned string.
+ **/
+void intern_acquire(const struct InternedString *value) {
+  // Only the writer touches the count, and it owns the string
+  ((struct InternedString *) value)->num_references++;
+}
+
+/**
+ *  Count one less node holding an interned string, and release the string
+ *  once no node holds it. Writer only.
+ *
+ *  @param table The intern table.
+ *  @param value The interned string.
+ **/
+void intern_release(struct InternTable *table, 
+		    const struct InternedString *value) {
+  size_t slot;
+  if (--((struct InternedString *) value)->num_references > 0) {
+    return;
+  }
+  // Mark its slot, so that probes for later strings still pass over it
+  slot = helper_find_slot(table->slots, value->text, value->hash, 
+			  value->length);
+  ATOMIC_PUBLISH(table->slots->slots[slot], &intern_deleted);
+  table->count--;
+  table->num_deleted++;
+  // Hand the string back to the arena once no reader holds it
+  epoch_retire(table->epochs, (void *) value, 
+	       sizeof(struct InternedString) + value->length + 1);
+}
+
+/**
+ *  Return the interned copy of a string without interning it. Readers may
+ *  call this while the writer interns, within an epoch.
+ *
+ *  @param table The intern table.
+ *  @param value The string to look for.
+ *  @return The interned copy of the string, or NULL if it is not interned.
+ **/
+const struct InternedString *intern_find(const struct InternTable *table,
+					 const char *value) {
+  size_t length;
+  unsigned int hash = intern_hash(value, &length);
+  // Holds the slots [Loaded once, as the writer may replace them]
+  const struct InternSlots *slots = ATOMIC_READ(table->slots);
+  const struct InternedString *result;
+  // If no string was ever interned
+  if (slots == NULL) {
+    return NULL;
+  }
+  result = ATOMIC_READ(slots->slots[helper_find_slot(slots, value, hash, 
+						     length)]);
+  // The string may have been released since it was found
+  return (result != &intern_deleted) ? result : NULL;
+}
@@ -0,0 +1,76 @@
+/**
+ *  String interning for the cargo of the image database.
+ **/
+
+#ifndef _INTERN_H
+#define _INTERN_H
+
+#include <stddef.h>
+
+#include "epoch.h"
+
+// Initial number of slots of an intern table (a power of two)
+#define INTERN_INITIAL_CAPACITY	1024
+
+
+struct InternedString {
+	// Precomputed hash and length of the text
+	unsigned int hash;
+	unsigned int length;
+	// Number of nodes holding the string [Writer only]
+	unsigned int num_references;
+	char text[];
+};
+
+// Marks a slot whose string was released, in hash tables keyed by interned
+// strings. Probes pass over it, as over any string that does not match
+extern const struct InternedString intern_deleted;
+
+// The slots of an intern table, replaced as a whole when the table grows
+struct InternSlots {
+	size_t capacity;
+	const struct InternedString *slots[];
+};
+
+struct InternTable {
+	// Open addressing hash table of interned strings
+	struct InternSlots *slots;
+	size_t count;
+	// Number of slots marked as released, until the slots are rebuilt
+	size_t num_deleted;
+	// Their arena holds the interned strings and the slots
+	struct Epochs *epochs;
+};
+
+/*
+ * Initialize an empty intern table whose memory comes from the arena of the
+ * given epochs.
+ */
+void intern_init(struct InternTable *, struct Epochs *);
+
+/*
+ * Return the hash an interned copy of a string has [Its hash member], and
+ * set the length of the string.
+ */
+unsigned int intern_hash(const char *, size_t *);
+
+/*
+ * Return the single interned copy of a string, interning it if required.
+ */
+const struct InternedString *intern(struct InternTable *, const char *);
+
+/*
+ * Count one more [OR] one less node holding an interned string. The string
+ * is released once no node holds it. Writer only.
+ */
+void intern_acquire(const struct InternedString *);
+void intern_release(struct InternTable *, const struct InternedString *);
+
+/*
+ * Return the interned copy of a string, or NULL if it is not interned.
+ * May run alongside intern, within an epoch.
+ */
+const struct InternedString *intern_find(const struct InternTable *,
+					 const char *);
+
+#endif /* _INTERN_H */
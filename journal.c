@@ -0,0 +1,318 @@
+/**
+ *  Write-ahead journal of the INSERT and DELETE OPERATIONS of the image 
+ *  database. Records are collected in memory and written and synced in 
+ *  batches (group commit), so syncing does not cap the insert throughput.
+ *  Inserts and deletes are idempotent, and each image ends up as the last
+ *  record about it left it, so replaying records that a snapshot already
+ *  holds is harmless. An insert record holds only the four values, as it
+ *  always has; a delete record is led by the DELETE symbol.
+ **/
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "journal.h"
+#include "utils.h"
+
+// Size of the magic at the start of a journal
+#define MAGIC_SIZE	8
+// Number of values of a record [Attributes; filename]
+#define NUM_VALUES	NUM_LEVELS
+
+/**
+ *  A helper function that computes the checksum of a record.
+ *
+ *  @param data The values of the record.
+ *  @param size The size of the values.
+ *  @return The FNV-1a hash of the values.
+ **/
+static uint32_t helper_checksum(const char *data, size_t size) {
+  uint32_t hash = FNV_OFFSET_BASIS;
+  size_t i;
+  for (i = 0; i < size; i++) {
+    hash = (hash ^ (unsigned char) data[i]) * FNV_PRIME;
+  }
+  return hash;
+}
+
+/**
+ *  A helper function that writes a whole buffer to a file. A write cut 
+ *  short by a signal is retried.
+ *
+ *  @param fd The file.
+ *  @param data The buffer.
+ *  @param size The size of the buffer.
+ *  @return 0 on success; -1 on failure.
+ **/
+static int helper_write_all(int fd, const char *data, size_t size) {
+  int result = 0;
+  while ((size > 0) && (result == 0)) {
+    ssize_t written = write(fd, data, size);
+    if ((written < 0) && (errno == EINTR)) {
+      continue;
+    }
+    if (written < 0) {
+      perror("write");
+      result = -1;
+    }
+    else {
+      data += written;
+      size -= written;
+    }
+  }
+  return result;
+}
+
+/**
+ *  A helper function that makes room for size more bytes in the buffer.
+ *
+ *  @param journal The journal.
+ *  @param size The number of bytes required.
+ **/
+static void helper_reserve(struct Journal *journal, size_t size) {
+  if (journal->used + size > journal->capacity) {
+    while (journal->used + size > journal->capacity) {
+      journal->capacity = (journal->capacity == 0) ? 4096 : 
+	(journal->capacity * 2);
+    }
+    journal->buffer = realloc(journal->buffer, journal->capacity);
+    if (journal->buffer == NULL) {
+      perror("realloc");
+      exit(1);
+    }
+  }
+}
+
+/**
+ *  Open (or create) a journal file, and read its records for replay.
+ *
+ *  @param journal The journal.
+ *  @param path The path of the journal file.
+ *  @param batch_size The number of records per group commit.
+ *  @return 0 on success; -1 on failure.
+ **/
+int journal_open(struct Journal *journal, const char *path, int batch_size) {
+  int result = 0;
+  struct stat info;
+  memset(journal, 0, sizeof(struct Journal));
+  journal->batch_size = (batch_size > 0) ? batch_size : 1;
+  journal->fd = open(path, O_RDWR | O_CREAT, 0644);
+  if ((journal->fd == -1) || (fstat(journal->fd, &info) == -1)) {
+    perror(path);
+    result = -1;
+  }
+  // If the journal is new, write its magic
+  else if (info.st_size == 0) {
+    result = helper_write_all(journal->fd, JOURNAL_MAGIC, MAGIC_SIZE);
+    journal->position = MAGIC_SIZE;
+  }
+  // Else, read the whole journal for replay
+  else {
+    helper_reserve(journal, info.st_size);
+    journal->used = pread(journal->fd, journal->buffer, info.st_size, 0);
+    if ((journal->used != (size_t) info.st_size) || 
+	(memcmp(journal->buffer, JOURNAL_MAGIC, MAGIC_SIZE) != 0)) {
+      fprintf(stderr, "Invalid journal.\n");
+      result = -1;
+    }
+    journal->position = MAGIC_SIZE;
+  }
+  if ((result != 0) && (journal->fd != -1)) {
+    close(journal->fd);
+    free(journal->buffer);
+    memset(journal, 0, sizeof(struct Journal));
+    journal->fd = -1;
+  }
+  return result;
+}
+
+/**
+ *  Return the next journaled operation.
+ *
+ *  @param journal The journal.
+ *  @param values Set to the tokens of the INSERT [OR] DELETE OPERATION. 
+ *  They remain valid until the next call.
+ *  @return 1 if a record was returned; 0 once the replay is complete.
+ **/
+int journal_replay(struct Journal *journal, char **values) {
+  // Record detector. Assume we have no valid record left
+  int is_record_found = 0;
+  struct JournalRecord record;
+  // If a complete record header is left
+  if (journal->position + sizeof(record) <= journal->used) {
+    memcpy(&record, journal->buffer + journal->position, sizeof(record));
+    // If the record is complete and intact
+    if ((record.size > 0) && 
+	(record.size <= journal->used - journal->position - sizeof(record)) &&
+	(helper_checksum(journal->buffer + journal->position + sizeof(record),
+			 record.size) == record.checksum) &&
+	(journal->buffer[journal->position + sizeof(record) + 
+			 record.size - 1] == '\0')) {
+      char *cur = journal->buffer + journal->position + sizeof(record);
+      char *end = cur + record.size;
+      // Holds the fields of the record [A symbol, then the values]
+      char *fields[NUM_VALUES + 1];
+      int num_fields = 0;
+      int i;
+      // Split the record into its fields
+      for ( ; (num_fields <= NUM_VALUES) && (cur < end); num_fields++) {
+	fields[num_fields] = cur;
+	cur += strlen(cur) + 1;
+      }
+      // An insert record holds the values only; a delete record is led by
+      // its symbol
+      if ((cur == end) && (num_fields == NUM_VALUES)) {
+	values[0] = "i";
+	is_record_found = 1;
+      }
+      else if ((cur == end) && (num_fields == NUM_VALUES + 1) &&
+	       (fields[0][0] == DELETE) && (fields[0][1] == '\0')) {
+	values[0] = fields[0];
+	is_record_found = 1;
+      }
+      if (is_record_found) {
+	for (i = 0; i < NUM_VALUES; i++) {
+	  values[i + 1] = fields[num_fields - NUM_VALUES + i];
+	}
+	journal->position = end - journal->buffer;
+      }
+    }
+  }
+  // If the replay is complete
+  if (!is_record_found) {
+    // Cut off any torn record left by a crash, and append after the last
+    // valid record
+    if ((journal->position < journal->used) && 
+	(ftruncate(journal->fd, journal->position) == -1)) {
+      perror("ftruncate");
+    }
+    lseek(journal->fd, journal->position, SEEK_SET);
+    // The buffer is reused for group commits
+    free(journal->buffer);
+    journal->buffer = NULL;
+    journal->used = 0;
+    journal->capacity = 0;
+  }
+  return is_record_found;
+}
+
+/**
+ *  Append an INSERT [OR] DELETE OPERATION to the journal. If its group 
+ *  commit fails, the record is dropped again, so the operation must not be
+ *  applied; the records before it stay pending, to be committed by the 
+ *  next group commit.
+ *
+ *  @param journal The journal.
+ *  @param values The tokens of the operation.
+ *  @return 0 on success; -1 on failure.
+ **/
+int journal_append(struct Journal *journal, char **values) {
+  int result = 0;
+  struct JournalRecord record;
+  size_t lengths[NUM_VALUES + 1];
+  char *cur;
+  // Holds the first token stored [Insert records leave out the symbol]
+  int first = (values[0][0] == DELETE) ? 0 : 1;
+  int i;
+  record.size = 0;
+  for (i = first; i <= NUM_VALUES; i++) {
+    lengths[i] = strlen(values[i]) + 1;
+    record.size += lengths[i];
+  }
+  // Store the record in the buffer
+  helper_reserve(journal, sizeof(record) + record.size);
+  cur = journal->buffer + journal->used + sizeof(record);
+  for (i = first; i <= NUM_VALUES; i++) {
+    memcpy(cur, values[i], lengths[i]);
+    cur += lengths[i];
+  }
+  record.checksum = helper_checksum(cur - record.size, record.size);
+  memcpy(journal->buffer + journal->used, &record, sizeof(record));
+  journal->used += sizeof(record) + record.size;
+  journal->num_pending++;
+  // If the group commit is complete, commit it
+  if (journal->num_pending >= journal->batch_size) {
+    result = journal_sync(journal);
+  }
+  // If it failed, drop the record [The file ends at the last committed 
+  // record again]
+  if (result == -1) {
+    journal->used -= sizeof(record) + record.size;
+    journal->num_pending--;
+  }
+  return result;
+}
+
+/**
+ *  Write and sync every pending record. If either fails, the file is cut 
+ *  back to its last committed record, so no torn record is left for later
+ *  records to follow [Replay stops at a torn record], and the pending 
+ *  records are kept.
+ *
+ *  @param journal The journal.
+ *  @return 0 on success; -1 on failure.
+ **/
+int journal_sync(struct Journal *journal) {
+  int result = 0;
+  if (journal->num_pending > 0) {
+    result = helper_write_all(journal->fd, journal->buffer, journal->used);
+    if ((result == 0) && (fdatasync(journal->fd) == -1)) {
+      perror("fdatasync");
+      result = -1;
+    }
+    // If the group commit failed, drop whatever part of it was written
+    if (result == -1) {
+      if ((ftruncate(journal->fd, journal->position) == -1) ||
+	  (lseek(journal->fd, journal->position, SEEK_SET) == -1)) {
+	perror("journal");
+      }
+    }
+    // Else, the file ends at its last record
+    else {
+      journal->position += journal->used;
+      journal->used = 0;
+      journal->num_pending = 0;
+    }
+  }
+  return result;
+}
+
+/**
+ *  Drop every record of the journal.
+ *
+ *  @param journal The journal.
+ *  @return 0 on success; -1 on failure.
+ **/
+int journal_truncate(struct Journal *journal) {
+  int result = 0;
+  journal->used = 0;
+  journal->num_pending = 0;
+  journal->position = MAGIC_SIZE;
+  if ((ftruncate(journal->fd, MAGIC_SIZE) == -1) || 
+      (lseek(journal->fd, MAGIC_SIZE, SEEK_SET) == -1) ||
+      (fdatasync(journal->fd) == -1)) {
+    perror("journal");
+    result = -1;
+  }
+  return result;
+}
+
+/**
+ *  Commit every pending record and close the journal.
+ *
+ *  @param journal The journal.
+ **/
+void journal_close(struct Journal *journal) {
+  if (journal->fd != -1) {
+    journal_sync(journal);
+    close(journal->fd);
+  }
+  free(journal->buffer);
+  memset(journal, 0, sizeof(struct Journal));
+  journal->fd = -1;
+}
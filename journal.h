@@ -0,0 +1,85 @@
+/**
+ *  Write-ahead journal of the INSERT and DELETE OPERATIONS of the image 
+ *  database.
+ **/
+
+#ifndef _JOURNAL_H
+#define _JOURNAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Identifies a journal file
+#define JOURNAL_MAGIC	"PPMJRNL1"
+// Default number of records per group commit
+#define JOURNAL_DEFAULT_BATCH	128
+
+
+/*
+ * Layout of a journal: the magic, then one record per INSERT [OR] DELETE 
+ * OPERATION. A record is a JournalRecord followed by the values of the 
+ * image [Attributes; filename], each NUL-terminated. The values of a 
+ * DELETE OPERATION are led by its symbol, NUL-terminated as well.
+ */
+struct JournalRecord {
+	uint32_t size;
+	uint32_t checksum;
+};
+
+struct Journal {
+	// The journal file [-1 if no journal is open]
+	int fd;
+	// Number of records per group commit
+	int batch_size;
+	// Records appended since the last group commit
+	int num_pending;
+	// Holds the records of the pending group commit, or during replay,
+	// the contents of the journal file
+	char *buffer;
+	size_t used;
+	size_t capacity;
+	// Replay position, and end of the last valid record [Once replayed,
+	// end of the last committed record]
+	size_t position;
+};
+
+/*
+ * Open (or create) a journal file. Its records are then returned by 
+ * journal_replay. Return 0 on success, -1 on failure.
+ */
+int journal_open(struct Journal *, const char *, int);
+
+/*
+ * Store the tokens of the next journaled operation in the given tokens 
+ * [The first token is the symbol of the operation]. Return 1,
+ * or 0 once every valid record was returned; the journal is then ready for
+ * appending, and any torn record at its end is cut off.
+ */
+int journal_replay(struct Journal *, char **);
+
+/*
+ * Append an INSERT [OR] DELETE OPERATION. The record is durable after the
+ * group commit it belongs to. Return 0 on success, or -1 if its group 
+ * commit failed: the record is then dropped and the operation must not be
+ * applied [The records before it stay pending].
+ */
+int journal_append(struct Journal *, char **);
+
+/*
+ * Commit every pending record now. Return 0 on success, or -1 on failure:
+ * the file is then cut back to its last committed record, and the records
+ * stay pending.
+ */
+int journal_sync(struct Journal *);
+
+/*
+ * Drop every record. Return 0 on success, -1 on failure.
+ */
+int journal_truncate(struct Journal *);
+
+/*
+ * Commit every pending record and close the journal.
+ */
+void journal_close(struct Journal *);
+
+#endif /* _JOURNAL_H */
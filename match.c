@@ -0,0 +1,83 @@
+/**
+ *  Matching of the attribute values of a query. Exact values, prefixes and
+ *  ranges all describe one contiguous range of sorted cargo, so sorted 
+ *  sibling nodes can be searched for the first match and walked until the
+ *  first node past the range.
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "match.h"
+#include "stats.h"
+
+/**
+ *  Parse an attribute value of a query.
+ *
+ *  @param match Set to the range of cargo matching the attribute value.
+ *  @param value The attribute value: <VALUE>, <PREFIX>*, * (any value) or 
+ *  <LOWER>..<UPPER>, where either bound may be left out.
+ **/
+void match_parse(struct AttributeMatch *match, const char *value) {
+  size_t length = strlen(value);
+  const char *separator = strstr(value, MATCH_RANGE);
+  match->lower = value;
+  match->upper = value;
+  match->is_exact = 0;
+  // If the value is a range, split it at the separator. The upper bound
+  // is compared up to its terminating NUL, so it is inclusive
+  if (separator != NULL) {
+    match->lower_length = separator - value;
+    match->upper = separator + strlen(MATCH_RANGE);
+    match->upper_length = strlen(match->upper);
+    if (match->upper_length > 0) {
+      match->upper_length++;
+    }
+  }
+  // Else, if the value is a prefix, both bounds are the prefix itself
+  else if ((length > 0) && (value[length - 1] == MATCH_PREFIX)) {
+    match->lower_length = length - 1;
+    match->upper_length = length - 1;
+  }
+  // Else, only the value itself matches
+  else {
+    match->lower_length = length;
+    match->upper_length = length + 1;
+    match->is_exact = 1;
+  }
+}
+
+/**
+ *  Check if cargo sorts before the range of a match.
+ *
+ *  @param match The match.
+ *  @param text The cargo.
+ *  @return 1 if the cargo sorts before every matching cargo; 0 otherwise.
+ **/
+int match_is_below(const struct AttributeMatch *match, const char *text) {
+  STATS_COUNT(STATS_COMPARISONS, 1);
+  return strncmp(text, match->lower, match->lower_length) < 0;
+}
+
+/**
+ *  Check if cargo sorts after the range of a match.
+ *
+ *  @param match The match.
+ *  @param text The cargo.
+ *  @return 1 if the cargo sorts after every matching cargo; 0 otherwise.
+ **/
+int match_is_beyond(const struct AttributeMatch *match, const char *text) {
+  STATS_COUNT(STATS_COMPARISONS, 1);
+  return strncmp(text, match->upper, match->upper_length) > 0;
+}
+
+/**
+ *  Check if a match leaves both ends of its range open.
+ *
+ *  @param match The match.
+ *  @return 1 if every cargo matches; 0 otherwise.
+ **/
+int match_is_any(const struct AttributeMatch *match) {
+  return (match->lower_length == 0) && (match->upper_length == 0);
+}
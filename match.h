@@ -0,0 +1,53 @@
+/**
+ *  Matching of the attribute values of a query against the cargo of the
+ *  image database.
+ **/
+
+#ifndef _MATCH_H
+#define _MATCH_H
+
+#include <stddef.h>
+
+// Suffix of an attribute value that matches every value with its prefix
+#define MATCH_PREFIX	'*'
+// Attribute value that matches any value
+#define MATCH_ANY	"*"
+// Separator of the inclusive bounds of an attribute range
+#define MATCH_RANGE	".."
+
+
+// The sorted range of cargo matching one attribute value of a query. Either
+// bound is compared over its first length characters only, so an empty
+// bound leaves that end of the range open
+struct AttributeMatch {
+	const char *lower;
+	size_t lower_length;
+	const char *upper;
+	size_t upper_length;
+	// Set if only cargo equal to the attribute value matches
+	int is_exact;
+};
+
+/*
+ * Parse an attribute value of a query: <VALUE>, <PREFIX>*, * (any value) or 
+ * <LOWER>..<UPPER> (either bound may be left out). The match points into
+ * the attribute value.
+ */
+void match_parse(struct AttributeMatch *, const char *);
+
+/*
+ * Return 1 if the cargo sorts before every matching cargo; 0 otherwise.
+ */
+int match_is_below(const struct AttributeMatch *, const char *);
+
+/*
+ * Return 1 if the cargo sorts after every matching cargo; 0 otherwise.
+ */
+int match_is_beyond(const struct AttributeMatch *, const char *);
+
+/*
+ * Return 1 if every cargo matches; 0 otherwise.
+ */
+int match_is_any(const struct AttributeMatch *);
+
+#endif /* _MATCH_H */
@@ -0,0 +1,307 @@
+/**
+ *  Sorted arrays of tree nodes shared with concurrent readers. A reader 
+ *  loads the array pointer and then its count, and only looks at the 
+ *  entries below that count. The writer therefore never moves an entry a
+ *  reader may look at: an append writes past the published count and then
+ *  publishes the new count, and any other insert builds a new array, 
+ *  publishes it in one pointer store, and retires the former array. Until
+ *  a reader registers, inserts and removals shift the entries in place.
+ *
+ *  A counted array also sums the image counts of its nodes, binary indexed,
+ *  so the images before any position are added up, and the nodes holding
+ *  a number of images found, in O(log n). The sums of an appended node are
+ *  written before the count that covers them; any other insert or removal
+ *  rebuilds them in O(n), as it copies or shifts the entries anyway.
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "nodes.h"
+#include "tree.h"
+
+struct NodeArray nodes_empty = {0, 0, 0};
+struct NodeArray nodes_counted = {0, 0, 1};
+
+/**
+ *  A helper function that finds the sums of a counted array.
+ *
+ *  @param array The array.
+ *  @return The sums, which follow its nodes.
+ **/
+static size_t *helper_sums(const struct NodeArray *array) {
+  return (size_t *) (array->nodes + array->capacity);
+}
+
+/**
+ *  A helper function that finds the size of an array.
+ *
+ *  @param capacity The number of nodes the array has room for.
+ *  @param is_counted Whether the array is counted.
+ *  @return The size of the array, in bytes.
+ **/
+static size_t helper_size(size_t capacity, int is_counted) {
+  return sizeof(struct NodeArray) + 
+    (sizeof(struct TreeNode *) + ((is_counted) ? sizeof(size_t) : 0)) * 
+    capacity;
+}
+
+/**
+ *  A helper function that allocates an empty array.
+ *
+ *  @param capacity The number of nodes the array has room for.
+ *  @param is_counted Whether the array is counted.
+ *  @param epochs The epochs of the tree, whose arena holds the array.
+ *  @return The new array.
+ **/
+static struct NodeArray *helper_alloc(size_t capacity, int is_counted,
+				      struct Epochs *epochs) {
+  struct NodeArray *result = arena_alloc(epochs->arena, 
+					 helper_size(capacity, is_counted));
+  result->count = 0;
+  result->capacity = capacity;
+  result->is_counted = is_counted;
+  return result;
+}
+
+/**
+ *  A helper function that retires an array.
+ *
+ *  @param array The array.
+ *  @param epochs The epochs of the tree.
+ **/
+static void helper_retire(struct NodeArray *array, struct Epochs *epochs) {
+  // The shared empty arrays are never handed back
+  if ((array != &nodes_empty) && (array != &nodes_counted)) {
+    epoch_retire(epochs, array, helper_size(array->capacity, 
+					    array->is_counted));
+  }
+}
+
+/**
+ *  A helper function that rebuilds the sums of a counted array from the
+ *  image counts of its nodes, in O(n): each sum passes itself on to the 
+ *  next sum that covers it.
+ *
+ *  @param array The array.
+ **/
+static void helper_build(struct NodeArray *array) {
+  size_t *sums = helper_sums(array);
+  size_t i, next;
+  for (i = 0; i < array->count; i++) {
+    sums[i] = array->nodes[i]->num_images;
+  }
+  for (i = 0; i < array->count; i++) {
+    next = i | (i + 1);
+    if (next < array->count) {
+      sums[next] += sums[i];
+    }
+  }
+}
+
+/**
+ *  A helper function that writes the sum of a node appended to a counted 
+ *  array, in O(log n), from the sums of the nodes before it that it covers.
+ *
+ *  @param array The array.
+ *  @param position The position of the node [Its count].
+ **/
+static void helper_append_sum(struct NodeArray *array, size_t position) {
+  size_t *sums = helper_sums(array);
+  size_t sum = array->nodes[position]->num_images;
+  // Holds the 1-based position of the sum, and of the sums it covers
+  size_t end = position + 1;
+  size_t i;
+  for (i = position; i > end - (end & -end); i -= i & -i) {
+    sum += sums[i - 1];
+  }
+  sums[position] = sum;
+}
+
+/**
+ *  Insert a node into an array.
+ *
+ *  @param array Points to the array. Updated if the array is replaced.
+ *  @param position The sorted position of the node.
+ *  @param node The node.
+ *  @param epochs The epochs of the tree.
+ **/
+void nodes_insert(struct NodeArray **array, size_t position, 
+		  struct TreeNode *node, struct Epochs *epochs) {
+  struct NodeArray *former = *array;
+  struct NodeArray *result;
+  // If the node is appended and fits, readers never see the new entry 
+  // before the count that covers it
+  if ((position == former->count) && (former->count < former->capacity)) {
+    former->nodes[position] = node;
+    if (former->is_counted) {
+      helper_append_sum(former, position);
+    }
+    ATOMIC_PUBLISH(former->count, former->count + 1);
+  }
+  // If it fits and no reader is registered, shift the entries in place
+  else if ((former->count < former->capacity) && 
+	   (ATOMIC_READ(epochs->num_readers) == 0)) {
+    memmove(&former->nodes[position + 1], &former->nodes[position],
+	    sizeof(struct TreeNode *) * (former->count - position));
+    former->nodes[position] = node;
+    former->count++;
+    if (former->is_counted) {
+      helper_build(former);
+    }
+  }
+  // Else, copy the array with the node in place [Doubling the capacity if
+  // it is full] and publish the copy
+  else {
+    result = helper_alloc((former->count < former->capacity) ? 
+			  former->capacity : 
+			  ((former->capacity == 0) ? 1 : 
+			   (former->capacity * 2)), former->is_counted, 
+			  epochs);
+    memcpy(result->nodes, former->nodes, 
+	   sizeof(struct TreeNode *) * position);
+    result->nodes[position] = node;
+    memcpy(&result->nodes[position + 1], &former->nodes[position],
+	   sizeof(struct TreeNode *) * (former->count - position));
+    result->count = former->count + 1;
+    if (result->is_counted) {
+      helper_build(result);
+    }
+    ATOMIC_PUBLISH(*array, result);
+    helper_retire(former, epochs);
+  }
+}
+
+/**
+ *  Remove a node from an array. An array left a quarter full [OR] empty is
+ *  replaced by one of half the capacity [OR] by the shared empty array, so
+ *  removals hand memory back as inserts took it.
+ *
+ *  @param array Points to the array. Updated if the array is replaced.
+ *  @param position The position of the node.
+ *  @param epochs The epochs of the tree.
+ **/
+void nodes_remove(struct NodeArray **array, size_t position,
+		  struct Epochs *epochs) {
+  struct NodeArray *former = *array;
+  struct NodeArray *result;
+  size_t count = former->count - 1;
+  // If the array is left empty, share the empty array
+  if (count == 0) {
+    ATOMIC_PUBLISH(*array, (former->is_counted) ? &nodes_counted : 
+		   &nodes_empty);
+    helper_retire(former, epochs);
+  }
+  // Else, if it stays well filled and no reader is registered, shift the
+  // entries in place
+  else if ((count > former->capacity / 4) && 
+	   (ATOMIC_READ(epochs->num_readers) == 0)) {
+    memmove(&former->nodes[position], &former->nodes[position + 1],
+	    sizeof(struct TreeNode *) * (count - position));
+    former->count = count;
+    if (former->is_counted) {
+      helper_build(former);
+    }
+  }
+  // Else, copy the array without the node [Halving the capacity if it is
+  // a quarter full] and publish the copy
+  else {
+    result = helper_alloc((count > former->capacity / 4) ? 
+			  former->capacity : (former->capacity / 2), 
+			  former->is_counted, epochs);
+    memcpy(result->nodes, former->nodes, 
+	   sizeof(struct TreeNode *) * position);
+    memcpy(&result->nodes[position], &former->nodes[position + 1],
+	   sizeof(struct TreeNode *) * (count - position));
+    result->count = count;
+    if (result->is_counted) {
+      helper_build(result);
+    }
+    ATOMIC_PUBLISH(*array, result);
+    helper_retire(former, epochs);
+  }
+}
+
+/**
+ *  Replace an array by an empty one.
+ *
+ *  @param array Points to the array. Updated to the new array.
+ *  @param capacity The number of nodes the new array has room for.
+ *  @param epochs The epochs of the tree.
+ **/
+void nodes_reset(struct NodeArray **array, size_t capacity, 
+		 struct Epochs *epochs) {
+  struct NodeArray *former = *array;
+  struct NodeArray *empty = (former->is_counted) ? &nodes_counted : 
+    &nodes_empty;
+  ATOMIC_PUBLISH(*array, (capacity == 0) ? empty : 
+		 helper_alloc(capacity, former->is_counted, epochs));
+  helper_retire(former, epochs);
+}
+
+/**
+ *  Add to the image count of a node of a counted array, in every sum that
+ *  covers it.
+ *
+ *  @param array The array.
+ *  @param position The position of the node.
+ *  @param delta The number of images added [Negative if removed].
+ **/
+void nodes_count(struct NodeArray *array, size_t position, long delta) {
+  size_t *sums = helper_sums(array);
+  size_t i;
+  for (i = position + 1; i <= array->count; i += i & -i) {
+    ATOMIC_PUBLISH(sums[i - 1], sums[i - 1] + delta);
+  }
+}
+
+/**
+ *  Add up the images of the nodes before a position of a counted array.
+ *
+ *  @param array The array.
+ *  @param position The position [At most the count of nodes loaded].
+ *  @return The number of images.
+ **/
+size_t nodes_prefix(const struct NodeArray *array, size_t position) {
+  const size_t *sums = helper_sums(array);
+  size_t result = 0;
+  size_t i;
+  for (i = position; i > 0; i -= i & -i) {
+    result += ATOMIC_READ(sums[i - 1]);
+  }
+  return result;
+}
+
+/**
+ *  Find the most nodes from the start of a counted array that hold no more
+ *  than a number of images, by descending the binary indexed sums: each 
+ *  step takes the next sum whole if it still fits.
+ *
+ *  @param array The array.
+ *  @param count The number of nodes of the array, as loaded.
+ *  @param num_images The number of images.
+ *  @param sum Set to the number of images of the nodes found.
+ *  @return The number of nodes found [count if every node fits].
+ **/
+size_t nodes_seek(const struct NodeArray *array, size_t count, 
+		  size_t num_images, size_t *sum) {
+  const size_t *sums = helper_sums(array);
+  size_t result = 0;
+  size_t step = 1;
+  size_t next;
+  *sum = 0;
+  while (step * 2 <= count) {
+    step *= 2;
+  }
+  for ( ; (count > 0) && (step > 0); step /= 2) {
+    if (result + step <= count) {
+      next = ATOMIC_READ(sums[result + step - 1]);
+      if (*sum + next <= num_images) {
+	result += step;
+	*sum += next;
+      }
+    }
+  }
+  return result;
+}
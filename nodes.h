@@ -0,0 +1,74 @@
+/**
+ *  Sorted arrays of tree nodes that can be read while the writer inserts
+ *  into them.
+ **/
+
+#ifndef _NODES_H
+#define _NODES_H
+
+#include <stddef.h>
+
+#include "epoch.h"
+
+struct TreeNode;
+
+
+struct NodeArray {
+	// Entries below count never change once count is published
+	size_t count;
+	size_t capacity;
+	// Whether the array keeps the image counts of its nodes. Their sums
+	// follow the capacity of nodes, binary indexed: sum i adds up the 
+	// counts of nodes i + 1 - lowbit(i + 1) to i, lowbit being the lowest
+	// set bit [A Fenwick tree]
+	int is_counted;
+	struct TreeNode *nodes[];
+};
+
+// The empty arrays, uncounted [Postings] and counted [The child node index
+// of a node without child nodes]. They are never written to
+extern struct NodeArray nodes_empty;
+extern struct NodeArray nodes_counted;
+
+/*
+ * Insert a node into an array at the given position. The array is either
+ * appended to in place, or replaced by a copy that is published and the
+ * former array retired. A counted array takes the count of the node as it
+ * stands. Writer only.
+ */
+void nodes_insert(struct NodeArray **, size_t, struct TreeNode *, 
+		  struct Epochs *);
+
+/*
+ * Remove the node at the given position from an array. The array is either
+ * shifted in place, or replaced by a copy that is published and the former
+ * array retired. An array left mostly empty is shrunk. Writer only.
+ */
+void nodes_remove(struct NodeArray **, size_t, struct Epochs *);
+
+/*
+ * Replace an array by an empty one with room for the given number of 
+ * nodes, retiring the former array. Writer only.
+ */
+void nodes_reset(struct NodeArray **, size_t, struct Epochs *);
+
+/*
+ * Add to the image count of the node at the given position of a counted 
+ * array, after the node changed its own. Writer only.
+ */
+void nodes_count(struct NodeArray *, size_t, long);
+
+/*
+ * Return the number of images of the nodes before the given position of a
+ * counted array [At most the count of nodes loaded].
+ */
+size_t nodes_prefix(const struct NodeArray *, size_t);
+
+/*
+ * Find the most nodes from the start of a counted array, of which the given
+ * count of nodes was loaded, that hold no more than the given number of 
+ * images. Return the number of nodes, and set the number of their images.
+ */
+size_t nodes_seek(const struct NodeArray *, size_t, size_t, size_t *);
+
+#endif /* _NODES_H */
@@ -0,0 +1,229 @@
+/**
+ *  Buffered output of the image database. Results are appended to a large
+ *  reusable buffer with memcpy, and written out in large chunks with 
+ *  write/writev, instead of one printf per value.
+ **/
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "output.h"
+
+/**
+ *  A helper function that writes a buffered chunk followed by more chunks
+ *  to the file descriptor of a sink, with as few system calls as possible.
+ *
+ *  @param output The sink.
+ *  @param blocks The other chunks.
+ *  @param num_blocks The number of other chunks [At most 
+ *  OUTPUT_MAX_BLOCKS].
+ **/
+static void helper_write(struct Output *output, const struct iovec *blocks,
+			 int num_blocks) {
+  struct iovec chunks[OUTPUT_MAX_BLOCKS + 1];
+  struct iovec *next = chunks;
+  int num_chunks = 0;
+  int i;
+  // Skip any empty chunk
+  if (output->used > 0) {
+    chunks[num_chunks].iov_base = output->buffer;
+    chunks[num_chunks++].iov_len = output->used;
+  }
+  for (i = 0; i < num_blocks; i++) {
+    if (blocks[i].iov_len > 0) {
+      chunks[num_chunks++] = blocks[i];
+    }
+  }
+  // Keep writing until every chunk is written [OR] until writing fails
+  while ((num_chunks > 0) && (!output->is_failed)) {
+    ssize_t written = writev(output->fd, next, num_chunks);
+    if (written < 0) {
+      if (errno != EINTR) {
+	perror("write");
+	output->is_failed = 1;
+      }
+    }
+    else {
+      // Skip the written bytes
+      while ((num_chunks > 0) && ((size_t) written >= next->iov_len)) {
+	written -= next->iov_len;
+	next++;
+	num_chunks--;
+      }
+      if (num_chunks > 0) {
+	next->iov_base = (char *) next->iov_base + written;
+	next->iov_len -= written;
+      }
+    }
+  }
+  output->used = 0;
+}
+
+/**
+ *  Initialize a sink that writes to a file descriptor.
+ *
+ *  @param output The sink.
+ *  @param fd The file descriptor.
+ **/
+void output_init_fd(struct Output *output, int fd) {
+  output->fd = fd;
+  output->buffer = malloc(OUTPUT_BUFFER_SIZE);
+  if (output->buffer == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+  output->used = 0;
+  output->capacity = OUTPUT_BUFFER_SIZE;
+  output->is_failed = 0;
+}
+
+/**
+ *  Initialize a sink that collects everything in memory. The collected 
+ *  bytes are found in its buffer.
+ *
+ *  @param output The sink.
+ **/
+void output_init_memory(struct Output *output) {
+  output->fd = -1;
+  output->buffer = NULL;
+  output->used = 0;
+  output->capacity = 0;
+  output->is_failed = 0;
+}
+
+/**
+ *  Append bytes to a sink.
+ *
+ *  @param output The sink.
+ *  @param data The bytes.
+ *  @param size The number of bytes.
+ **/
+void output_append(struct Output *output, const char *data, size_t size) {
+  // If the bytes fit in the buffer, copy them
+  if (output->used + size <= output->capacity) {
+    memcpy(output->buffer + output->used, data, size);
+    output->used += size;
+  }
+  // Else, if this is a memory sink, grow its buffer
+  else if (output->fd == -1) {
+    while (output->used + size > output->capacity) {
+      output->capacity = (output->capacity == 0) ? 4096 :
+	(output->capacity * 2);
+    }
+    output->buffer = realloc(output->buffer, output->capacity);
+    if (output->buffer == NULL) {
+      perror("realloc");
+      exit(1);
+    }
+    memcpy(output->buffer + output->used, data, size);
+    output->used += size;
+  }
+  // Else, write the buffer and the bytes together, without copying them
+  else {
+    struct iovec block;
+    block.iov_base = (void *) data;
+    block.iov_len = size;
+    helper_write(output, &block, 1);
+  }
+}
+
+/**
+ *  Append several blocks of bytes to a sink. A file descriptor sink copies
+ *  small blocks into its buffer as long as it can, and writes out the rest
+ *  after its buffer, many blocks per system call, without copying them.
+ *
+ *  @param output The sink.
+ *  @param blocks The blocks.
+ *  @param num_blocks The number of blocks.
+ **/
+void output_append_blocks(struct Output *output, const struct iovec *blocks,
+			  size_t num_blocks) {
+  // Holds the first block not yet appended, and the number of blocks from
+  // it on to be written out together
+  size_t first = 0;
+  size_t num_pending = 0;
+  while (first + num_pending < num_blocks) {
+    const struct iovec *block = &blocks[first + num_pending];
+    // If nothing is pending, and the block is small and fits in the 
+    // buffer [OR] this is a memory sink, copy it
+    if ((num_pending == 0) && 
+	((output->fd == -1) || 
+	 ((block->iov_len <= OUTPUT_BUFFER_SIZE / 16) &&
+	  (output->used + block->iov_len <= output->capacity)))) {
+      output_append(output, block->iov_base, block->iov_len);
+      first++;
+    }
+    // Else, it is written out with the buffer and the blocks before it
+    else if (++num_pending == OUTPUT_MAX_BLOCKS) {
+      helper_write(output, &blocks[first], num_pending);
+      first += num_pending;
+      num_pending = 0;
+    }
+  }
+  if (num_pending > 0) {
+    helper_write(output, &blocks[first], num_pending);
+  }
+}
+
+/**
+ *  Append a NUL-terminated string to a sink.
+ *
+ *  @param output The sink.
+ *  @param value The string.
+ **/
+void output_puts(struct Output *output, const char *value) {
+  output_append(output, value, strlen(value));
+}
+
+/**
+ *  Append a character to a sink.
+ *
+ *  @param output The sink.
+ *  @param value The character.
+ **/
+void output_putc(struct Output *output, char value) {
+  // Fast path: room is left in the buffer
+  if (output->used < output->capacity) {
+    output->buffer[output->used++] = value;
+  }
+  else {
+    output_append(output, &value, 1);
+  }
+}
+
+/**
+ *  Write out everything buffered by a file descriptor sink.
+ *
+ *  @param output The sink.
+ **/
+void output_flush(struct Output *output) {
+  if ((output->fd != -1) && (output->used > 0)) {
+    helper_write(output, NULL, 0);
+  }
+}
+
+/**
+ *  Forget everything collected by a memory sink.
+ *
+ *  @param output The sink.
+ **/
+void output_reset(struct Output *output) {
+  output->used = 0;
+}
+
+/**
+ *  Flush a sink and release its buffer.
+ *
+ *  @param output The sink.
+ **/
+void output_destroy(struct Output *output) {
+  output_flush(output);
+  free(output->buffer);
+  output->buffer = NULL;
+  output->used = 0;
+  output->capacity = 0;
+}
@@ -0,0 +1,67 @@
+/**
+ *  Buffered output of the image database.
+ **/
+
+#ifndef _OUTPUT_H
+#define _OUTPUT_H
+
+#include <stddef.h>
+#include <sys/uio.h>
+
+// Size of the buffer of a file descriptor sink
+#define OUTPUT_BUFFER_SIZE	(1 << 16)
+// Largest number of blocks written out by one system call
+#define OUTPUT_MAX_BLOCKS	256
+
+
+struct Output {
+	// The file descriptor written to when the buffer is flushed [-1 for a
+	// memory sink, whose buffer grows instead and is never flushed]
+	int fd;
+	char *buffer;
+	size_t used;
+	size_t capacity;
+	// Set once a write to the file descriptor failed
+	int is_failed;
+};
+
+/*
+ * Initialize a sink that writes to a file descriptor in large chunks.
+ */
+void output_init_fd(struct Output *, int);
+
+/*
+ * Initialize a sink that collects everything in memory.
+ */
+void output_init_memory(struct Output *);
+
+/*
+ * Append bytes, a NUL-terminated string, or a character.
+ */
+void output_append(struct Output *, const char *, size_t);
+void output_puts(struct Output *, const char *);
+void output_putc(struct Output *, char);
+
+/*
+ * Append several blocks of bytes, in order. A file descriptor sink writes
+ * large blocks out with writev instead of copying them.
+ */
+void output_append_blocks(struct Output *, const struct iovec *, size_t);
+
+/*
+ * Write out everything buffered by a file descriptor sink. A memory sink is
+ * left unchanged.
+ */
+void output_flush(struct Output *);
+
+/*
+ * Forget everything collected by a memory sink.
+ */
+void output_reset(struct Output *);
+
+/*
+ * Flush the sink and release its buffer.
+ */
+void output_destroy(struct Output *);
+
+#endif /* _OUTPUT_H */
@@ -0,0 +1,124 @@
+/**
+ *  Block reader of the image database. Input is read in blocks of
+ *  READER_BLOCK_SIZE bytes straight into one buffer, and lines are found
+ *  with a vectorized newline scan and terminated where they lie, so a line
+ *  costs no copy and no stdio call. A line longer than the buffer is kept
+ *  whole: the buffer doubles until it fits.
+ **/
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "reader.h"
+#include "scan.h"
+
+/**
+ *  Initialize a reader.
+ *
+ *  @param reader A pointer to the reader.
+ *  @param fd The file descriptor to read from.
+ **/
+void reader_init(struct Reader *reader, int fd) {
+  reader->fd = fd;
+  // One more byte terminates a last line cut off by EOF
+  reader->buffer = malloc(READER_BLOCK_SIZE + 1);
+  if (reader->buffer == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+  reader->capacity = READER_BLOCK_SIZE;
+  reader->start = 0;
+  reader->scanned = 0;
+  reader->end = 0;
+  reader->is_eof = 0;
+}
+
+/**
+ *  A helper function that reads the next block after the bytes not yet
+ *  returned, making room for it first.
+ *
+ *  @param reader A pointer to the reader.
+ **/
+static void helper_fill(struct Reader *reader) {
+  ssize_t size;
+  // Move the partial line to the front of the buffer
+  if (reader->start > 0) {
+    memmove(reader->buffer, reader->buffer + reader->start,
+	    reader->end - reader->start);
+    reader->end -= reader->start;
+    reader->scanned -= reader->start;
+    reader->start = 0;
+  }
+  // If the partial line fills the buffer, double it
+  if (reader->end == reader->capacity) {
+    reader->capacity *= 2;
+    reader->buffer = realloc(reader->buffer, reader->capacity + 1);
+    if (reader->buffer == NULL) {
+      perror("realloc");
+      exit(1);
+    }
+  }
+  do {
+    size = read(reader->fd, reader->buffer + reader->end,
+		reader->capacity - reader->end);
+  } while ((size < 0) && (errno == EINTR));
+  // A failed read ends the input, as EOF does
+  if (size < 0) {
+    perror("read");
+  }
+  if (size <= 0) {
+    reader->is_eof = 1;
+    return;
+  }
+  reader->end += size;
+}
+
+/**
+ *  Return the next line.
+ *
+ *  @param reader A pointer to the reader.
+ *  @param length Holds the length of the line.
+ *  @return The line, terminated in place; or NULL at EOF.
+ **/
+char *reader_next_line(struct Reader *reader, size_t *length) {
+  char *line;
+  const char *newline;
+  // Keep reading until a newline character [OR] EOF is met
+  while ((newline = scan_byte(reader->buffer + reader->scanned,
+			      reader->buffer + reader->end, '\n')) ==
+	 reader->buffer + reader->end) {
+    reader->scanned = reader->end;
+    if (reader->is_eof) {
+      break;
+    }
+    helper_fill(reader);
+  }
+  line = reader->buffer + reader->start;
+  *length = newline - line;
+  // At EOF, the last line may lack its newline character
+  if (newline == reader->buffer + reader->end) {
+    if (*length == 0) {
+      return NULL;
+    }
+    reader->start = reader->end;
+  }
+  else {
+    reader->start = newline - reader->buffer + 1;
+  }
+  reader->scanned = reader->start;
+  line[*length] = '\0';
+  return line;
+}
+
+/**
+ *  Release the buffer of a reader.
+ *
+ *  @param reader A pointer to the reader.
+ **/
+void reader_destroy(struct Reader *reader) {
+  free(reader->buffer);
+  reader->buffer = NULL;
+}
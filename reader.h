@@ -0,0 +1,45 @@
+/**
+ *  Block reader that splits a file descriptor into lines of any length.
+ **/
+
+#ifndef _READER_H
+#define _READER_H
+
+#include <stddef.h>
+
+// Number of bytes asked for per read system call
+#define READER_BLOCK_SIZE	(1 << 16)
+
+
+struct Reader {
+	int fd;
+	// Bytes read; [start, end) are not yet returned, and [start, scanned)
+	// is known to hold no newline character
+	char *buffer;
+	size_t capacity;
+	size_t start;
+	size_t scanned;
+	size_t end;
+	// Set once read returned EOF [OR] failed
+	int is_eof;
+};
+
+
+/*
+ * Initialize a reader of the given file descriptor.
+ */
+void reader_init(struct Reader *, int);
+
+/*
+ * Return the next line, without its newline character and terminated in
+ * place, and store its length. The last line may lack its newline 
+ * character. The line stays valid until the next call. Return NULL at EOF.
+ */
+char *reader_next_line(struct Reader *, size_t *);
+
+/*
+ * Release the buffer of a reader. The file descriptor is left open.
+ */
+void reader_destroy(struct Reader *);
+
+#endif /* _READER_H */
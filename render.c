@@ -0,0 +1,286 @@
+/**
+ *  Memoized rendering of the PRINT OPERATION. The output of a PRINT
+ *  OPERATION is the images below each first depth level node, one after
+ *  the other, so it is kept as one rendered block per Attribute 1 (A1)
+ *  value. A change only drops the block of its own A1 value; the next
+ *  PRINT OPERATION renders that block again, and writes every other block
+ *  out as it is, with writev.
+ *
+ *  The blocks hold a second copy of the output, so their total length is 
+ *  bounded. Every PRINT OPERATION writes out every block, so recency says
+ *  nothing about which block is worth keeping, and evicting the least 
+ *  recently used block to make room would evict the blocks the same PRINT
+ *  OPERATION needs next time. A block that does not fit is therefore 
+ *  written out and dropped instead. The blocks kept are those that 
+ *  changes leave alone; a block dropped by a change makes room for 
+ *  whichever block is rendered next.
+ **/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "render.h"
+
+/**
+ *  A helper function that finds the link to the block of a value, in its
+ *  bucket.
+ *
+ *  @param cache The render cache.
+ *  @param value The value.
+ *  @param hash The hash of the value.
+ *  @return The link to the block, or the NULL link ending the bucket if
+ *  there is none.
+ **/
+static struct RenderBlock **helper_find(const struct RenderCache *cache,
+					const char *value, unsigned int hash) {
+  struct RenderBlock **link = &cache->buckets[hash & cache->mask];
+  while ((*link != NULL) &&
+	 (((*link)->hash != hash) || (strcmp((*link)->value, value) != 0))) {
+    link = &(*link)->next;
+  }
+  return link;
+}
+
+/**
+ *  A helper function that doubles the number of buckets of a render cache.
+ *
+ *  @param cache The render cache.
+ **/
+static void helper_grow(struct RenderCache *cache) {
+  size_t num_buckets = (cache->mask + 1) * 2;
+  struct RenderBlock **buckets = calloc(num_buckets,
+					sizeof(struct RenderBlock *));
+  struct RenderBlock *cur;
+  struct RenderBlock *next;
+  size_t i;
+  if (buckets == NULL) {
+    perror("calloc");
+    exit(1);
+  }
+  // Move every block into the new buckets
+  for (i = 0; i <= cache->mask; i++) {
+    for (cur = cache->buckets[i]; cur != NULL; cur = next) {
+      next = cur->next;
+      cur->next = buckets[cur->hash & (num_buckets - 1)];
+      buckets[cur->hash & (num_buckets - 1)] = cur;
+    }
+  }
+  free(cache->buckets);
+  cache->buckets = buckets;
+  cache->mask = num_buckets - 1;
+}
+
+/**
+ *  A helper function that drops a block and releases its memory.
+ *
+ *  @param cache The render cache.
+ *  @param link The link to the block.
+ **/
+static void helper_remove(struct RenderCache *cache,
+			  struct RenderBlock **link) {
+  struct RenderBlock *block = *link;
+  *link = block->next;
+  cache->count--;
+  cache->num_bytes -= block->length;
+  free(block->text);
+  free(block);
+}
+
+/**
+ *  A helper function that renders the images below a first depth level
+ *  node and caches them as its block, if the block fits.
+ *
+ *  @param cache The render cache.
+ *  @param tree A pointer to the tree.
+ *  @param node The first depth level node.
+ *  @param link The NULL link where the block belongs.
+ *  @param rendered Collects the rendered images. Left to be written out and
+ *  destroyed by the caller if the block is not cached.
+ *  @return The new block, or NULL if it would pass the limit of the cache.
+ **/
+static struct RenderBlock *helper_render(struct RenderCache *cache,
+					 const struct Tree *tree,
+					 const struct TreeNode *node,
+					 struct RenderBlock **link,
+					 struct Output *rendered) {
+  struct RenderBlock *block;
+  output_init_memory(rendered);
+  tree_print_branch(tree, node, rendered);
+  cache->num_rendered++;
+  if (rendered->used > cache->max_bytes - cache->num_bytes) {
+    cache->num_uncached++;
+    return NULL;
+  }
+  block = malloc(sizeof(struct RenderBlock) + node->value->length + 1);
+  if (block == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+  // The block takes over the collected bytes
+  block->hash = node->value->hash;
+  block->text = rendered->buffer;
+  block->length = rendered->used;
+  memcpy(block->value, node->value->text, node->value->length + 1);
+  block->next = NULL;
+  *link = block;
+  cache->count++;
+  cache->num_bytes += block->length;
+  // At most one block per bucket on average
+  if (cache->count > cache->mask + 1) {
+    helper_grow(cache);
+  }
+  return block;
+}
+
+/**
+ *  Initialize an empty render cache.
+ *
+ *  @param cache The render cache.
+ **/
+void render_init(struct RenderCache *cache) {
+  memset(cache, 0, sizeof(struct RenderCache));
+  cache->buckets = calloc(RENDER_INITIAL_CAPACITY,
+			  sizeof(struct RenderBlock *));
+  if (cache->buckets == NULL) {
+    perror("calloc");
+    exit(1);
+  }
+  cache->mask = RENDER_INITIAL_CAPACITY - 1;
+  cache->max_bytes = RENDER_MAX_BYTES;
+}
+
+/**
+ *  Release all memory held by a render cache.
+ *
+ *  @param cache The render cache.
+ **/
+void render_destroy(struct RenderCache *cache) {
+  render_clear(cache);
+  free(cache->buckets);
+  cache->buckets = NULL;
+}
+
+/**
+ *  Print a complete tree, in sorted order, from the cached blocks if its
+ *  depth levels are in attribute order.
+ *
+ *  @param cache The render cache.
+ *  @param tree A pointer to the tree.
+ *  @param output The sink to print to.
+ **/
+void render_print(struct RenderCache *cache, const struct Tree *tree,
+		  struct Output *output) {
+  const struct NodeArray *children = tree->root.children;
+  struct iovec *blocks;
+  size_t num_blocks = 0;
+  struct RenderBlock **link;
+  struct RenderBlock *block;
+  // Holds a block that is not cached
+  struct Output rendered;
+  const struct TreeNode *node;
+  size_t i;
+  int depth_level;
+  // Blocks are only kept while the first depth level holds Attribute 1 
+  // (A1) [A planned tree is printed as a whole]
+  for (depth_level = 0; depth_level < NUM_ATTRIBUTES; depth_level++) {
+    if (tree->order[depth_level] != depth_level) {
+      tree_print(tree, output);
+      return;
+    }
+  }
+  // If database is empty
+  if (children->count == 0) {
+    // Output NULL
+    output_puts(output, "(NULL)\n");
+    return;
+  }
+  blocks = malloc(sizeof(struct iovec) * children->count);
+  if (blocks == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+  // Take the block of every first depth level node, rendering the missing
+  // ones
+  for (i = 0; i < children->count; i++) {
+    node = children->nodes[i];
+    link = helper_find(cache, node->value->text, node->value->hash);
+    if (*link != NULL) {
+      block = *link;
+      cache->num_reused++;
+    }
+    else {
+      block = helper_render(cache, tree, node, link, &rendered);
+      // If the block did not fit, write it out after the blocks before it
+      if (block == NULL) {
+	output_append_blocks(output, blocks, num_blocks);
+	num_blocks = 0;
+	output_append(output, rendered.buffer, rendered.used);
+	output_destroy(&rendered);
+	continue;
+      }
+    }
+    blocks[num_blocks].iov_base = block->text;
+    blocks[num_blocks].iov_len = block->length;
+    num_blocks++;
+  }
+  output_append_blocks(output, blocks, num_blocks);
+  free(blocks);
+}
+
+/**
+ *  Drop the block an INSERT [OR] DELETE OPERATION may change.
+ *
+ *  @param cache The render cache.
+ *  @param values The tokens of the operation.
+ **/
+void render_invalidate(struct RenderCache *cache, char **values) {
+  struct RenderBlock **link;
+  size_t length;
+  // A DELETE OPERATION of any Attribute 1 (A1) value may change any block
+  if ((values[0][0] == DELETE) && (strcmp(values[1], MATCH_ANY) == 0)) {
+    cache->num_invalidated += cache->count;
+    render_clear(cache);
+  }
+  else {
+    // Blocks are found by the hash of their interned A1 value
+    link = helper_find(cache, values[1], intern_hash(values[1], &length));
+    if (*link != NULL) {
+      helper_remove(cache, link);
+      cache->num_invalidated++;
+    }
+  }
+}
+
+/**
+ *  Drop every block of a render cache.
+ *
+ *  @param cache The render cache.
+ **/
+void render_clear(struct RenderCache *cache) {
+  size_t i;
+  for (i = 0; (cache->count > 0) && (i <= cache->mask); i++) {
+    while (cache->buckets[i] != NULL) {
+      helper_remove(cache, &cache->buckets[i]);
+    }
+  }
+}
+
+/**
+ *  Print the statistics of a render cache.
+ *
+ *  @param cache The render cache.
+ *  @param output The sink to print to.
+ **/
+void render_report(const struct RenderCache *cache, struct Output *output) {
+  char buf[256];
+  int size = snprintf(buf, sizeof(buf), "Print blocks: %zu cached (%zu of "
+		      "%zu bytes), %lu reused, %lu rendered (%lu not cached), "
+		      "%lu invalidated\n", cache->count, cache->num_bytes, 
+		      cache->max_bytes, cache->num_reused, cache->num_rendered,
+		      cache->num_uncached, cache->num_invalidated);
+  if (size > 0) {
+    output_append(output, buf, ((size_t) size < sizeof(buf)) ?
+		  (size_t) size : (sizeof(buf) - 1));
+  }
+}
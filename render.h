@@ -0,0 +1,77 @@
+/**
+ *  Memoized rendering of the PRINT OPERATION of the image database.
+ **/
+
+#ifndef _RENDER_H
+#define _RENDER_H
+
+#include <stddef.h>
+
+#include "output.h"
+#include "tree.h"
+
+// Initial number of buckets of a render cache (a power of two)
+#define RENDER_INITIAL_CAPACITY	64
+// Largest total length of the blocks of a render cache, in bytes. Blocks 
+// rendered beyond it are written out without being kept
+#ifndef RENDER_MAX_BYTES
+#define RENDER_MAX_BYTES	(1 << 26)
+#endif
+
+
+// The rendered images of one Attribute 1 (A1) value
+struct RenderBlock {
+	// Hash of the value, as interned
+	unsigned int hash;
+	// The PRINT output of its images
+	char *text;
+	size_t length;
+	// Next block of the same bucket
+	struct RenderBlock *next;
+	// The value, NUL-terminated
+	char value[];
+};
+
+struct RenderCache {
+	// Chained hash table of the blocks [Its size is a power of two]
+	struct RenderBlock **buckets;
+	size_t mask;
+	size_t count;
+	// Total length of the blocks, and the most it may reach
+	size_t num_bytes;
+	size_t max_bytes;
+	unsigned long num_reused;
+	unsigned long num_rendered;
+	// Blocks rendered but not kept, as they would pass max_bytes
+	unsigned long num_uncached;
+	unsigned long num_invalidated;
+};
+
+void render_init(struct RenderCache *);
+void render_destroy(struct RenderCache *);
+
+/*
+ * PRINT OPERATION on a tree. Unless the tree is planned, every block still
+ * cached is written out as it is, and only the others are rendered [See 
+ * tree_print_branch] and cached, as long as the blocks stay within 
+ * RENDER_MAX_BYTES.
+ */
+void render_print(struct RenderCache *, const struct Tree *, struct Output *);
+
+/*
+ * Drop the block an INSERT [OR] DELETE OPERATION of the given tokens may
+ * change, or every block if its Attribute 1 (A1) value is *.
+ */
+void render_invalidate(struct RenderCache *, char **);
+
+/*
+ * Drop every block.
+ */
+void render_clear(struct RenderCache *);
+
+/*
+ * Print the number of blocks and bytes cached, reused and rendered.
+ */
+void render_report(const struct RenderCache *, struct Output *);
+
+#endif /* _RENDER_H */
@@ -0,0 +1,185 @@
+/**
+ *  Vectorized byte scans. To find a byte, input is compared 16 bytes at a
+ *  time with SSE2, or 64 bytes at a time with AVX2 where the processor has
+ *  it, and the first match is read off the comparison bit mask. Delimiters
+ *  are returned as the bit mask itself, 64 bytes at a time, for tokenize to
+ *  walk. Plain byte loops are used on other processors [OR] when built with
+ *  -DSCAN_SCALAR.
+ **/
+
+#include <stddef.h>
+#include <string.h>
+
+#include "scan.h"
+#include "utils.h"
+
+#if defined(__SSE2__) && !defined(SCAN_SCALAR)
+#define SCAN_SSE2
+#include <immintrin.h>
+#endif
+
+// The two characters of DELIMITERS
+#define DELIMITER_SPACE	' '
+#define DELIMITER_NEWLINE	'\n'
+
+
+#ifdef SCAN_SSE2
+
+/**
+ *  A helper function that finds a byte 16 bytes at a time.
+ *
+ *  @param start The first byte to scan.
+ *  @param end The end of the bytes to scan.
+ *  @param value The byte to find.
+ *  @return The first matching byte, or end.
+ **/
+static const char *helper_scan_byte_sse2(const char *start, const char *end,
+					 char value) {
+  __m128i target = _mm_set1_epi8(value);
+  int mask;
+  for ( ; end - start >= 16; start += 16) {
+    mask = _mm_movemask_epi8(_mm_cmpeq_epi8(
+      _mm_loadu_si128((const __m128i *) start), target));
+    if (mask != 0) {
+      return start + __builtin_ctz(mask);
+    }
+  }
+  while ((start < end) && (*start != value)) {
+    start++;
+  }
+  return start;
+}
+
+/**
+ *  A helper function that finds a byte 64 bytes at a time. Only called on
+ *  processors with AVX2.
+ *
+ *  @param start The first byte to scan.
+ *  @param end The end of the bytes to scan.
+ *  @param value The byte to find.
+ *  @return The first matching byte, or end.
+ **/
+__attribute__((target("avx2")))
+static const char *helper_scan_byte_avx2(const char *start, const char *end,
+					 char value) {
+  __m256i target = _mm256_set1_epi8(value);
+  __m256i first, second;
+  unsigned long long mask;
+  for ( ; end - start >= 64; start += 64) {
+    first = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *) start),
+			      target);
+    second = _mm256_cmpeq_epi8(
+      _mm256_loadu_si256((const __m256i *) (start + 32)), target);
+    // Test both halves at once, and only build the mask on a match
+    if (!_mm256_testz_si256(_mm256_or_si256(first, second),
+			    _mm256_or_si256(first, second))) {
+      mask = (unsigned int) _mm256_movemask_epi8(first) |
+	((unsigned long long) (unsigned int) _mm256_movemask_epi8(second)
+	 << 32);
+      return start + __builtin_ctzll(mask);
+    }
+  }
+  return helper_scan_byte_sse2(start, end, value);
+}
+
+/**
+ *  A helper function that finds a byte with the widest scan the processor
+ *  has, and sets scan_byte up to call that scan directly from then on.
+ **/
+static const char *helper_scan_byte_first(const char *, const char *, char);
+
+// The scan used by scan_byte
+static const char *(*scan_byte_function)(const char *, const char *, char) =
+  helper_scan_byte_first;
+
+static const char *helper_scan_byte_first(const char *start,
+					  const char *end, char value) {
+  __builtin_cpu_init();
+  __atomic_store_n(&scan_byte_function,
+		   __builtin_cpu_supports("avx2") ? helper_scan_byte_avx2 :
+		   helper_scan_byte_sse2, __ATOMIC_RELAXED);
+  return scan_byte_function(start, end, value);
+}
+
+/**
+ *  A helper function that compares 16 bytes with the delimiters.
+ *
+ *  @param bytes The bytes.
+ *  @return A bit mask with a bit set for every delimiter.
+ **/
+static unsigned int helper_delimiter_mask(__m128i bytes) {
+  return (unsigned int) _mm_movemask_epi8(_mm_or_si128(
+    _mm_cmpeq_epi8(bytes, _mm_set1_epi8(DELIMITER_SPACE)),
+    _mm_cmpeq_epi8(bytes, _mm_set1_epi8(DELIMITER_NEWLINE))));
+}
+
+#else
+
+/**
+ *  A helper function that checks if a byte is a delimiter.
+ *
+ *  @param value The byte.
+ *  @return 1 if the byte is a delimiter; 0 otherwise.
+ **/
+static int helper_is_delimiter(char value) {
+  return (value == DELIMITER_SPACE) || (value == DELIMITER_NEWLINE);
+}
+
+#endif /* SCAN_SSE2 */
+
+/**
+ *  Find the first byte equal to a given byte.
+ *
+ *  @param start The first byte to scan.
+ *  @param end The end of the bytes to scan.
+ *  @param value The byte to find.
+ *  @return The first matching byte, or end.
+ **/
+const char *scan_byte(const char *start, const char *end, char value) {
+#ifdef SCAN_SSE2
+  return __atomic_load_n(&scan_byte_function, __ATOMIC_RELAXED)(start, end,
+								 value);
+#else
+  while ((start < end) && (*start != value)) {
+    start++;
+  }
+  return start;
+#endif
+}
+
+/**
+ *  Find the delimiters among the first 64 bytes. The bytes are compared 16
+ *  at a time; the last, partial 16 bytes are copied out first, so no byte
+ *  past the end is ever read.
+ *
+ *  @param start The first byte to scan.
+ *  @param end The end of the bytes to scan.
+ *  @return A bit mask with bit i set if start[i] is a delimiter [OR] is past
+ *  the end.
+ **/
+unsigned long long scan_delimiter_mask(const char *start, const char *end) {
+  unsigned long long result = 0;
+  size_t size = ((end - start) < 64) ? (size_t) (end - start) : 64;
+  size_t i = 0;
+#ifdef SCAN_SSE2
+  char tail[16] = {'\0'};
+  for ( ; i + 16 <= size; i += 16) {
+    result |= (unsigned long long) helper_delimiter_mask(
+      _mm_loadu_si128((const __m128i *) (start + i))) << i;
+  }
+  if (i < size) {
+    memcpy(tail, start + i, size - i);
+    result |= (unsigned long long) helper_delimiter_mask(
+      _mm_loadu_si128((const __m128i *) tail)) << i;
+  }
+#else
+  for ( ; i < size; i++) {
+    result |= (unsigned long long) helper_is_delimiter(start[i]) << i;
+  }
+#endif
+  // Bytes past the end count as delimiters
+  if (size < 64) {
+    result |= ~0ULL << size;
+  }
+  return result;
+}
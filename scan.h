@@ -0,0 +1,20 @@
+/**
+ *  Vectorized byte scans used to split input into lines and tokens.
+ **/
+
+#ifndef _SCAN_H
+#define _SCAN_H
+
+/*
+ * Return the first byte of [start, end) equal to the given byte, or end if
+ * there is none.
+ */
+const char *scan_byte(const char *, const char *, char);
+
+/*
+ * Return a bit mask of the first 64 bytes of [start, end): bit i is set if
+ * start[i] is one of the DELIMITERS, or if start + i is past the end.
+ */
+unsigned long long scan_delimiter_mask(const char *, const char *);
+
+#endif /* _SCAN_H */
@@ -0,0 +1,441 @@
+/**
+ *  Unix domain socket server for the image database. A single thread
+ *  multiplexes every client with epoll. Each read system call takes in as
+ *  many pipelined requests as the client has sent; they are all run, and
+ *  their responses collected and handed back with a single write system
+ *  call. A client whose responses pile up is not read from until it has
+ *  read them.
+ **/
+
+// accept4 is a GNU extension
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "scan.h"
+#include "server.h"
+#include "utils.h"
+
+
+struct ServerClient {
+	int fd;
+	// Bytes read but not yet run [Only ever a partial request between
+	// reads]. One more byte terminates a last request cut off by EOF
+	char input[SERVER_READ_SIZE + SERVER_MAX_REQUEST + 1];
+	size_t used;
+	// Set while the rest of an over-long request is dropped
+	int is_discarding;
+	// Responses to be written, and how much of them was written
+	struct Output output;
+	size_t sent;
+	// Set once the client closed its end [OR] a write to it failed
+	int is_closing;
+	int is_failed;
+	// The events the client is registered for
+	unsigned int events;
+	// Every client is kept in a list, to be closed on shutdown
+	struct ServerClient *previous;
+	struct ServerClient *next;
+};
+
+// Set by SIGINT and SIGTERM
+static volatile sig_atomic_t is_stopping = 0;
+
+/**
+ *  A helper function that asks the server to stop.
+ *
+ *  @param signal_number The signal received.
+ **/
+static void helper_stop(int signal_number) {
+  is_stopping = 1;
+}
+
+/**
+ *  A helper function that runs one request of a client and collects its
+ *  response.
+ *
+ *  @param database The database.
+ *  @param client The client.
+ *  @param line The request, NUL-terminated.
+ **/
+static void helper_run(struct Database *database, struct ServerClient *client,
+		       char *line) {
+  // char* array to hold the pointers to tokens
+  char *args[INPUT_ARG_MAX_NUM];
+  int num_tokens = tokenize(line, args);
+  // Holds the page of a QUERY [OR] PRINT OPERATION
+  size_t offset;
+  size_t limit;
+  // If the request [OR] its page is invalid
+  if ((num_tokens == -1) ||
+      (((args[0][0] == QUERY) || (args[0][0] == PRINT)) &&
+       (tokenize_page(args, num_tokens, &offset, &limit) == -1))) {
+    output_puts(&client->output, ERROR_MSG);
+  }
+  // Else, if we have an INSERT OPERATION
+  else if (args[0][0] == INSERT) {
+    if (database_insert(database, args) == -1) {
+      output_puts(&client->output, ERROR_MSG);
+    }
+  }
+  // Else, if we have a DELETE OPERATION
+  else if (args[0][0] == DELETE) {
+    if (database_delete(database, args) == -1) {
+      output_puts(&client->output, ERROR_MSG);
+    }
+  }
+  // Else, if we have a QUERY OPERATION
+  else if (args[0][0] == QUERY) {
+    database_search_page(database, args, offset, limit, &client->output);
+  }
+  // Else, if we have a PRINT OPERATION
+  else if (args[0][0] == PRINT) {
+    database_print_page(database, offset, limit, &client->output);
+  }
+  // Else, if we have a COUNT OPERATION
+  else if (args[0][0] == COUNT) {
+    database_count_query(database, args, &client->output);
+  }
+  // Else, if we have a STATS OPERATION
+  else if (args[0][0] == STATS) {
+    database_stats(database, &client->output);
+  }
+  // Else, if we have a FREEZE OPERATION
+  else if (args[0][0] == FREEZE) {
+    if (database_freeze(database) == -1) {
+      output_puts(&client->output, ERROR_MSG);
+    }
+  }
+  // Else, SAVE, LOAD and COMPACT OPERATIONS are not served
+  else {
+    output_puts(&client->output, ERROR_MSG);
+  }
+}
+
+/**
+ *  A helper function that reads what a client sent and runs every complete
+ *  request in it.
+ *
+ *  @param database The database.
+ *  @param client The client.
+ **/
+static void helper_read(struct Database *database,
+			struct ServerClient *client) {
+  ssize_t size = read(client->fd, client->input + client->used,
+		      SERVER_READ_SIZE + SERVER_MAX_REQUEST - client->used);
+  char *line = client->input;
+  char *end;
+  // If the read failed, the client is gone
+  if (size < 0) {
+    if ((errno != EAGAIN) && (errno != EINTR)) {
+      client->is_closing = 1;
+      client->is_failed = 1;
+    }
+    return;
+  }
+  // If the client closed its end, run its last request, as with EOF on
+  // standard input
+  if (size == 0) {
+    client->is_closing = 1;
+    if ((client->used > 0) && (!client->is_discarding)) {
+      client->input[client->used] = '\0';
+      helper_run(database, client, line);
+    }
+    client->used = 0;
+    return;
+  }
+  client->used += size;
+  // Run every complete request
+  while ((end = (char *) scan_byte(line, client->input + client->used,
+				   '\n')) != client->input + client->used) {
+    *end = '\0';
+    // If this ends an over-long request, it was answered already
+    if (client->is_discarding) {
+      client->is_discarding = 0;
+    }
+    // A request must not be over-long [Its newline character included]
+    else if (end + 1 - line > SERVER_MAX_REQUEST) {
+      output_puts(&client->output, ERROR_MSG);
+    }
+    else {
+      helper_run(database, client, line);
+    }
+    line = end + 1;
+  }
+  // Keep the partial request for the next read
+  client->used -= line - client->input;
+  memmove(client->input, line, client->used);
+  // If the partial request is already over-long with the newline character
+  // it still lacks, answer it now, and drop the rest of it as it arrives
+  if (client->used + 1 > SERVER_MAX_REQUEST) {
+    if (!client->is_discarding) {
+      output_puts(&client->output, ERROR_MSG);
+    }
+    client->is_discarding = 1;
+    client->used = 0;
+  }
+}
+
+/**
+ *  A helper function that writes as many of the collected responses of a
+ *  client as its socket takes.
+ *
+ *  @param client The client.
+ **/
+static void helper_write(struct ServerClient *client) {
+  ssize_t size;
+  while ((client->sent < client->output.used) && (!client->is_failed)) {
+    size = send(client->fd, client->output.buffer + client->sent,
+		client->output.used - client->sent, MSG_NOSIGNAL);
+    if (size >= 0) {
+      client->sent += size;
+    }
+    // If the socket is full, wait until it drains
+    else if (errno == EAGAIN) {
+      break;
+    }
+    else if (errno != EINTR) {
+      client->is_closing = 1;
+      client->is_failed = 1;
+    }
+  }
+  // If every response was written, reuse the buffer
+  if (client->sent == client->output.used) {
+    output_reset(&client->output);
+    client->sent = 0;
+  }
+}
+
+/**
+ *  A helper function that disconnects a client.
+ *
+ *  @param clients The list of clients.
+ *  @param client The client.
+ **/
+static void helper_close(struct ServerClient **clients,
+			 struct ServerClient *client) {
+  // Closing the socket also removes it from the epoll instance
+  close(client->fd);
+  if (client->previous != NULL) {
+    client->previous->next = client->next;
+  }
+  else {
+    *clients = client->next;
+  }
+  if (client->next != NULL) {
+    client->next->previous = client->previous;
+  }
+  output_destroy(&client->output);
+  free(client);
+}
+
+/**
+ *  A helper function that accepts every pending connection.
+ *
+ *  @param listener The listening socket.
+ *  @param epoll_fd The epoll instance.
+ *  @param clients The list of clients.
+ **/
+static void helper_accept(int listener, int epoll_fd,
+			  struct ServerClient **clients) {
+  struct epoll_event event;
+  struct ServerClient *client;
+  int fd;
+  while ((fd = accept4(listener, NULL, NULL,
+		       SOCK_NONBLOCK | SOCK_CLOEXEC)) != -1) {
+    client = malloc(sizeof(struct ServerClient));
+    if (client == NULL) {
+      perror("malloc");
+      exit(1);
+    }
+    client->fd = fd;
+    client->used = 0;
+    client->is_discarding = 0;
+    output_init_memory(&client->output);
+    client->sent = 0;
+    client->is_closing = 0;
+    client->is_failed = 0;
+    client->events = EPOLLIN;
+    client->previous = NULL;
+    client->next = *clients;
+    event.events = client->events;
+    event.data.ptr = client;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event) == -1) {
+      perror("epoll_ctl");
+      close(fd);
+      output_destroy(&client->output);
+      free(client);
+    }
+    else {
+      if (*clients != NULL) {
+	(*clients)->previous = client;
+      }
+      *clients = client;
+    }
+  }
+  if ((errno != EAGAIN) && (errno != EINTR)) {
+    perror("accept");
+  }
+}
+
+/**
+ *  A helper function that serves a client that is ready.
+ *
+ *  @param database The database.
+ *  @param epoll_fd The epoll instance.
+ *  @param clients The list of clients.
+ *  @param client The client.
+ *  @param events The events the client is ready for.
+ **/
+static void helper_serve(struct Database *database, int epoll_fd,
+			 struct ServerClient **clients,
+			 struct ServerClient *client, unsigned int events) {
+  struct epoll_event event;
+  size_t pending;
+  // Take in the requests [A hang up or error is found by the read]
+  if ((events & (EPOLLIN | EPOLLHUP | EPOLLERR)) && (!client->is_closing)) {
+    helper_read(database, client);
+  }
+  // Hand back every response collected so far in one go
+  helper_write(client);
+  pending = client->output.used - client->sent;
+  // If the client is gone, or closed its end and has every response
+  if ((client->is_failed) || ((client->is_closing) && (pending == 0))) {
+    helper_close(clients, client);
+    return;
+  }
+  // Read more requests only while responses do not pile up, and wait for
+  // room in the socket while they are pending
+  event.events = 0;
+  if ((!client->is_closing) && (pending < SERVER_MAX_PENDING)) {
+    event.events |= EPOLLIN;
+  }
+  if (pending > 0) {
+    event.events |= EPOLLOUT;
+  }
+  if (event.events != client->events) {
+    client->events = event.events;
+    event.data.ptr = client;
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, client->fd, &event) == -1) {
+      perror("epoll_ctl");
+      helper_close(clients, client);
+    }
+  }
+}
+
+/**
+ *  A helper function that opens a listening socket at a path.
+ *
+ *  @param path The path of the socket.
+ *  @return The socket, or -1 on failure.
+ **/
+static int helper_listen(const char *path) {
+  struct sockaddr_un address;
+  struct stat status;
+  int result;
+  if (strlen(path) >= sizeof(address.sun_path)) {
+    fprintf(stderr, "%s: socket path too long\n", path);
+    return -1;
+  }
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  strcpy(address.sun_path, path);
+  // Replace a socket left behind by an earlier server, but no other file
+  if ((lstat(path, &status) == 0) && (S_ISSOCK(status.st_mode))) {
+    unlink(path);
+  }
+  result = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (result == -1) {
+    perror("socket");
+    return -1;
+  }
+  if ((bind(result, (struct sockaddr *) &address, sizeof(address)) == -1) ||
+      (listen(result, SOMAXCONN) == -1)) {
+    perror(path);
+    close(result);
+    return -1;
+  }
+  return result;
+}
+
+/**
+ *  Serve the database on a Unix domain socket until SIGINT or SIGTERM.
+ *
+ *  @param database The database.
+ *  @param path The path of the socket. It is removed once stopped.
+ *  @return 0 once stopped, or -1 on failure.
+ **/
+int server_run(struct Database *database, const char *path) {
+  struct epoll_event events[SERVER_MAX_EVENTS];
+  struct epoll_event event;
+  struct sigaction action;
+  sigset_t stop_signals;
+  sigset_t former_signals;
+  struct ServerClient *clients = NULL;
+  int listener = helper_listen(path);
+  int epoll_fd;
+  int num_events;
+  int i;
+  int result = 0;
+  if (listener == -1) {
+    return -1;
+  }
+  epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  event.events = EPOLLIN;
+  // The listening socket is told apart from the clients by a NULL pointer
+  event.data.ptr = NULL;
+  if ((epoll_fd == -1) ||
+      (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listener, &event) == -1)) {
+    perror("epoll");
+    close(listener);
+    unlink(path);
+    return -1;
+  }
+  // The stop signals are only let through while waiting for events, so
+  // that none is missed between two waits
+  sigemptyset(&stop_signals);
+  sigaddset(&stop_signals, SIGINT);
+  sigaddset(&stop_signals, SIGTERM);
+  sigprocmask(SIG_BLOCK, &stop_signals, &former_signals);
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = helper_stop;
+  sigaction(SIGINT, &action, NULL);
+  sigaction(SIGTERM, &action, NULL);
+  is_stopping = 0;
+  while (!is_stopping) {
+    num_events = epoll_pwait(epoll_fd, events, SERVER_MAX_EVENTS, -1,
+			     &former_signals);
+    if ((num_events == -1) && (errno != EINTR)) {
+      perror("epoll_wait");
+      result = -1;
+      break;
+    }
+    for (i = 0; i < num_events; i++) {
+      if (events[i].data.ptr == NULL) {
+	helper_accept(listener, epoll_fd, &clients);
+      }
+      else {
+	helper_serve(database, epoll_fd, &clients, events[i].data.ptr,
+		     events[i].events);
+      }
+    }
+  }
+  // Disconnect every client that is left
+  while (clients != NULL) {
+    helper_close(&clients, clients);
+  }
+  close(epoll_fd);
+  close(listener);
+  unlink(path);
+  sigprocmask(SIG_SETMASK, &former_signals, NULL);
+  return result;
+}
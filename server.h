@@ -0,0 +1,35 @@
+/**
+ *  Unix domain socket server for the image database.
+ **/
+
+#ifndef _SERVER_H
+#define _SERVER_H
+
+#include "database.h"
+
+// Number of bytes read from a client per read system call
+#define SERVER_READ_SIZE	(1 << 16)
+// Longest request a client may send, newline character included. A longer
+// one is answered with the error message [Standard input takes lines of any
+// length, but a client must not make the server hold one]
+#define SERVER_MAX_REQUEST	(1 << 16)
+// Number of response bytes held for a client before its requests stop
+// being read, until it catches up
+#define SERVER_MAX_PENDING	(1 << 20)
+// Maximum number of events handled per epoll_wait call
+#define SERVER_MAX_EVENTS	64
+
+
+/*
+ * Serve the INSERT, DELETE, QUERY, PRINT, COUNT, STATS and FREEZE 
+ * OPERATIONS of any number of clients on a Unix domain socket at the 
+ * given path, until SIGINT or SIGTERM. QUERY and PRINT OPERATIONS may be 
+ * paged by an offset and a limit, as on standard input. Each client may
+ * send many requests without waiting for their responses; they are run in
+ * order, and their responses are the bytes standard output would show. An
+ * invalid request is answered with the error message.
+ * Return 0 once stopped, or -1 on failure.
+ */
+int server_run(struct Database *, const char *);
+
+#endif /* _SERVER_H */
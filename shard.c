@@ -0,0 +1,792 @@
+/**
+ *  Sharded image database. Images are partitioned by ranges of Attribute 1
+ *  (A1), so each shard is an independent database with its own tree, arena
+ *  and intern table, and the shards can insert in parallel. The thread
+ *  reading input only parses it and hands each INSERT OPERATION to the
+ *  ingest thread of its shard, through a lock-free single-producer,
+ *  single-consumer queue. Since the shards hold consecutive ranges of A1,
+ *  a PRINT OPERATION is the output of each shard in turn, and a QUERY
+ *  OPERATION of one A1 value only reads one shard. Every other operation
+ *  first waits for the queues of the shards it reads to drain, so results
+ *  are those of running the operations one at a time.
+ **/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "shard.h"
+
+// Marks the end of the records of a queue before its buffer wraps around
+#define SHARD_WRAP	UINT32_MAX
+
+
+/**
+ *  A helper function that finds the shard holding an A1 value.
+ *
+ *  @param shards The shards.
+ *  @param value The A1 value.
+ *  @return The index of the shard: the number of bounds not after the value.
+ **/
+static int helper_shard_of(const struct Shards *shards, const char *value) {
+  int low = 0;
+  int high = shards->is_split ? (shards->num_shards - 1) : 0;
+  int middle;
+  // Binary search for the first bound after the value
+  while (low < high) {
+    middle = (low + high) / 2;
+    if (strcmp(shards->bounds[middle], value) <= 0) {
+      low = middle + 1;
+    }
+    else {
+      high = middle;
+    }
+  }
+  return low;
+}
+
+/**
+ *  A helper function that checks if the queue of a shard is empty, so
+ *  every image queued so far is in its database.
+ *
+ *  @param shard The shard.
+ *  @return 1 if the queue is empty; 0 otherwise.
+ **/
+static int helper_is_empty(const struct Shard *shard) {
+  return __atomic_load_n(&shard->queue.head, __ATOMIC_SEQ_CST) ==
+    __atomic_load_n(&shard->queue.tail, __ATOMIC_SEQ_CST);
+}
+
+/**
+ *  A helper function that returns the number of free bytes of the queue of
+ *  a shard.
+ *
+ *  @param shard The shard.
+ *  @return The number of bytes the producer may still append.
+ **/
+static size_t helper_room(const struct Shard *shard) {
+  return SHARD_QUEUE_SIZE - 
+    (__atomic_load_n(&shard->queue.tail, __ATOMIC_SEQ_CST) -
+     __atomic_load_n(&shard->queue.head, __ATOMIC_SEQ_CST));
+}
+
+/**
+ *  A helper function that waits until the ingest thread of a shard has
+ *  inserted every queued image. Its database can then be used by the
+ *  calling thread [And any other thread reading it] until the next image
+ *  is queued.
+ *
+ *  @param shard The shard.
+ **/
+static void helper_drain(struct Shard *shard) {
+  if (helper_is_empty(shard)) {
+    return;
+  }
+  // Sleep until the ingest thread empties the queue [It checks for 
+  // draining threads after releasing each record, so one of the two sees
+  // the other]
+  pthread_mutex_lock(&shard->lock);
+  __atomic_add_fetch(&shard->num_draining, 1, __ATOMIC_SEQ_CST);
+  while (!helper_is_empty(shard)) {
+    pthread_cond_wait(&shard->is_ready, &shard->lock);
+  }
+  __atomic_sub_fetch(&shard->num_draining, 1, __ATOMIC_SEQ_CST);
+  pthread_mutex_unlock(&shard->lock);
+}
+
+/**
+ *  A helper function that appends an INSERT OPERATION to the queue of a
+ *  shard, waiting for room if it is full, and wakes its ingest thread.
+ *
+ *  @param shard The shard.
+ *  @param values The tokens of the INSERT OPERATION.
+ *  @return 0 on success; -1 if the image is too large to be queued.
+ **/
+static int helper_push(struct Shard *shard, char **values) {
+  struct ShardQueue *queue = &shard->queue;
+  size_t tail = queue->tail;
+  size_t offset = tail & (SHARD_QUEUE_SIZE - 1);
+  size_t size = 0;
+  size_t length;
+  size_t needed;
+  char *cur;
+  int i;
+  for (i = 1; i <= NUM_LEVELS; i++) {
+    size += strlen(values[i]) + 1;
+  }
+  // The record is padded to 8 bytes, so the end of the buffer always has
+  // room for the wrap marker
+  needed = (sizeof(uint32_t) + size + 7) & ~((size_t) 7);
+  if (needed > SHARD_QUEUE_SIZE / 2) {
+    return -1;
+  }
+  // If the record does not fit before the end of the buffer, it starts
+  // over at the beginning
+  if (needed > SHARD_QUEUE_SIZE - offset) {
+    needed += SHARD_QUEUE_SIZE - offset;
+  }
+  // Sleep until the ingest thread makes room [It checks for a waiting 
+  // producer after releasing each record, as for draining threads]
+  if (helper_room(shard) < needed) {
+    pthread_mutex_lock(&shard->lock);
+    __atomic_store_n(&shard->num_needed, needed, __ATOMIC_SEQ_CST);
+    while (helper_room(shard) < needed) {
+      pthread_cond_wait(&shard->is_ready, &shard->lock);
+    }
+    __atomic_store_n(&shard->num_needed, 0, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&shard->lock);
+  }
+  if (needed > ((sizeof(uint32_t) + size + 7) & ~((size_t) 7))) {
+    *(uint32_t *) (queue->buffer + offset) = SHARD_WRAP;
+    offset = 0;
+  }
+  *(uint32_t *) (queue->buffer + offset) = size;
+  cur = queue->buffer + offset + sizeof(uint32_t);
+  for (i = 1; i <= NUM_LEVELS; i++) {
+    length = strlen(values[i]) + 1;
+    memcpy(cur, values[i], length);
+    cur += length;
+  }
+  // Publish the record, then wake the ingest thread if it is waiting [It
+  // checks the queue again after announcing that it waits, so one of the
+  // two sees the other]
+  __atomic_store_n(&queue->tail, tail + needed, __ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&shard->is_waiting, __ATOMIC_SEQ_CST)) {
+    pthread_mutex_lock(&shard->lock);
+    pthread_cond_broadcast(&shard->is_ready);
+    pthread_mutex_unlock(&shard->lock);
+  }
+  return 0;
+}
+
+/**
+ *  A helper function that takes the next INSERT OPERATION off the queue of
+ *  a shard, without releasing its record.
+ *
+ *  @param queue The queue.
+ *  @param values Set to the values of the image, in the record.
+ *  @param next Set to the position after the record.
+ *  @return 1 if an INSERT OPERATION was taken; 0 if the queue is empty.
+ **/
+static int helper_pop(struct ShardQueue *queue, char **values,
+		      size_t *next) {
+  size_t head = queue->head;
+  size_t offset = head & (SHARD_QUEUE_SIZE - 1);
+  uint32_t size;
+  char *cur;
+  int i;
+  if (head == __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE)) {
+    return 0;
+  }
+  size = *(uint32_t *) (queue->buffer + offset);
+  // Skip the wrap marker [A record always follows it]
+  if (size == SHARD_WRAP) {
+    head += SHARD_QUEUE_SIZE - offset;
+    offset = 0;
+    size = *(uint32_t *) queue->buffer;
+  }
+  cur = queue->buffer + offset + sizeof(uint32_t);
+  for (i = 1; i <= NUM_LEVELS; i++) {
+    values[i] = cur;
+    cur += strlen(cur) + 1;
+  }
+  *next = head + ((sizeof(uint32_t) + size + 7) & ~((size_t) 7));
+  return 1;
+}
+
+/**
+ *  A helper function run by the ingest thread of each shard. It inserts
+ *  the images of the queue into the database of the shard, and sleeps
+ *  while the queue is empty.
+ *
+ *  @param argument The shard.
+ *  @return NULL.
+ **/
+static void *helper_ingest(void *argument) {
+  struct Shard *shard = argument;
+  // char* array to hold the tokens of an INSERT OPERATION
+  char *values[INPUT_ARG_MAX_NUM];
+  char symbol[2] = {INSERT, '\0'};
+  size_t next;
+  size_t needed;
+  int is_done = 0;
+  values[0] = symbol;
+  while (!is_done) {
+    if (helper_pop(&shard->queue, values, &next)) {
+      database_insert(&shard->database, values);
+      // Only now is the record released, so a drained queue means every
+      // image is in the database
+      __atomic_store_n(&shard->queue.head, next, __ATOMIC_SEQ_CST);
+      // Wake every thread waiting for the queue to drain, once it is 
+      // empty, and the producer waiting for room, once there is enough
+      needed = __atomic_load_n(&shard->num_needed, __ATOMIC_SEQ_CST);
+      if (((__atomic_load_n(&shard->num_draining, __ATOMIC_SEQ_CST) > 0) &&
+	   (helper_is_empty(shard))) ||
+	  ((needed > 0) && (helper_room(shard) >= needed))) {
+	pthread_mutex_lock(&shard->lock);
+	pthread_cond_broadcast(&shard->is_ready);
+	pthread_mutex_unlock(&shard->lock);
+      }
+    }
+    else {
+      pthread_mutex_lock(&shard->lock);
+      __atomic_store_n(&shard->is_waiting, 1, __ATOMIC_SEQ_CST);
+      while ((helper_is_empty(shard)) && (!shard->is_stopping)) {
+	pthread_cond_wait(&shard->is_ready, &shard->lock);
+      }
+      __atomic_store_n(&shard->is_waiting, 0, __ATOMIC_SEQ_CST);
+      is_done = (shard->is_stopping) && (helper_is_empty(shard));
+      pthread_mutex_unlock(&shard->lock);
+    }
+  }
+  return NULL;
+}
+
+/**
+ *  A helper function that hands an INSERT OPERATION to a shard. An image
+ *  too large for the queue is inserted by the calling thread, once the
+ *  ingest thread is idle.
+ *
+ *  @param shard The shard.
+ *  @param values The tokens of the INSERT OPERATION.
+ **/
+static void helper_queue(struct Shard *shard, char **values) {
+  if (helper_push(shard, values) == -1) {
+    helper_drain(shard);
+    database_insert(&shard->database, values);
+  }
+}
+
+/**
+ *  A helper function that compares interned A1 values [See qsort].
+ *
+ *  @param a A pointer to the first value.
+ *  @param b A pointer to the second value.
+ *  @return The order of the values, as strcmp.
+ **/
+static int helper_compare(const void *a, const void *b) {
+  return strcmp((*(const struct InternedString * const *) a)->text,
+		(*(const struct InternedString * const *) b)->text);
+}
+
+/**
+ *  A helper function that splits the range of A1 evenly over the shards,
+ *  at the A1 values of the images inserted so far, which are all in the
+ *  first shard. The images of the other ranges are then moved to their
+ *  shards [And counted as INSERT and DELETE OPERATIONS].
+ *
+ *  @param shards The shards.
+ **/
+static void helper_split(struct Shards *shards) {
+  struct Shard *first = &shards->shards[0];
+  struct Tree *tree = &first->database.tree;
+  const struct NodeArray *children;
+  struct TreeCursor cursor;
+  struct TreeImage image;
+  // A1 value of each run of images, in sorted order, and the number of
+  // images of each run
+  const struct InternedString **runs;
+  size_t *counts;
+  size_t num_runs = 0;
+  size_t num_images;
+  size_t seen = 0;
+  size_t moved;
+  size_t i;
+  // char* array to hold the tokens of an operation
+  char *values[INPUT_ARG_MAX_NUM];
+  char symbol[2] = {INSERT, '\0'};
+  int shard;
+  int level;
+  helper_drain(first);
+  // Thaw a frozen first shard, as its next insert would
+  if (first->database.snapshot.data != NULL) {
+    snapshot_thaw(&first->database.snapshot, tree);
+    snapshot_close(&first->database.snapshot);
+  }
+  num_images = tree->num_images;
+  if (num_images == 0) {
+    shards->num_inserts = 0;
+    return;
+  }
+  runs = malloc(sizeof(const struct InternedString *) * num_images);
+  counts = malloc(sizeof(size_t) * num_images);
+  if ((runs == NULL) || (counts == NULL)) {
+    perror("malloc");
+    exit(1);
+  }
+  // If the first depth level holds A1, each of its nodes is a run
+  if (tree->order[0] == 0) {
+    children = tree->root.children;
+    for (i = 0; i < children->count; i++) {
+      runs[num_runs] = children->nodes[i]->value;
+      counts[num_runs++] = children->nodes[i]->num_images;
+    }
+  }
+  // Otherwise [A planned tree] each image is a run, sorted by A1
+  else {
+    cursor_open(&cursor, tree, NULL);
+    while (cursor_next(&cursor, &image)) {
+      runs[num_runs] = image.values[0];
+      counts[num_runs++] = 1;
+    }
+    cursor_close(&cursor);
+    qsort(runs, num_runs, sizeof(const struct InternedString *),
+	  helper_compare);
+  }
+  // Split at the A1 values of evenly spaced images
+  i = 0;
+  for (shard = 1; shard < shards->num_shards; shard++) {
+    while (seen + counts[i] <= shard * num_images / shards->num_shards) {
+      seen += counts[i++];
+    }
+    shards->bounds[shard - 1] = strdup(runs[i]->text);
+    if (shards->bounds[shard - 1] == NULL) {
+      perror("strdup");
+      exit(1);
+    }
+  }
+  shards->is_split = 1;
+  // The runs of the other shards come last, since they are sorted
+  for (moved = 0; (moved < num_runs) &&
+	 (helper_shard_of(shards, runs[moved]->text) == 0); moved++) {
+  }
+  // Queue the images of the other shards for them
+  values[0] = symbol;
+  cursor_open(&cursor, tree, NULL);
+  while (cursor_next(&cursor, &image)) {
+    shard = helper_shard_of(shards, image.values[0]->text);
+    if (shard != 0) {
+      for (level = 1; level <= NUM_LEVELS; level++) {
+	values[level] = (char *) image.values[level - 1]->text;
+      }
+      helper_queue(&shards->shards[shard], values);
+    }
+  }
+  cursor_close(&cursor);
+  // Then delete them from the first shard, one A1 value at a time
+  symbol[0] = DELETE;
+  for (level = 2; level <= NUM_LEVELS; level++) {
+    values[level] = MATCH_ANY;
+  }
+  for (i = moved; i < num_runs; i++) {
+    // The runs of one A1 value share its interned string
+    if ((i > moved) && (runs[i] == runs[i - 1])) {
+      continue;
+    }
+    // The delete releases the interned string, so it works on a copy
+    values[1] = strdup(runs[i]->text);
+    if (values[1] == NULL) {
+      perror("strdup");
+      exit(1);
+    }
+    database_delete(&first->database, values);
+    free(values[1]);
+  }
+  free(counts);
+  free(runs);
+}
+
+/**
+ *  A helper function that finds the shards whose range of A1 the A1 value
+ *  of a QUERY [OR] DELETE OPERATION may match.
+ *
+ *  @param shards The shards.
+ *  @param value The A1 value [See match_parse].
+ *  @param first Set to the first shard.
+ *  @param last Set to the last shard.
+ **/
+static void helper_shard_range(const struct Shards *shards, const char *value,
+			       int *first, int *last) {
+  struct AttributeMatch match;
+  match_parse(&match, value);
+  *first = 0;
+  *last = shards->is_split ? (shards->num_shards - 1) : 0;
+  // Skip the shards whose values all sort before [OR] after the match
+  while ((*first < *last) &&
+	 (match_is_below(&match, shards->bounds[*first]))) {
+    (*first)++;
+  }
+  while ((*last > *first) &&
+	 (match_is_beyond(&match, shards->bounds[*last - 1]))) {
+    (*last)--;
+  }
+}
+
+/**
+ *  Start the shards.
+ *
+ *  @param shards The shards.
+ *  @param num_shards The number of shards.
+ **/
+void shards_init(struct Shards *shards, int num_shards) {
+  int i;
+  memset(shards, 0, sizeof(struct Shards));
+  shards->num_shards = (num_shards < SHARD_MAX) ? num_shards : SHARD_MAX;
+  shards->shards = calloc(shards->num_shards, sizeof(struct Shard));
+  if (shards->shards == NULL) {
+    perror("calloc");
+    exit(1);
+  }
+  for (i = 0; i < shards->num_shards; i++) {
+    struct Shard *shard = &shards->shards[i];
+    database_init(&shard->database);
+    if (posix_memalign((void **) &shard->queue.buffer, 64,
+		       SHARD_QUEUE_SIZE) != 0) {
+      perror("posix_memalign");
+      exit(1);
+    }
+    pthread_mutex_init(&shard->lock, NULL);
+    pthread_cond_init(&shard->is_ready, NULL);
+    if (pthread_create(&shard->thread, NULL, helper_ingest, shard) != 0) {
+      perror("pthread_create");
+      exit(1);
+    }
+  }
+}
+
+/**
+ *  Stop the ingest threads, once their queues are drained, and release the
+ *  shards.
+ *
+ *  @param shards The shards.
+ **/
+void shards_destroy(struct Shards *shards) {
+  int i;
+  for (i = 0; i < shards->num_shards; i++) {
+    struct Shard *shard = &shards->shards[i];
+    pthread_mutex_lock(&shard->lock);
+    shard->is_stopping = 1;
+    pthread_cond_signal(&shard->is_ready);
+    pthread_mutex_unlock(&shard->lock);
+    pthread_join(shard->thread, NULL);
+    pthread_cond_destroy(&shard->is_ready);
+    pthread_mutex_destroy(&shard->lock);
+    free(shard->queue.buffer);
+    database_destroy(&shard->database);
+  }
+  for (i = 0; i < shards->num_shards - 1; i++) {
+    free(shards->bounds[i]);
+  }
+  free(shards->shards);
+  memset(shards, 0, sizeof(struct Shards));
+}
+
+/**
+ *  Queue an image for its shard.
+ *
+ *  @param shards The shards.
+ *  @param values The tokens of the INSERT OPERATION.
+ **/
+void shards_insert(struct Shards *shards, char **values) {
+  // Split the range of A1 once enough images show how A1 is spread
+  if ((!shards->is_split) && (shards->num_shards > 1) &&
+      (++shards->num_inserts > SHARD_SAMPLE_SIZE)) {
+    helper_split(shards);
+  }
+  helper_queue(&shards->shards[helper_shard_of(shards, values[1])], values);
+}
+
+/**
+ *  Wait for the queued images of every shard.
+ *
+ *  @param shards The shards.
+ **/
+void shards_drain(struct Shards *shards) {
+  int i;
+  for (i = 0; i < shards->num_shards; i++) {
+    helper_drain(&shards->shards[i]);
+  }
+}
+
+/**
+ *  Delete an image, or a branch of images, from the shards it may be in.
+ *
+ *  @param shards The shards.
+ *  @param values The tokens of the DELETE OPERATION.
+ *  @return The number of images deleted, or -1 if the operation is
+ *  invalid.
+ **/
+long shards_delete(struct Shards *shards, char **values) {
+  long result = 0;
+  long deleted;
+  int first;
+  int last;
+  // A * deletes from every shard; anything else names one
+  if (strcmp(values[1], MATCH_ANY) == 0) {
+    first = 0;
+    last = shards->num_shards - 1;
+  }
+  else {
+    first = helper_shard_of(shards, values[1]);
+    last = first;
+  }
+  for ( ; first <= last; first++) {
+    helper_drain(&shards->shards[first]);
+    deleted = database_delete(&shards->shards[first].database, values);
+    // Every shard finds the same values invalid
+    if (deleted == -1) {
+      return -1;
+    }
+    result += deleted;
+  }
+  return result;
+}
+
+/**
+ *  Print all files with matching attribute values, from the shards whose
+ *  range of A1 the query matches. The filenames of a shard all sort before
+ *  those of the next one, so their lines are joined in order.
+ *
+ *  @param shards The shards.
+ *  @param values The tokens of the QUERY OPERATION.
+ *  @param output The sink to print to.
+ **/
+void shards_search(const struct Shards *shards, char **values,
+		   struct Output *output) {
+  // Collects the result of each shard
+  struct Output result;
+  int num_printed = 0;
+  int first;
+  int last;
+  helper_shard_range(shards, values[1], &first, &last);
+  // If only one shard can match, it prints straight to the sink
+  if (first == last) {
+    helper_drain(&shards->shards[first]);
+    database_search(&shards->shards[first].database, values, output);
+    return;
+  }
+  output_init_memory(&result);
+  for ( ; first <= last; first++) {
+    helper_drain(&shards->shards[first]);
+    output_reset(&result);
+    database_search(&shards->shards[first].database, values, &result);
+    // Join the lines of the shards that found filenames
+    if ((result.used != strlen("(NULL)\n")) ||
+	(memcmp(result.buffer, "(NULL)\n", result.used) != 0)) {
+      if (num_printed > 0) {
+	output_putc(output, ' ');
+      }
+      output_append(output, result.buffer, result.used - 1);
+      num_printed++;
+    }
+  }
+  output_destroy(&result);
+  output_puts(output, (num_printed > 0) ? "\n" : "(NULL)\n");
+}
+
+/**
+ *  Print all images of the shards, one shard after the other.
+ *
+ *  @param shards The shards.
+ *  @param output The sink to print to.
+ **/
+void shards_print(struct Shards *shards, struct Output *output) {
+  int num_printed = 0;
+  int i;
+  for (i = 0; i < shards->num_shards; i++) {
+    helper_drain(&shards->shards[i]);
+    if (database_count(&shards->shards[i].database) > 0) {
+      database_print(&shards->shards[i].database, output);
+      num_printed++;
+    }
+  }
+  // If database is empty
+  if (num_printed == 0) {
+    // Output NULL
+    output_puts(output, "(NULL)\n");
+  }
+}
+
+/**
+ *  Print one page of the files with matching attribute values, from the 
+ *  shards whose range of A1 the query matches. The shards whose matching
+ *  images all come before the page are skipped by their counts.
+ *
+ *  @param shards The shards.
+ *  @param values The tokens of the QUERY OPERATION.
+ *  @param offset The number of matching files before the page.
+ *  @param limit The largest number of files of the page.
+ *  @param output The sink to print to.
+ **/
+void shards_search_page(const struct Shards *shards, char **values,
+			size_t offset, size_t limit, struct Output *output) {
+  // Collects the page of each shard
+  struct Output result;
+  size_t num_printed = 0;
+  size_t count;
+  int first;
+  int last;
+  helper_shard_range(shards, values[1], &first, &last);
+  output_init_memory(&result);
+  for ( ; (first <= last) && (num_printed < limit); first++) {
+    helper_drain(&shards->shards[first]);
+    count = database_count_matches(&shards->shards[first].database, values);
+    if (count <= offset) {
+      offset -= count;
+      continue;
+    }
+    output_reset(&result);
+    database_search_page(&shards->shards[first].database, values, offset,
+			 limit - num_printed, &result);
+    // Join the lines of the shards
+    if (num_printed > 0) {
+      output_putc(output, ' ');
+    }
+    output_append(output, result.buffer, result.used - 1);
+    num_printed += (count - offset < limit - num_printed) ? 
+      (count - offset) : (limit - num_printed);
+    offset = 0;
+  }
+  output_destroy(&result);
+  output_puts(output, (num_printed > 0) ? "\n" : "(NULL)\n");
+}
+
+/**
+ *  Print one page of the images of the shards, one shard after the other.
+ *
+ *  @param shards The shards.
+ *  @param offset The number of images before the page.
+ *  @param limit The largest number of images of the page.
+ *  @param output The sink to print to.
+ **/
+void shards_print_page(struct Shards *shards, size_t offset, size_t limit,
+		       struct Output *output) {
+  size_t num_printed = 0;
+  size_t count;
+  int i;
+  for (i = 0; (i < shards->num_shards) && (num_printed < limit); i++) {
+    helper_drain(&shards->shards[i]);
+    count = database_count(&shards->shards[i].database);
+    if (count <= offset) {
+      offset -= count;
+      continue;
+    }
+    database_print_page(&shards->shards[i].database, offset, 
+			limit - num_printed, output);
+    num_printed += (count - offset < limit - num_printed) ? 
+      (count - offset) : (limit - num_printed);
+    offset = 0;
+  }
+  // If the page is past the last image
+  if (num_printed == 0) {
+    output_puts(output, "(NULL)\n");
+  }
+}
+
+/**
+ *  Return the number of images with matching attribute values of the 
+ *  shards whose range of A1 the query matches.
+ *
+ *  @param shards The shards.
+ *  @param values The tokens of the QUERY OPERATION.
+ *  @return The number of matching images.
+ **/
+size_t shards_count(const struct Shards *shards, char **values) {
+  size_t result = 0;
+  int first;
+  int last;
+  helper_shard_range(shards, values[1], &first, &last);
+  for ( ; first <= last; first++) {
+    helper_drain(&shards->shards[first]);
+    result += database_count_matches(&shards->shards[first].database, 
+				     values);
+  }
+  return result;
+}
+
+/**
+ *  Print the statistics of the shards: their operations, their memory and
+ *  the shape of their trees, added up, and their numbers of images.
+ *
+ *  @param shards The shards.
+ *  @param output The sink to print to.
+ **/
+void shards_stats(const struct Shards *shards, struct Output *output) {
+  struct StatsShape total;
+  struct StatsShape shape;
+  struct Arena arena;
+  const struct Arena *cur;
+  char buf[64];
+  int size;
+  int depth_level;
+  int i;
+  memset(&total, 0, sizeof(struct StatsShape));
+  memset(&arena, 0, sizeof(struct Arena));
+  for (i = 0; i < shards->num_shards; i++) {
+    helper_drain(&shards->shards[i]);
+    database_shape(&shards->shards[i].database, &shape);
+    // The first depth levels of the shards share one root
+    total.num_nodes[0] += shape.num_nodes[0];
+    total.max_fanout[0] += shape.max_fanout[0];
+    for (depth_level = 1; depth_level < NUM_LEVELS; depth_level++) {
+      total.num_nodes[depth_level] += shape.num_nodes[depth_level];
+      if (shape.max_fanout[depth_level] > total.max_fanout[depth_level]) {
+	total.max_fanout[depth_level] = shape.max_fanout[depth_level];
+      }
+    }
+    if (i == 0) {
+      memcpy(total.order, shape.order, sizeof(total.order));
+    }
+    cur = &shards->shards[i].database.tree.arena;
+    arena.num_blocks += cur->num_blocks;
+    arena.num_allocations += cur->num_allocations;
+    arena.bytes_reserved += cur->bytes_reserved;
+    arena.bytes_used += cur->bytes_used;
+    arena.bytes_free += cur->bytes_free;
+  }
+  stats_report(output, &total, &arena);
+  for (i = 0; i < shards->num_shards; i++) {
+    size = snprintf(buf, sizeof(buf), "Shard %d images: %zu\n", i + 1,
+		    database_count(&shards->shards[i].database));
+    if (size > 0) {
+      output_append(output, buf, ((size_t) size < sizeof(buf)) ?
+		    (size_t) size : (sizeof(buf) - 1));
+    }
+  }
+}
+
+/**
+ *  Freeze every shard.
+ *
+ *  @param shards The shards.
+ *  @return 0 on success; -1 if a shard is too large to freeze.
+ **/
+int shards_freeze(struct Shards *shards) {
+  int result = 0;
+  int i;
+  for (i = 0; i < shards->num_shards; i++) {
+    helper_drain(&shards->shards[i]);
+    if (database_freeze(&shards->shards[i].database) != 0) {
+      result = -1;
+    }
+  }
+  return result;
+}
+
+/**
+ *  Plan the depth levels of every shard from now on.
+ *
+ *  @param shards The shards.
+ **/
+void shards_plan(struct Shards *shards) {
+  int i;
+  for (i = 0; i < shards->num_shards; i++) {
+    helper_drain(&shards->shards[i]);
+    database_plan(&shards->shards[i].database);
+  }
+}
+
+/**
+ *  Set the false positive rate of the query filter of every shard.
+ *
+ *  @param shards The shards.
+ *  @param rate The false positive rate [0 turns the filters off].
+ **/
+void shards_filter(struct Shards *shards, double rate) {
+  int i;
+  for (i = 0; i < shards->num_shards; i++) {
+    helper_drain(&shards->shards[i]);
+    database_filter(&shards->shards[i].database, rate);
+  }
+}
@@ -0,0 +1,129 @@
+/**
+ *  Sharded image database: images are partitioned by ranges of Attribute 1
+ *  (A1) over independent databases, each fed by its own ingest thread.
+ **/
+
+#ifndef _SHARD_H
+#define _SHARD_H
+
+#include <pthread.h>
+#include <stddef.h>
+
+#include "database.h"
+#include "output.h"
+
+// Size of the input queue of a shard, in bytes (a power of two)
+#define SHARD_QUEUE_SIZE	(1 << 20)
+// Number of images inserted before the ranges of A1 are split
+#define SHARD_SAMPLE_SIZE	16384
+// Largest number of shards
+#define SHARD_MAX	64
+
+
+// Single-producer, single-consumer queue of INSERT OPERATIONS. Each record
+// is its length and the values of the image, each NUL-terminated, padded
+// to 8 bytes; a record that does not fit before the end of the buffer
+// starts over at its beginning. Positions only grow; the producer and the
+// consumer each own one, on its own cache line
+struct ShardQueue {
+	char *buffer;
+	size_t head __attribute__((aligned(64)));
+	size_t tail __attribute__((aligned(64)));
+};
+
+struct Shard {
+	// Holds the images of one range of A1
+	struct Database database;
+	struct ShardQueue queue;
+	// The ingest thread, which sleeps on the condition while the queue is
+	// empty. Threads draining the queue sleep on it until the queue is
+	// empty, and the producer until the queue has room [The ingest thread
+	// never sleeps while they do, and wakes them all at once]
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t is_ready;
+	int is_waiting;
+	// Number of threads waiting for the queue to drain
+	int num_draining;
+	// Number of free bytes the producer waits for [0 unless it waits]
+	size_t num_needed;
+	int is_stopping;
+};
+
+struct Shards {
+	struct Shard *shards;
+	int num_shards;
+	// A1 value at which each shard but the first starts, in order [Until
+	// they are split, every image goes to the first shard]
+	char *bounds[SHARD_MAX - 1];
+	int is_split;
+	size_t num_inserts;
+};
+
+/*
+ * Start the given number of shards [At most SHARD_MAX], each with its
+ * ingest thread.
+ */
+void shards_init(struct Shards *, int);
+
+/*
+ * Stop the ingest threads and release the shards.
+ */
+void shards_destroy(struct Shards *);
+
+/*
+ * INSERT OPERATION: Queue the image for the ingest thread of its shard.
+ * Once SHARD_SAMPLE_SIZE images are inserted, the ranges of A1 are split
+ * evenly over the shards, and the images already inserted are moved.
+ */
+void shards_insert(struct Shards *, char **);
+
+/*
+ * Wait until the ingest thread of every shard has inserted its queued 
+ * images. Until the next INSERT OPERATION, any number of threads may then
+ * read the shards.
+ */
+void shards_drain(struct Shards *);
+
+/*
+ * DELETE, QUERY and PRINT OPERATIONS. Each waits for the queued images of
+ * the shards it reads, and only reads the shards whose range of A1 the
+ * operation matches. Same arguments and results as the database functions.
+ */
+long shards_delete(struct Shards *, char **);
+void shards_search(const struct Shards *, char **, struct Output *);
+void shards_print(struct Shards *, struct Output *);
+
+/*
+ * QUERY and PRINT OPERATIONS of one page, and the number of images 
+ * matching a QUERY OPERATION, over the shards as above. Shards whose 
+ * images all come before the page are skipped by their counts.
+ */
+void shards_search_page(const struct Shards *, char **, size_t, size_t,
+			struct Output *);
+void shards_print_page(struct Shards *, size_t, size_t, struct Output *);
+size_t shards_count(const struct Shards *, char **);
+
+/*
+ * STATS OPERATION over every shard, followed by the number of images of
+ * each shard.
+ */
+void shards_stats(const struct Shards *, struct Output *);
+
+/*
+ * FREEZE OPERATION on every shard. Return 0 on success, -1 on failure.
+ */
+int shards_freeze(struct Shards *);
+
+/*
+ * Plan the depth levels of every shard [See database_plan].
+ */
+void shards_plan(struct Shards *);
+
+/*
+ * Set the false positive rate of the query filter of every shard [See
+ * database_filter].
+ */
+void shards_filter(struct Shards *, double);
+
+#endif /* _SHARD_H */
@@ -0,0 +1,962 @@
+/**
+ *  Binary snapshots of the image database. A snapshot stores the tree level
+ *  by level, with offsets instead of pointers, so a snapshot file can be 
+ *  mapped into memory and searched or printed without being deserialized.
+ **/
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "snapshot.h"
+#include "utils.h"
+
+// Checksum parameters (FNV-1a, applied to 64-bit words)
+#define CHECKSUM_OFFSET_BASIS	14695981039346656037ULL
+#define CHECKSUM_PRIME	1099511628211ULL
+
+/**
+ *  A helper function that rounds a size up to a multiple of 8 bytes.
+ *
+ *  @param size The size to round up.
+ *  @return The aligned size.
+ **/
+static uint64_t helper_align(uint64_t size) {
+  return (size + 7) & ~(uint64_t) 7;
+}
+
+/**
+ *  A helper function that computes the checksum of a snapshot, covering
+ *  everything after the header.
+ *
+ *  @param data The snapshot image. Its size is a multiple of 8 bytes.
+ *  @param size The size of the snapshot image.
+ *  @return The checksum.
+ **/
+static uint64_t helper_checksum(const char *data, size_t size) {
+  uint64_t hash = CHECKSUM_OFFSET_BASIS;
+  const uint64_t *word = (const uint64_t *) (data + 
+					     sizeof(struct SnapshotHeader));
+  const uint64_t *end = (const uint64_t *) (data + size);
+  for ( ; word < end; word++) {
+    hash = (hash ^ *word) * CHECKSUM_PRIME;
+    hash ^= hash >> 32;
+  }
+  return hash;
+}
+
+/**
+ *  A helper function that finds the slot of an interned string in a table
+ *  mapping strings to their offsets in the string table.
+ *
+ *  @param keys The strings of the table.
+ *  @param mask The number of slots of the table, minus 1.
+ *  @param value The string to look for.
+ *  @return The index of the slot holding the string, or of the empty slot
+ *  where it belongs.
+ **/
+static size_t helper_find_offset(const struct InternedString **keys, 
+				 size_t mask, 
+				 const struct InternedString *value) {
+  size_t slot = value->hash & mask;
+  // Interned strings are compared by address
+  while ((keys[slot] != NULL) && (keys[slot] != value)) {
+    slot = (slot + 1) & mask;
+  }
+  return slot;
+}
+
+/**
+ *  A helper function that checks that an array of a snapshot image lies 
+ *  within the image, at an aligned offset. Sizes are compared, not offsets
+ *  added, so huge offsets cannot wrap around.
+ *
+ *  @param offset The offset of the array.
+ *  @param array_size The size of the array.
+ *  @param size The size of the snapshot image.
+ *  @return 1 if the array lies within the image; 0 otherwise.
+ **/
+static int helper_fits(uint64_t offset, uint64_t array_size, size_t size) {
+  return (offset % 8 == 0) && (offset >= sizeof(struct SnapshotHeader)) && 
+    (offset <= size) && (array_size <= size - offset);
+}
+
+/**
+ *  A helper function that checks the depth levels of a snapshot image: 
+ *  every string offset must start within the string table [Whose last 
+ *  string is terminated], and the child nodes of the nodes of each depth
+ *  level must be consecutive, non-empty ranges that together cover the 
+ *  next depth level exactly, so every walk stays within its arrays.
+ *
+ *  @param snapshot The snapshot, whose fields point at the image.
+ *  @return 0 if the depth levels are valid; -1 otherwise.
+ **/
+static int helper_check_levels(const struct Snapshot *snapshot) {
+  const struct SnapshotHeader *header = snapshot->header;
+  const uint32_t *children;
+  uint64_t i;
+  int level;
+  for (level = 0; level < SNAPSHOT_NUM_LEVELS; level++) {
+    for (i = 0; i < header->num_nodes[level]; i++) {
+      if (snapshot->values[level][i] >= header->strings_size) {
+	return -1;
+      }
+    }
+    if (level < SNAPSHOT_NUM_LEVELS - 1) {
+      children = snapshot->children[level];
+      if (children[0] != 0) {
+	return -1;
+      }
+      for (i = 0; i < header->num_nodes[level]; i++) {
+	if (children[i] >= children[i + 1]) {
+	  return -1;
+	}
+      }
+      // The last child offset must close the next depth level
+      if (children[header->num_nodes[level]] != 
+	  header->num_nodes[level + 1]) {
+	return -1;
+      }
+    }
+  }
+  return 0;
+}
+
+/**
+ *  A helper function that points the fields of a snapshot at a snapshot 
+ *  image, after checking that the image is a valid snapshot: its header, 
+ *  its checksum, and then every offset it holds, since a snapshot that 
+ *  passes is walked without further bounds checks.
+ *
+ *  @param snapshot The snapshot. Unchanged unless the image is valid.
+ *  @param data The snapshot image.
+ *  @param size The size of the snapshot image.
+ *  @return 0 if the image is a valid snapshot; -1 otherwise.
+ **/
+static int helper_attach(struct Snapshot *snapshot, const char *data,
+			 size_t size) {
+  const struct SnapshotHeader *header = (const struct SnapshotHeader *) data;
+  struct Snapshot result;
+  int level;
+  // Check the header
+  if ((size < sizeof(struct SnapshotHeader)) || (size % 8 != 0) ||
+      (memcmp(header->magic, SNAPSHOT_MAGIC, 8) != 0) ||
+      (header->version != SNAPSHOT_VERSION) ||
+      (header->num_levels != SNAPSHOT_NUM_LEVELS) || (header->size != size) ||
+      (!helper_fits(header->strings_offset, header->strings_size, size)) ||
+      ((header->strings_size > 0) && 
+       (data[header->strings_offset + header->strings_size - 1] != '\0'))) {
+    return -1;
+  }
+  // Check that every array lies within the image
+  for (level = 0; level < SNAPSHOT_NUM_LEVELS; level++) {
+    if ((header->num_nodes[level] >= UINT32_MAX) ||
+	(!helper_fits(header->values_offset[level], 
+		      header->num_nodes[level] * 4, size))) {
+      return -1;
+    }
+    if ((level < SNAPSHOT_NUM_LEVELS - 1) &&
+	(!helper_fits(header->children_offset[level], 
+		      (header->num_nodes[level] + 1) * 4, size))) {
+      return -1;
+    }
+  }
+  // Check the contents
+  if (helper_checksum(data, size) != header->checksum) {
+    return -1;
+  }
+  result.data = data;
+  result.size = size;
+  result.is_mapped = 0;
+  result.header = header;
+  result.strings = data + header->strings_offset;
+  for (level = 0; level < SNAPSHOT_NUM_LEVELS; level++) {
+    result.values[level] = (const uint32_t *) 
+      (data + header->values_offset[level]);
+    if (level < SNAPSHOT_NUM_LEVELS - 1) {
+      result.children[level] = (const uint32_t *) 
+	(data + header->children_offset[level]);
+    }
+  }
+  // Check the offsets the arrays hold
+  if (helper_check_levels(&result) == -1) {
+    return -1;
+  }
+  *snapshot = result;
+  return 0;
+}
+
+/**
+ *  A helper function that serializes a planned tree into a snapshot image.
+ *  Its images are copied into a tree whose depth levels are in attribute 
+ *  order, which is serialized instead.
+ *
+ *  @param tree A pointer to the planned tree.
+ *  @param data Set to the newly allocated snapshot image.
+ *  @param size Set to the size of the snapshot image.
+ *  @return 0 on success; -1 if the tree does not fit the snapshot format.
+ **/
+static int helper_build_planned(const struct Tree *tree, char **data, 
+				size_t *size) {
+  struct Tree sorted;
+  struct TreeCursor cursor;
+  struct TreeImage image;
+  int result;
+  int level;
+  tree_init(&sorted);
+  // The copy is never queried, so it needs no query filter
+  tree_filter(&sorted, 0);
+  cursor_open(&cursor, tree, NULL);
+  while (cursor_next(&cursor, &image)) {
+    for (level = 0; level < SNAPSHOT_NUM_LEVELS; level++) {
+      image.values[level] = intern(&sorted.strings, 
+				   image.values[level]->text);
+    }
+    tree_append(&sorted, &image);
+  }
+  cursor_close(&cursor);
+  result = snapshot_build(&sorted, data, size);
+  tree_destroy(&sorted);
+  return result;
+}
+
+/**
+ *  Serialize a tree into a snapshot image.
+ *
+ *  @param tree A pointer to the tree.
+ *  @param data Set to the newly allocated snapshot image. Must be released
+ *  with free.
+ *  @param size Set to the size of the snapshot image.
+ *  @return 0 on success; -1 if the tree does not fit the snapshot format.
+ **/
+int snapshot_build(const struct Tree *tree, char **data, size_t *size) {
+  // Holds the nodes of every depth level, in level order
+  struct TreeNode **nodes[SNAPSHOT_NUM_LEVELS];
+  uint64_t num_nodes[SNAPSHOT_NUM_LEVELS];
+  // Maps every interned string to its offset in the string table
+  const struct InternedString **keys;
+  uint32_t *offsets;
+  size_t mask = 1;
+  uint64_t total_nodes = 0;
+  uint64_t strings_size = 0;
+  uint64_t offset;
+  struct SnapshotHeader *header;
+  char *result;
+  int level;
+  int result_code = 0;
+  size_t i;
+  int j;
+  // Snapshots hold the attributes in order
+  for (level = 0; level < NUM_ATTRIBUTES; level++) {
+    if (tree->order[level] != level) {
+      return helper_build_planned(tree, data, size);
+    }
+  }
+  // Depth level 1 holds the child nodes of the root node
+  num_nodes[0] = tree->root.children->count;
+  nodes[0] = malloc(sizeof(struct TreeNode *) * (num_nodes[0] + 1));
+  if (nodes[0] == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+  memcpy(nodes[0], tree->root.children->nodes, 
+	 sizeof(struct TreeNode *) * num_nodes[0]);
+  // Every other depth level holds the child nodes of the previous depth
+  // level, in order
+  for (level = 1; level < SNAPSHOT_NUM_LEVELS; level++) {
+    num_nodes[level] = 0;
+    for (i = 0; i < num_nodes[level - 1]; i++) {
+      num_nodes[level] += nodes[level - 1][i]->children->count;
+    }
+    nodes[level] = malloc(sizeof(struct TreeNode *) * (num_nodes[level] + 1));
+    if (nodes[level] == NULL) {
+      perror("malloc");
+      exit(1);
+    }
+    num_nodes[level] = 0;
+    for (i = 0; i < num_nodes[level - 1]; i++) {
+      memcpy(&nodes[level][num_nodes[level]], 
+	     nodes[level - 1][i]->children->nodes,
+	     sizeof(struct TreeNode *) * nodes[level - 1][i]->children->count);
+      num_nodes[level] += nodes[level - 1][i]->children->count;
+    }
+  }
+  // Assign every distinct string its offset in the string table
+  for (level = 0; level < SNAPSHOT_NUM_LEVELS; level++) {
+    total_nodes += num_nodes[level];
+  }
+  while (mask < total_nodes * 2) {
+    mask *= 2;
+  }
+  keys = calloc(mask, sizeof(struct InternedString *));
+  offsets = malloc(sizeof(uint32_t) * mask);
+  if ((keys == NULL) || (offsets == NULL)) {
+    perror("malloc");
+    exit(1);
+  }
+  mask--;
+  for (level = 0; level < SNAPSHOT_NUM_LEVELS; level++) {
+    for (i = 0; i < num_nodes[level]; i++) {
+      const struct InternedString *value = nodes[level][i]->value;
+      size_t slot = helper_find_offset(keys, mask, value);
+      if (keys[slot] == NULL) {
+	keys[slot] = value;
+	offsets[slot] = strings_size;
+	strings_size += value->length + 1;
+      }
+    }
+  }
+  // The format holds 32-bit offsets
+  for (level = 0; level < SNAPSHOT_NUM_LEVELS; level++) {
+    if (num_nodes[level] >= UINT32_MAX) {
+      result_code = -1;
+    }
+  }
+  if (strings_size > UINT32_MAX) {
+    result_code = -1;
+  }
+  if (result_code == 0) {
+    // Lay out the snapshot image
+    result = NULL;
+    offset = helper_align(sizeof(struct SnapshotHeader));
+    header = calloc(1, sizeof(struct SnapshotHeader));
+    if (header == NULL) {
+      perror("calloc");
+      exit(1);
+    }
+    memcpy(header->magic, SNAPSHOT_MAGIC, 8);
+    header->version = SNAPSHOT_VERSION;
+    header->num_levels = SNAPSHOT_NUM_LEVELS;
+    header->strings_offset = offset;
+    header->strings_size = strings_size;
+    offset += helper_align(strings_size);
+    for (level = 0; level < SNAPSHOT_NUM_LEVELS; level++) {
+      header->num_nodes[level] = num_nodes[level];
+      header->values_offset[level] = offset;
+      offset += helper_align(num_nodes[level] * 4);
+      if (level < SNAPSHOT_NUM_LEVELS - 1) {
+	header->children_offset[level] = offset;
+	offset += helper_align((num_nodes[level] + 1) * 4);
+      }
+    }
+    header->size = offset;
+    result = calloc(1, offset);
+    if (result == NULL) {
+      perror("calloc");
+      exit(1);
+    }
+    // Fill in the string table
+    for (i = 0; i <= mask; i++) {
+      if (keys[i] != NULL) {
+	memcpy(result + header->strings_offset + offsets[i], keys[i]->text,
+	       keys[i]->length + 1);
+      }
+    }
+    // Fill in the depth levels
+    for (level = 0; level < SNAPSHOT_NUM_LEVELS; level++) {
+      uint32_t *values = (uint32_t *) (result + header->values_offset[level]);
+      // The last depth level has no child offsets
+      uint32_t *children = (level < SNAPSHOT_NUM_LEVELS - 1) ?
+	(uint32_t *) (result + header->children_offset[level]) : NULL;
+      uint32_t num_children = 0;
+      for (i = 0; i < num_nodes[level]; i++) {
+	values[i] = offsets[helper_find_offset(keys, mask, 
+					       nodes[level][i]->value)];
+	if (level < SNAPSHOT_NUM_LEVELS - 1) {
+	  children[i] = num_children;
+	  num_children += nodes[level][i]->children->count;
+	}
+      }
+      if (level < SNAPSHOT_NUM_LEVELS - 1) {
+	children[num_nodes[level]] = num_children;
+      }
+    }
+    memcpy(result, header, sizeof(struct SnapshotHeader));
+    ((struct SnapshotHeader *) result)->checksum = 
+      helper_checksum(result, offset);
+    free(header);
+    *data = result;
+    *size = offset;
+  }
+  for (j = 0; j < SNAPSHOT_NUM_LEVELS; j++) {
+    free(nodes[j]);
+  }
+  free(keys);
+  free(offsets);
+  return result_code;
+}
+
+/**
+ *  A helper function that writes a snapshot image to a file, replacing the
+ *  file atomically.
+ *
+ *  @param data The snapshot image.
+ *  @param size The size of the snapshot image.
+ *  @param path The path of the snapshot file.
+ *  @return 0 on success; -1 on failure.
+ **/
+static int helper_write(const char *data, size_t size, const char *path) {
+  int result = 0;
+  // The snapshot is written next to its final path, synced, and only then
+  // renamed into place, so a crash never leaves a partial snapshot
+  char *temp_path = malloc(strlen(path) + sizeof(".tmp"));
+  FILE *file;
+  if (temp_path == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+  sprintf(temp_path, "%s.tmp", path);
+  file = fopen(temp_path, "wb");
+  if (file == NULL) {
+    perror("fopen");
+    result = -1;
+  }
+  else {
+    if ((fwrite(data, 1, size, file) != size) || (fflush(file) != 0) ||
+	(fsync(fileno(file)) != 0)) {
+      perror("fwrite");
+      result = -1;
+    }
+    if (fclose(file) != 0) {
+      perror("fclose");
+      result = -1;
+    }
+    if ((result == 0) && (rename(temp_path, path) != 0)) {
+      perror("rename");
+      result = -1;
+    }
+    if (result != 0) {
+      unlink(temp_path);
+    }
+  }
+  free(temp_path);
+  return result;
+}
+
+/**
+ *  Write a tree to a snapshot file.
+ *
+ *  @param tree A pointer to the tree.
+ *  @param path The path of the snapshot file.
+ *  @return 0 on success; -1 on failure.
+ **/
+int snapshot_write(const struct Tree *tree, const char *path) {
+  char *data;
+  size_t size;
+  int result = snapshot_build(tree, &data, &size);
+  if (result != 0) {
+    fprintf(stderr, "Database too large for a snapshot.\n");
+  }
+  else {
+    result = helper_write(data, size, path);
+    free(data);
+  }
+  return result;
+}
+
+/**
+ *  Write the image of an open snapshot to a file.
+ *
+ *  @param snapshot The snapshot.
+ *  @param path The path of the snapshot file.
+ *  @return 0 on success; -1 on failure.
+ **/
+int snapshot_copy(const struct Snapshot *snapshot, const char *path) {
+  return helper_write(snapshot->data, snapshot->size, path);
+}
+
+/**
+ *  Map a snapshot file into memory. Only the header and checksum are 
+ *  examined; nothing is deserialized.
+ *
+ *  @param snapshot The snapshot.
+ *  @param path The path of the snapshot file.
+ *  @return 0 on success; -1 on failure.
+ **/
+int snapshot_map(struct Snapshot *snapshot, const char *path) {
+  int result = -1;
+  struct stat info;
+  int fd = open(path, O_RDONLY);
+  if (fd == -1) {
+    perror("open");
+  }
+  else if (fstat(fd, &info) == -1) {
+    perror("fstat");
+    close(fd);
+  }
+  else {
+    void *data = MAP_FAILED;
+    if (info.st_size > 0) {
+      data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if ((data == MAP_FAILED) || 
+	(helper_attach(snapshot, data, info.st_size) != 0)) {
+      fprintf(stderr, "Invalid snapshot.\n");
+      if (data != MAP_FAILED) {
+	munmap(data, info.st_size);
+      }
+    }
+    else {
+      snapshot->is_mapped = 1;
+      result = 0;
+    }
+  }
+  return result;
+}
+
+/**
+ *  Serialize a tree into a snapshot image held in memory, and open it. The
+ *  tree is left as it was.
+ *
+ *  @param snapshot The snapshot.
+ *  @param tree A pointer to the tree.
+ *  @return 0 on success; -1 if the tree does not fit the snapshot format.
+ **/
+int snapshot_freeze(struct Snapshot *snapshot, const struct Tree *tree) {
+  char *data;
+  size_t size;
+  if (snapshot_build(tree, &data, &size) != 0) {
+    return -1;
+  }
+  // The image was just built, so it cannot fail to validate
+  helper_attach(snapshot, data, size);
+  snapshot->is_mapped = 0;
+  return 0;
+}
+
+/**
+ *  Release an open snapshot.
+ *
+ *  @param snapshot The snapshot.
+ **/
+void snapshot_close(struct Snapshot *snapshot) {
+  if (snapshot->data != NULL) {
+    if (snapshot->is_mapped) {
+      munmap((void *) snapshot->data, snapshot->size);
+    }
+    else {
+      free((void *) snapshot->data);
+    }
+  }
+  memset(snapshot, 0, sizeof(struct Snapshot));
+}
+
+/**
+ *  A helper function that finds the first node of a range of sibling nodes
+ *  of a depth level that is not below [OR] is beyond the range of a match,
+ *  using a binary search.
+ *
+ *  @param snapshot The snapshot.
+ *  @param level The depth level.
+ *  @param low The first node of the range.
+ *  @param high One past the last node of the range.
+ *  @param match The match.
+ *  @param is_beyond 0 to find the first node not below the range; 1 to find
+ *  the first node beyond the range.
+ *  @return The index of the node [high if there is none].
+ **/
+static uint32_t helper_seek_node(const struct Snapshot *snapshot, int level,
+				 uint32_t low, uint32_t high,
+				 const struct AttributeMatch *match, 
+				 int is_beyond) {
+  while (low < high) {
+    uint32_t middle = low + ((high - low) / 2);
+    const char *text = snapshot->strings + snapshot->values[level][middle];
+    if ((is_beyond) ? (!match_is_beyond(match, text)) : 
+	(match_is_below(match, text))) {
+      low = middle + 1;
+    }
+    else {
+      high = middle;
+    }
+  }
+  return low;
+}
+
+/**
+ *  A helper function that narrows a range of sibling nodes of a depth level
+ *  to the nodes matching an attribute value of a query.
+ *
+ *  @param snapshot The snapshot.
+ *  @param level The depth level.
+ *  @param low The first node of the range.
+ *  @param high One past the last node of the range.
+ *  @param match The match of the attribute value [See match_parse].
+ *  @param first Set to the first matching node.
+ *  @param last Set to one past the last matching node.
+ **/
+static void helper_match_range(const struct Snapshot *snapshot, int level,
+			       uint32_t low, uint32_t high, 
+			       const struct AttributeMatch *match,
+			       uint32_t *first, uint32_t *last) {
+  // Matching sibling nodes are contiguous, so seek to both ends of them
+  *first = helper_seek_node(snapshot, level, low, high, match, 0);
+  *last = helper_seek_node(snapshot, level, *first, high, match, 1);
+}
+
+/**
+ *  A helper function that finds the first filename node below a node.
+ *
+ *  @param snapshot The snapshot.
+ *  @param level The attribute depth level of the node.
+ *  @param node The node [One past the last node of the depth level finds
+ *  one past the last filename node].
+ *  @return The index of the filename node.
+ **/
+static uint32_t helper_first_filename(const struct Snapshot *snapshot, 
+				      int level, uint32_t node) {
+  // Follow the first child node of each depth level down
+  for ( ; level < NUM_ATTRIBUTES; level++) {
+    node = snapshot->children[level][node];
+  }
+  return node;
+}
+
+/**
+ *  A helper function that walks the images of a snapshot with matching 
+ *  attribute values, skipping a number of them and printing the filenames
+ *  of at most a number of those that follow, separated by spaces. Where 
+ *  every image below a range of matching nodes matches, their filenames 
+ *  are one range of filename nodes, skipped without being walked.
+ *
+ *  @param snapshot The snapshot.
+ *  @param values An array of attribute values
+ *  @param offset The number of images to skip.
+ *  @param limit The largest number of filenames to print.
+ *  @param output The sink to print to [Unused if nothing is printed].
+ *  @param num_skipped Set to the number of images skipped.
+ *  @return The number of filenames printed.
+ **/
+static size_t helper_search(const struct Snapshot *snapshot, char **values,
+			    size_t offset, size_t limit, 
+			    struct Output *output, size_t *num_skipped) {
+  const char *strings = snapshot->strings;
+  // Holds the match of every attribute value
+  struct AttributeMatch matches[NUM_ATTRIBUTES];
+  // Holds the current node, and one past the last matching node, of each 
+  // attribute depth level
+  uint32_t nodes[NUM_ATTRIBUTES];
+  uint32_t ends[NUM_ATTRIBUTES];
+  // Holds the range of filename nodes below the matching nodes
+  uint32_t filename;
+  uint32_t last;
+  // Holds the number of them skipped
+  size_t skipped;
+  // Holds the current attribute depth level, and the first from which 
+  // every depth level matches any cargo
+  int level;
+  int any_level;
+  // Holds the number of filenames printed
+  size_t num_printed = 0;
+  *num_skipped = 0;
+  for (level = 0; level < NUM_ATTRIBUTES; level++) {
+    match_parse(&matches[level], values[level + 1]);
+  }
+  for (any_level = NUM_ATTRIBUTES; 
+       (any_level > 0) && (match_is_any(&matches[any_level - 1])); 
+       any_level--) {
+  }
+  level = 0;
+  helper_match_range(snapshot, 0, 0, snapshot->header->num_nodes[0], 
+		     &matches[0], &nodes[0], &ends[0]);
+  // Walk the matching nodes depth first until the first depth level is 
+  // exhausted [OR] the page is full
+  while ((level >= 0) && (num_printed < limit)) {
+    // If the depth level is exhausted, move on to the next node above
+    if (nodes[level] == ends[level]) {
+      if (--level >= 0) {
+	nodes[level]++;
+      }
+    }
+    // Else, if some images below the nodes do not match, descend to the
+    // matching child nodes of the node
+    else if (level + 1 < any_level) {
+      helper_match_range(snapshot, level + 1, 
+			 snapshot->children[level][nodes[level]],
+			 snapshot->children[level][nodes[level] + 1], 
+			 &matches[level + 1], &nodes[level + 1], 
+			 &ends[level + 1]);
+      level++;
+    }
+    // Else, skip the filenames of every matching node, then output them,
+    // separated by spaces
+    else {
+      filename = helper_first_filename(snapshot, level, nodes[level]);
+      last = helper_first_filename(snapshot, level, ends[level]);
+      skipped = (offset < last - filename) ? offset : (last - filename);
+      filename += skipped;
+      offset -= skipped;
+      *num_skipped += skipped;
+      for ( ; (filename < last) && (num_printed < limit); filename++) {
+	if (num_printed > 0) {
+	  output_putc(output, ' ');
+	}
+	output_puts(output, 
+		    strings + snapshot->values[NUM_ATTRIBUTES][filename]);
+	num_printed++;
+      }
+      nodes[level] = ends[level];
+    }
+  }
+  return num_printed;
+}
+
+/**
+ *  Searches a snapshot to print all files with matching attribute values.
+ *  Same output as tree_search. A snapshot has no attribute indexes, so an
+ *  attribute that is not exact visits every node of its range.
+ *
+ *  @param snapshot The snapshot.
+ *  @param values An array of attribute values
+ *  @param output The sink to print to.
+ **/
+void snapshot_search(const struct Snapshot *snapshot, char **values,
+		     struct Output *output) {
+  snapshot_search_page(snapshot, values, 0, PAGE_ALL, output);
+}
+
+/**
+ *  Searches a snapshot to print one page of the files with matching 
+ *  attribute values. Same output as tree_search_page.
+ *
+ *  @param snapshot The snapshot.
+ *  @param values An array of attribute values
+ *  @param offset The number of matching files before the page.
+ *  @param limit The largest number of files of the page.
+ *  @param output The sink to print to.
+ **/
+void snapshot_search_page(const struct Snapshot *snapshot, char **values,
+			  size_t offset, size_t limit, 
+			  struct Output *output) {
+  size_t num_skipped;
+  if (helper_search(snapshot, values, offset, limit, output, 
+		    &num_skipped) > 0) {
+    output_putc(output, '\n');
+  }
+  else {
+    output_puts(output, "(NULL)\n");
+  }
+}
+
+/**
+ *  Count the images of a snapshot with matching attribute values.
+ *
+ *  @param snapshot The snapshot.
+ *  @param values An array of attribute values
+ *  @return The number of matching images.
+ **/
+size_t snapshot_count(const struct Snapshot *snapshot, char **values) {
+  size_t result;
+  // Every matching image is skipped, so nothing is printed
+  helper_search(snapshot, values, PAGE_ALL, PAGE_ALL, NULL, &result);
+  return result;
+}
+
+/**
+ *  A helper function that finds the nodes on the path to a filename node.
+ *  Filename nodes are visited in order, so each depth level only moves 
+ *  forwards, and a walk over every filename visits each node once.
+ *
+ *  @param snapshot The snapshot.
+ *  @param filename The filename node.
+ *  @param nodes Holds the nodes of the path to the former filename node 
+ *  [All 0 before the first], and is set to the path to this one.
+ **/
+static void helper_path_to(const struct Snapshot *snapshot, 
+			   uint32_t filename, uint32_t *nodes) {
+  int level;
+  nodes[NUM_ATTRIBUTES] = filename;
+  // Move every depth level on until its node holds the node below
+  for (level = NUM_ATTRIBUTES - 1; level >= 0; level--) {
+    while (snapshot->children[level][nodes[level] + 1] <= 
+	   nodes[level + 1]) {
+      nodes[level]++;
+    }
+  }
+}
+
+/**
+ *  A helper function that finds the nodes on the path to a filename node
+ *  from scratch, with a binary search of the child node offsets of each 
+ *  depth level.
+ *
+ *  @param snapshot The snapshot.
+ *  @param filename The filename node.
+ *  @param nodes Set to the path to the filename node.
+ **/
+static void helper_seek_path(const struct Snapshot *snapshot, 
+			     uint32_t filename, uint32_t *nodes) {
+  // Holds the search range [low, high)
+  uint32_t low;
+  uint32_t high;
+  int level;
+  nodes[NUM_ATTRIBUTES] = filename;
+  // Find the last node of each depth level whose child nodes start at or
+  // before the node below
+  for (level = NUM_ATTRIBUTES - 1; level >= 0; level--) {
+    low = 0;
+    high = snapshot->header->num_nodes[level];
+    while (high - low > 1) {
+      uint32_t middle = low + ((high - low) / 2);
+      if (snapshot->children[level][middle] <= nodes[level + 1]) {
+	low = middle;
+      }
+      else {
+	high = middle;
+      }
+    }
+    nodes[level] = low;
+  }
+}
+
+/**
+ *  Prints a complete snapshot. Same output as tree_print.
+ *
+ *  @param snapshot The snapshot.
+ *  @param output The sink to print to.
+ **/
+void snapshot_print(const struct Snapshot *snapshot, struct Output *output) {
+  snapshot_print_page(snapshot, 0, PAGE_ALL, output);
+}
+
+/**
+ *  Prints one page of the images of a snapshot. Same output as 
+ *  tree_print_page. The filename nodes are the images in sorted order, so
+ *  the page starts at the filename node of its offset.
+ *
+ *  @param snapshot The snapshot.
+ *  @param offset The number of images before the page.
+ *  @param limit The largest number of images of the page.
+ *  @param output The sink to print to.
+ **/
+void snapshot_print_page(const struct Snapshot *snapshot, size_t offset,
+			 size_t limit, struct Output *output) {
+  const char *strings = snapshot->strings;
+  // Holds the path to the current filename node
+  uint32_t nodes[SNAPSHOT_NUM_LEVELS] = {0};
+  // Holds the filename nodes of the page [filename, end)
+  uint64_t filename = offset;
+  uint64_t end = snapshot->header->num_nodes[SNAPSHOT_NUM_LEVELS - 1];
+  int level;
+  // If database is empty [OR] the page is past its last image
+  if (filename >= end) {
+    output_puts(output, "(NULL)\n");
+    return;
+  }
+  if (limit < end - filename) {
+    end = filename + limit;
+  }
+  helper_seek_path(snapshot, filename, nodes);
+  for ( ; filename < end; filename++) {
+    helper_path_to(snapshot, filename, nodes);
+    // Output the cargo of the path, separated by spaces
+    for (level = 0; level < SNAPSHOT_NUM_LEVELS; level++) {
+      output_puts(output, strings + snapshot->values[level][nodes[level]]);
+      output_putc(output, (level < SNAPSHOT_NUM_LEVELS - 1) ? ' ' : '\n');
+    }
+  }
+}
+
+/**
+ *  Count the nodes of each depth level of a snapshot, and find the largest
+ *  number of child nodes of a node of the depth level above each.
+ *
+ *  @param snapshot The snapshot.
+ *  @param shape Set to the shape of the snapshot.
+ **/
+void snapshot_shape(const struct Snapshot *snapshot, 
+		    struct StatsShape *shape) {
+  int depth_level;
+  uint64_t node;
+  memset(shape, 0, sizeof(struct StatsShape));
+  for (depth_level = 0; depth_level < SNAPSHOT_NUM_LEVELS; depth_level++) {
+    shape->num_nodes[depth_level] = snapshot->header->num_nodes[depth_level];
+  }
+  // Snapshots hold the attributes in order
+  for (depth_level = 0; depth_level < NUM_ATTRIBUTES; depth_level++) {
+    shape->order[depth_level] = depth_level;
+  }
+  // Every first depth level node is a child node of the root
+  shape->max_fanout[0] = shape->num_nodes[0];
+  for (depth_level = 1; depth_level < SNAPSHOT_NUM_LEVELS; depth_level++) {
+    for (node = 0; node < shape->num_nodes[depth_level - 1]; node++) {
+      if (snapshot->children[depth_level - 1][node + 1] - 
+	  snapshot->children[depth_level - 1][node] > 
+	  shape->max_fanout[depth_level]) {
+	shape->max_fanout[depth_level] = 
+	  snapshot->children[depth_level - 1][node + 1] - 
+	  snapshot->children[depth_level - 1][node];
+      }
+    }
+  }
+}
+
+/**
+ *  Insert every image of a snapshot into a tree. Images are visited in 
+ *  sorted order, so they are appended without searching [Unless the tree 
+ *  is planned]. Only the cargo of nodes not on the former path is interned.
+ *
+ *  @param snapshot The snapshot.
+ *  @param tree A pointer to the tree.
+ **/
+void snapshot_thaw(const struct Snapshot *snapshot, struct Tree *tree) {
+  const char *strings = snapshot->strings;
+  struct TreeImage image;
+  // Holds the path to the current filename node, and to the former one
+  uint32_t nodes[SNAPSHOT_NUM_LEVELS] = {0};
+  uint32_t former[SNAPSHOT_NUM_LEVELS];
+  uint32_t filename;
+  int level;
+  for (filename = 0; 
+       filename < snapshot->header->num_nodes[SNAPSHOT_NUM_LEVELS - 1];
+       filename++) {
+    helper_path_to(snapshot, filename, nodes);
+    for (level = 0; level < SNAPSHOT_NUM_LEVELS; level++) {
+      if ((filename == 0) || (nodes[level] != former[level])) {
+	image.values[level] = 
+	  intern(&tree->strings, strings + snapshot->values[level][nodes[level]]);
+	former[level] = nodes[level];
+      }
+    }
+    tree_append(tree, &image);
+  }
+}
+
+/**
+ *  Append an INSERT OPERATION to a journal for every image of a snapshot, 
+ *  in sorted order, and commit them, so replaying the journal rebuilds the 
+ *  snapshot.
+ *
+ *  @param snapshot The snapshot.
+ *  @param journal The journal.
+ *  @return 0 on success; -1 on failure.
+ **/
+int snapshot_journal(const struct Snapshot *snapshot, 
+		     struct Journal *journal) {
+  const char *strings = snapshot->strings;
+  // The tokens of the INSERT OPERATION [The journal only reads them]
+  char insert[2] = {INSERT, '\0'};
+  char *values[SNAPSHOT_NUM_LEVELS + 1];
+  uint32_t nodes[SNAPSHOT_NUM_LEVELS];
+  uint32_t filename;
+  int level;
+  values[0] = insert;
+  for (filename = 0; 
+       filename < snapshot->header->num_nodes[SNAPSHOT_NUM_LEVELS - 1];
+       filename++) {
+    helper_path_to(snapshot, filename, nodes);
+    for (level = 0; level < SNAPSHOT_NUM_LEVELS; level++) {
+      values[level + 1] = 
+	(char *) (strings + snapshot->values[level][nodes[level]]);
+    }
+    if (journal_append(journal, values) == -1) {
+      return -1;
+    }
+  }
+  return journal_sync(journal);
+}
@@ -0,0 +1,127 @@
+/**
+ *  Binary snapshots of the image database.
+ **/
+
+#ifndef _SNAPSHOT_H
+#define _SNAPSHOT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "journal.h"
+#include "tree.h"
+
+// Identifies a snapshot file
+#define SNAPSHOT_MAGIC	"PPMIMGDB"
+// Version of the snapshot format
+#define SNAPSHOT_VERSION	1
+// Number of depth levels [Attributes; filename]. A snapshot only loads in a
+// build with the same number of attributes
+#define SNAPSHOT_NUM_LEVELS	NUM_LEVELS
+
+
+/*
+ * Layout of a snapshot: the header, the string table (NUL-terminated
+ * strings), then for every depth level an array of string offsets, one per
+ * node, and (except for filenames) an array of num_nodes + 1 child offsets.
+ * The child nodes of node i are nodes [children[i], children[i + 1]) of the
+ * next depth level. Nodes are stored level by level in sorted order, with 
+ * the attributes in order even if the tree was planned, and all offsets are
+ * relative, so the file can be used wherever it is mapped.
+ */
+struct SnapshotHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t num_levels;
+	// Size of the whole snapshot, and checksum of everything after the
+	// header
+	uint64_t size;
+	uint64_t checksum;
+	uint64_t strings_offset;
+	uint64_t strings_size;
+	uint64_t num_nodes[SNAPSHOT_NUM_LEVELS];
+	uint64_t values_offset[SNAPSHOT_NUM_LEVELS];
+	uint64_t children_offset[SNAPSHOT_NUM_LEVELS - 1];
+};
+
+struct Snapshot {
+	// The whole snapshot, and whether it is mapped from a file
+	const char *data;
+	size_t size;
+	int is_mapped;
+
+	const struct SnapshotHeader *header;
+	const char *strings;
+	const uint32_t *values[SNAPSHOT_NUM_LEVELS];
+	const uint32_t *children[SNAPSHOT_NUM_LEVELS - 1];
+};
+
+/*
+ * Serialize a tree into a newly allocated snapshot image. Return 0 on
+ * success, or -1 if the tree is too large for the format.
+ */
+int snapshot_build(const struct Tree *, char **, size_t *);
+
+/*
+ * Write a tree to a snapshot file. Return 0 on success, -1 on failure.
+ */
+int snapshot_write(const struct Tree *, const char *);
+
+/*
+ * Write the image of an open snapshot to a file. Return 0 on success, -1 on
+ * failure.
+ */
+int snapshot_copy(const struct Snapshot *, const char *);
+
+/*
+ * Map a snapshot file into memory and validate it. Return 0 on success, -1
+ * on failure.
+ */
+int snapshot_map(struct Snapshot *, const char *);
+
+/*
+ * Open a tree as a snapshot image held in memory, for reading. Return 0 on
+ * success, or -1 if the tree is too large for the format.
+ */
+int snapshot_freeze(struct Snapshot *, const struct Tree *);
+
+/*
+ * Release an open snapshot.
+ */
+void snapshot_close(struct Snapshot *);
+
+/*
+ * QUERY and PRINT OPERATIONS, run directly on the snapshot image.
+ */
+void snapshot_search(const struct Snapshot *, char **, struct Output *);
+void snapshot_print(const struct Snapshot *, struct Output *);
+
+/*
+ * QUERY and PRINT OPERATIONS of one page, and the number of images 
+ * matching a QUERY OPERATION, run directly on the snapshot image. Same 
+ * arguments and results as the tree functions.
+ */
+void snapshot_search_page(const struct Snapshot *, char **, size_t, size_t,
+			  struct Output *);
+void snapshot_print_page(const struct Snapshot *, size_t, size_t,
+			 struct Output *);
+size_t snapshot_count(const struct Snapshot *, char **);
+
+/*
+ * Count the nodes of each depth level of a snapshot, and find its largest
+ * fanouts.
+ */
+void snapshot_shape(const struct Snapshot *, struct StatsShape *);
+
+/*
+ * Insert every image of a snapshot into a tree.
+ */
+void snapshot_thaw(const struct Snapshot *, struct Tree *);
+
+/*
+ * Append an INSERT OPERATION to a journal for every image of a snapshot, and
+ * commit them. Return 0 on success, -1 on failure.
+ */
+int snapshot_journal(const struct Snapshot *, struct Journal *);
+
+#endif /* _SNAPSHOT_H */
@@ -0,0 +1,288 @@
+/**
+ *  Operation statistics of the image database. Hot paths only bump plain
+ *  counters of their own thread; they are added to the shared totals with
+ *  a handful of relaxed atomic adds once per operation, along with the
+ *  latency of the operation. Latencies are kept in log-linear [HDR-style]
+ *  histograms, so percentiles are known within 12.5% in constant memory.
+ **/
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "stats.h"
+
+#ifndef NO_STATS
+
+// Totals of every thread
+struct StatsTotals {
+	unsigned long counts[STATS_NUM_COUNTERS];
+	unsigned long num_operations[STATS_NUM_OPERATIONS];
+	unsigned long long total_time[STATS_NUM_OPERATIONS];
+	unsigned long long max_time[STATS_NUM_OPERATIONS];
+	unsigned long buckets[STATS_NUM_OPERATIONS][STATS_NUM_BUCKETS];
+};
+
+__thread struct StatsLocal stats_local;
+
+static struct StatsTotals totals;
+
+#endif /* NO_STATS */
+
+/**
+ *  A helper function that prints formatted text to a sink.
+ *
+ *  @param output The sink.
+ *  @param format The format, as with printf.
+ **/
+static void helper_printf(struct Output *output, const char *format, ...) {
+  char buf[256];
+  va_list arguments;
+  int size;
+  va_start(arguments, format);
+  size = vsnprintf(buf, sizeof(buf), format, arguments);
+  va_end(arguments);
+  if (size > 0) {
+    output_append(output, buf, ((size_t) size < sizeof(buf)) ?
+		  (size_t) size : (sizeof(buf) - 1));
+  }
+}
+
+#ifndef NO_STATS
+
+/**
+ *  Return the time in nanoseconds.
+ *
+ *  @return The time.
+ **/
+unsigned long long stats_clock(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (unsigned long long) now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+/**
+ *  A helper function that finds the histogram bucket of a latency.
+ *
+ *  @param time The latency in nanoseconds.
+ *  @return The bucket.
+ **/
+static int helper_bucket(unsigned long long time) {
+  int exponent;
+  if (time < (1ULL << STATS_SUB_BUCKET_BITS)) {
+    return (int) time;
+  }
+  // The leading bit picks the power of two, the next bits the sub-bucket
+  exponent = 63 - __builtin_clzll(time);
+  return ((exponent - STATS_SUB_BUCKET_BITS + 1) << STATS_SUB_BUCKET_BITS) +
+    (int) ((time >> (exponent - STATS_SUB_BUCKET_BITS)) &
+	   ((1ULL << STATS_SUB_BUCKET_BITS) - 1));
+}
+
+/**
+ *  A helper function that returns the largest latency of a bucket.
+ *
+ *  @param bucket The bucket.
+ *  @return The latency in nanoseconds.
+ **/
+static unsigned long long helper_bucket_limit(int bucket) {
+  int exponent;
+  unsigned long long sub_bucket;
+  if (bucket < (1 << STATS_SUB_BUCKET_BITS)) {
+    return bucket;
+  }
+  exponent = (bucket >> STATS_SUB_BUCKET_BITS) + STATS_SUB_BUCKET_BITS - 1;
+  sub_bucket = bucket & ((1 << STATS_SUB_BUCKET_BITS) - 1);
+  return (((1ULL << STATS_SUB_BUCKET_BITS) + sub_bucket + 1) <<
+	  (exponent - STATS_SUB_BUCKET_BITS)) - 1;
+}
+
+/**
+ *  Record an operation, and add the counters of the current thread to the
+ *  totals.
+ *
+ *  @param operation The symbol of the operation.
+ *  @param start The time the operation started at.
+ **/
+void stats_record(char operation, unsigned long long start) {
+  unsigned long long time = stats_clock() - start;
+  unsigned long long max_time;
+  const char *symbol = strchr(STATS_OPERATIONS, operation);
+  int index;
+  int counter;
+  for (counter = 0; counter < STATS_NUM_COUNTERS; counter++) {
+    if (stats_local.counts[counter] != 0) {
+      __atomic_fetch_add(&totals.counts[counter],
+			 stats_local.counts[counter], __ATOMIC_RELAXED);
+      stats_local.counts[counter] = 0;
+    }
+  }
+  if ((symbol == NULL) || (operation == '\0')) {
+    return;
+  }
+  index = symbol - STATS_OPERATIONS;
+  __atomic_fetch_add(&totals.num_operations[index], 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&totals.total_time[index], time, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&totals.buckets[index][helper_bucket(time)], 1,
+		     __ATOMIC_RELAXED);
+  max_time = __atomic_load_n(&totals.max_time[index], __ATOMIC_RELAXED);
+  while ((time > max_time) &&
+	 (!__atomic_compare_exchange_n(&totals.max_time[index], &max_time,
+				       time, 1, __ATOMIC_RELAXED,
+				       __ATOMIC_RELAXED))) {
+  }
+}
+
+/**
+ *  A helper function that formats a latency with a fitting unit.
+ *
+ *  @param buf The buffer to format into.
+ *  @param size The size of the buffer.
+ *  @param time The latency in nanoseconds.
+ *  @return The buffer.
+ **/
+static const char *helper_format_time(char *buf, size_t size,
+				      unsigned long long time) {
+  if (time < 1000) {
+    snprintf(buf, size, "%lluns", time);
+  }
+  else if (time < 1000000) {
+    snprintf(buf, size, "%.1fus", time / 1e3);
+  }
+  else if (time < 1000000000) {
+    snprintf(buf, size, "%.1fms", time / 1e6);
+  }
+  else {
+    snprintf(buf, size, "%.2fs", time / 1e9);
+  }
+  return buf;
+}
+
+/**
+ *  A helper function that finds a latency percentile in a histogram.
+ *
+ *  @param buckets The histogram.
+ *  @param count The number of latencies in it.
+ *  @param fraction The percentile, as a fraction.
+ *  @param max_time The largest latency.
+ *  @return The largest latency of the bucket holding the percentile.
+ **/
+static unsigned long long helper_percentile(const unsigned long *buckets,
+					    unsigned long count,
+					    double fraction,
+					    unsigned long long max_time) {
+  unsigned long rank = (unsigned long) (fraction * count);
+  unsigned long seen = 0;
+  int bucket;
+  for (bucket = 0; bucket < STATS_NUM_BUCKETS; bucket++) {
+    seen += buckets[bucket];
+    if (seen > rank) {
+      break;
+    }
+  }
+  return (helper_bucket_limit(bucket) < max_time) ?
+    helper_bucket_limit(bucket) : max_time;
+}
+
+/**
+ *  A helper function that prints the count, latency summary and histogram
+ *  of every operation that ran.
+ *
+ *  @param output The sink.
+ **/
+static void helper_report_operations(struct Output *output) {
+  static const double FRACTIONS[4] = {0.5, 0.9, 0.99, 0.999};
+  static const char *NAMES[4] = {"p50", "p90", "p99", "p99.9"};
+  unsigned long buckets[STATS_NUM_BUCKETS];
+  unsigned long count;
+  unsigned long long max_time;
+  char buf[32];
+  int index, bucket, i;
+  for (index = 0; index < STATS_NUM_OPERATIONS; index++) {
+    count = __atomic_load_n(&totals.num_operations[index], __ATOMIC_RELAXED);
+    if (count == 0) {
+      continue;
+    }
+    max_time = __atomic_load_n(&totals.max_time[index], __ATOMIC_RELAXED);
+    for (bucket = 0; bucket < STATS_NUM_BUCKETS; bucket++) {
+      buckets[bucket] = __atomic_load_n(&totals.buckets[index][bucket],
+					__ATOMIC_RELAXED);
+    }
+    helper_printf(output, "%c: %lu ops, mean %s", STATS_OPERATIONS[index],
+		  count, helper_format_time(buf, sizeof(buf),
+					    totals.total_time[index] / count));
+    for (i = 0; i < 4; i++) {
+      helper_printf(output, ", %s %s", NAMES[i],
+		    helper_format_time(buf, sizeof(buf),
+				       helper_percentile(buckets, count,
+							 FRACTIONS[i],
+							 max_time)));
+    }
+    helper_printf(output, ", max %s\n",
+		  helper_format_time(buf, sizeof(buf), max_time));
+    // Every bucket that holds a latency, by its largest latency
+    for (bucket = 0; bucket < STATS_NUM_BUCKETS; bucket++) {
+      if (buckets[bucket] > 0) {
+	helper_printf(output, "  <= %s: %lu\n",
+		      helper_format_time(buf, sizeof(buf),
+					 helper_bucket_limit(bucket)),
+		      buckets[bucket]);
+      }
+    }
+  }
+  helper_printf(output, "Nodes visited: %lu\n",
+		__atomic_load_n(&totals.counts[STATS_NODES_VISITED],
+				__ATOMIC_RELAXED));
+  helper_printf(output, "String comparisons: %lu\n",
+		__atomic_load_n(&totals.counts[STATS_COMPARISONS],
+				__ATOMIC_RELAXED));
+  helper_printf(output, "Sort swaps: %lu\n",
+		__atomic_load_n(&totals.counts[STATS_SORT_SWAPS],
+				__ATOMIC_RELAXED));
+  helper_printf(output, "Filtered queries: %lu, %lu ruled out, %lu false "
+		"positives\n",
+		__atomic_load_n(&totals.counts[STATS_FILTER_CHECKS],
+				__ATOMIC_RELAXED),
+		__atomic_load_n(&totals.counts[STATS_FILTER_REJECTS],
+				__ATOMIC_RELAXED),
+		__atomic_load_n(&totals.counts[STATS_FILTER_FALSE_POSITIVES],
+				__ATOMIC_RELAXED));
+}
+
+#endif /* NO_STATS */
+
+/**
+ *  Print the statistics.
+ *
+ *  @param output The sink.
+ *  @param shape The shape of the tree.
+ *  @param arena The arena of the tree.
+ **/
+void stats_report(struct Output *output, const struct StatsShape *shape,
+		  const struct Arena *arena) {
+  int depth_level;
+#ifndef NO_STATS
+  // Counters bumped by this thread outside of an operation [Such as a bulk
+  // load] are added first
+  stats_record('\0', stats_clock());
+  helper_report_operations(output);
+#else
+  output_puts(output, "Operation statistics are compiled out\n");
+#endif
+  helper_printf(output, "Allocations: %zu (%zu bytes used, %zu free, %zu "
+		"reserved)\n", arena->num_allocations, arena->bytes_used,
+		arena->bytes_free, arena->bytes_reserved);
+  // Depth levels are listed from the top, so a planned order shows
+  for (depth_level = 0; depth_level < NUM_LEVELS; depth_level++) {
+    if (depth_level < NUM_ATTRIBUTES) {
+      helper_printf(output, "Attribute %d", shape->order[depth_level] + 1);
+    }
+    else {
+      output_puts(output, "Filename");
+    }
+    helper_printf(output, " nodes: %zu, max fanout %zu\n",
+		  shape->num_nodes[depth_level], 
+		  shape->max_fanout[depth_level]);
+  }
+}
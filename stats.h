@@ -0,0 +1,89 @@
+/**
+ *  Operation statistics of the image database: per-command counts and
+ *  latency histograms, and counters on the hot paths. Building with
+ *  -DNO_STATS removes the counters and timers completely.
+ **/
+
+#ifndef _STATS_H
+#define _STATS_H
+
+#include <stddef.h>
+#include <string.h>
+
+#include "arena.h"
+#include "output.h"
+#include "utils.h"
+
+// Hot-path counters
+#define STATS_NODES_VISITED	0
+#define STATS_COMPARISONS	1
+#define STATS_SORT_SWAPS	2
+#define STATS_FILTER_CHECKS	3
+#define STATS_FILTER_REJECTS	4
+#define STATS_FILTER_FALSE_POSITIVES	5
+#define STATS_NUM_COUNTERS	6
+
+// Symbols of the operations whose latency is recorded
+#define STATS_OPERATIONS	"iqpwlksdfc"
+#define STATS_NUM_OPERATIONS	10
+
+// Latency buckets: exact below 2^STATS_SUB_BUCKET_BITS nanoseconds, then
+// 2^STATS_SUB_BUCKET_BITS buckets per power of two [12.5% wide]
+#define STATS_SUB_BUCKET_BITS	3
+#define STATS_NUM_BUCKETS \
+  ((65 - STATS_SUB_BUCKET_BITS) << STATS_SUB_BUCKET_BITS)
+
+
+// The number of nodes of each depth level, and the largest number of child
+// nodes of a node of the depth level above it
+struct StatsShape {
+	size_t num_nodes[NUM_LEVELS];
+	size_t max_fanout[NUM_LEVELS];
+	// The attribute held by each attribute depth level [0 for Attribute 1]
+	int order[NUM_ATTRIBUTES];
+};
+
+#ifndef NO_STATS
+
+// Counters of the current thread, added to the totals after each operation
+struct StatsLocal {
+	unsigned long counts[STATS_NUM_COUNTERS];
+};
+
+extern __thread struct StatsLocal stats_local;
+
+#define STATS_COUNT(counter, amount) \
+  (stats_local.counts[(counter)] += (amount))
+// strcmp, counted as a string comparison
+#define STATS_STRCMP(a, b) \
+  (stats_local.counts[STATS_COMPARISONS]++, strcmp((a), (b)))
+#define STATS_START(start) unsigned long long start = stats_clock()
+#define STATS_RECORD(operation, start) stats_record((operation), (start))
+
+/*
+ * Return the time in nanoseconds.
+ */
+unsigned long long stats_clock(void);
+
+/*
+ * Record an operation of the given symbol, started at the given time, and
+ * add the counters of the current thread to the totals.
+ */
+void stats_record(char, unsigned long long);
+
+#else
+
+#define STATS_COUNT(counter, amount) ((void) 0)
+#define STATS_STRCMP(a, b) strcmp((a), (b))
+#define STATS_START(start) ((void) 0)
+#define STATS_RECORD(operation, start) ((void) 0)
+
+#endif /* NO_STATS */
+
+/*
+ * Print the statistics, along with the given tree shape and arena usage.
+ */
+void stats_report(struct Output *, const struct StatsShape *,
+		  const struct Arena *);
+
+#endif /* _STATS_H */
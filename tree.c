@@ -12,138 +12,186 @@
 /**
  *  A helper function that allocates a new tree node.
  *
- *  @param value The entry's value. It represents either an attribute or a 
- *  filename.
+ *  @param arena The arena of the tree.
+ *  @param value The entry's interned value. It represents either an 
+ *  attribute or a filename.
  *  @return A pointer to the newly allocated node.
  **/
-struct TreeNode *allocate_node(const char *value) {
-  // Allocate memory on Heap for a new node
-  struct TreeNode *result = malloc(sizeof(struct TreeNode));
+struct TreeNode *allocate_node(struct Arena *arena, 
+			       const struct InternedString *value) {
+  // Allocate memory in the arena for a new node
+  struct TreeNode *result = arena_alloc(arena, sizeof(struct TreeNode));
   // Initialize node values:
-  // Allocate memory on Heap for new cargo
-  result->value = malloc((sizeof(char) * strlen(value)) + 1);
-  // Insert the new cargo
-  strcpy(result->value, value);
+  // The cargo is shared with every other node holding the same value, and 
+  // counts this node
+  result->value = value;
+  intern_acquire(value);
   // Points to next node in same depth level
   result->sibling = NULL;
   // Points to next node in next depth level
   result->child = NULL;
+  // Set once the node is connected to its parent node
+  result->parent = NULL;
+  // Child nodes are indexed in sorted order, with their counts of images.
+  // No child nodes yet
+  result->children = &nodes_counted;
+  // Counted once its images are connected
+  result->num_images = 0;
   // Returns a reference to the new node
   return result;
 }
 
 /**
- *  A helper function that inserts new node branches into the database.
- *
- *  @param root The root node of the database.
- *  @param values The cargo to be placed in the new nodes. May hold:
- *  Attribute 1 (A1); Attribute 2 (A2); Attribute 3 (A3); Filename.
- *  @param num_children The number of new nodes to be inserted.
- **/
-void helper_tree_insert_children(struct TreeNode *root, char **values, 
-				 int num_children) {
-  // If 4 children are required 
-  // (i.e., root node is main root node of database)
-  if (num_children == 4) {
-    // Create filename node
-    struct TreeNode *filename = allocate_node(values[4]);
-    // Create Attribute 3 (A3) node
-    struct TreeNode *attribute_3 = allocate_node(values[3]);
-    // Connect A3 to filename on next depth level
-    attribute_3->child = filename;
-    // Create Attribute 2 (A2) node
-    struct TreeNode *attribute_2 = allocate_node(values[2]);
-    // Connect A2 to A3 on next depth level
-    attribute_2->child = attribute_3;
-    // Create Attribute 1 (A1) node
-    struct TreeNode *attribute_1 = allocate_node(values[1]);
-    // Connect A1 to A2 on next depth level
-    attribute_1->child = attribute_2;
-    // Connect Root to A1 on next depth level
-    root->child = attribute_1;
-  }
-  // Else, if 3 children are required 
-  // (i.e., root node is Attribute 1 (A1) node)
-  else if (num_children == 3) {
-    // Create filename node
-    struct TreeNode *filename = allocate_node(values[4]);
-    // Create Attribute 3 (A3) node
-    struct TreeNode *attribute_3 = allocate_node(values[3]);
-    // Connect A3 to filename on next depth level
-    attribute_3->child = filename;
-    // Create Attribute 2 (A2) node
-    struct TreeNode *attribute_2 = allocate_node(values[2]);
-    // Connect A2 to A3 on next depth level
-    attribute_2->child = attribute_3;
-    // Connect A1 to A2 on next depth level
-    root->child = attribute_2;
-  }
-  // Else, if 2 children are required 
-  // (i.e., root node is Attribute 2 (A2) node)
-  else if (num_children == 2) {
-    // Create filename node
-    struct TreeNode *filename = allocate_node(values[4]);
-    // Create Attribute 3 (A3) node
-    struct TreeNode *attribute_3 = allocate_node(values[3]);
-    // Connect A3 to filename on next depth level
-    attribute_3->child = filename;
-    // Connect A2 to A3 on next depth level
-    root->child = attribute_3;
-  }
-  // Else, 1 child is required (i.e., root node is Attribute 3 (A3) node)
-  else {
-    // Create filename node
-    struct TreeNode *filename = allocate_node(values[4]);
-    // Connect A3 to filename on next depth level
-    root->child = filename;
+ *  A helper function that finds a child node using a binary search over the
+ *  sorted child node index of its parent node. Since cargo is interned, a 
+ *  matching node is recognized by its address; strcmp is only needed to 
+ *  decide which half to search next.
+ *
+ *  @param parent The node whose child nodes are to be searched.
+ *  @param value The interned cargo of the required child node.
+ *  @param position Set to the index of the matching child node, or to the 
+ *  index at which a child node with the given cargo should be inserted.
+ *  @return The matching child node, or NULL if there is none.
+ **/
+struct TreeNode *helper_find_child(const struct TreeNode *parent, 
+				   const struct InternedString *value, 
+				   int *position) {
+  // Holds the child node index [Loaded once, as the writer may replace it]
+  const struct NodeArray *children = ATOMIC_READ(parent->children);
+  // Holds the search range [low, high)
+  int low = 0;
+  int high = ATOMIC_READ(children->count);
+  // Node detector. Assume that we have not yet found our required value
+  int is_node_found = 0;
+  // Keep halving the search range until it is empty [OR] until we find the
+  // required node
+  while ((low < high) && (!is_node_found)) {
+    int middle = low + ((high - low) / 2);
+    const struct InternedString *middle_value;
+    middle_value = children->nodes[middle]->value;
+    STATS_COUNT(STATS_NODES_VISITED, 1);
+    // If this is the node we are looking for
+    if (middle_value == value) {
+      low = middle;
+      is_node_found = 1;
+    }
+    // Else, if the middle node is smaller, search the upper half
+    else if (STATS_STRCMP(middle_value->text, value->text) < 0) {
+      low = middle + 1;
+    }
+    // Else, the middle node is larger, search the lower half
+    else {
+      high = middle;
+    }
   }
+  // Store the position of the node (or where it belongs)
+  *position = low;
+  return (is_node_found) ? children->nodes[low] : NULL;
 }
 
 /**
- *  A helper function that inserts a new sibling node into the database.
+ *  A helper function that connects a new child node to its parent node, both
+ *  in the sorted sibling node list and in the sorted child node index. The
+ *  new node is complete before either link to it is published, so 
+ *  concurrent readers see it either fully, in sorted order, or not at all.
  *
- *  @param root The root node of the database.
- *  @param value The cargo to be placed in the new node. May hold:
- *  Attribute 1 (A1); Attribute 2 (A2); Attribute 3 (A3); Filename.
- *  @param is_new_sibling Used to determine if a new sibling node was 
- *  inserted.
- *  @return A pointer to the new sibling node.
+ *  @param tree A pointer to the tree.
+ *  @param parent The node to receive a new child node.
+ *  @param position The sorted position of the new child node.
+ *  @param node The new child node.
  **/
-struct TreeNode *helper_tree_insert_sibling(struct TreeNode *root,
-					    char *value, 
-					    int *is_new_sibling) {
-  // Holds the node to be returned
-  struct TreeNode *result;
-  // If this node matches the desired cargo
-  if (strcmp(root->value, value) == 0) {
-    // Our result is the given node. This indicates that a new sibling node
-    // was not required to be inserted
-    result = root;
+void helper_add_child(struct Tree *tree, struct TreeNode *parent,
+		      int position, struct TreeNode *node) {
+  node->parent = parent;
+  // If the new node is the first sibling node
+  if (position == 0) {
+    // Connect the new node to the former first sibling node (if any)
+    node->sibling = parent->child;
+    // Connect the parent node to the new node on next depth level
+    ATOMIC_PUBLISH(parent->child, node);
   }
-  // Else, move on to the next sibling node
+  // Else, link the new node in after its smaller sibling node
   else {
-    struct TreeNode *next_node = root->sibling;
-    // If this node exists
-    if (next_node != NULL) {
-      // Recursive call: Attempt to insert a new sibling node at current node.
-      // The new root node is the current sibling node
-      result = helper_tree_insert_sibling(next_node, value, is_new_sibling);
-    }
-    // Else, create a new node with our specified cargo
-    else {
-      struct TreeNode *new_node = allocate_node(value);
-      // Connect the previous node with our new sibling node
-      root->sibling = new_node;
-      // Our result is the new sibling node
-      result = new_node;
-      // Indicates that a new sibling node was inserted
-      *is_new_sibling = 1;
-    }
+    node->sibling = parent->children->nodes[position - 1]->sibling;
+    ATOMIC_PUBLISH(parent->children->nodes[position - 1]->sibling, node);
+  }
+  // Store the new node in the child node index
+  nodes_insert(&parent->children, position, node, &tree->epochs);
+}
+
+/**
+ *  A helper function that finds the attribute held by a depth level.
+ *
+ *  @param order The attribute held by each attribute depth level.
+ *  @param depth_level The depth level.
+ *  @return The index of the value among the values of an image 
+ *  [NUM_ATTRIBUTES for the filename].
+ **/
+int helper_attribute(const int *order, int depth_level) {
+  return (depth_level < NUM_ATTRIBUTES) ? order[depth_level] : 
+    NUM_ATTRIBUTES;
+}
+
+/**
+ *  A helper function that creates a new branch of nodes, one per depth 
+ *  level from the given one down to the filename. The branch is complete 
+ *  before it is returned, so once connected to the tree, concurrent readers
+ *  see all of it or none of it.
+ *
+ *  @param tree A pointer to the tree.
+ *  @param keys The interned cargo of every depth level.
+ *  @param depth_level The depth level of the first new node.
+ *  @return The first node of the branch, not yet connected to a parent.
+ **/
+struct TreeNode *helper_new_branch(struct Tree *tree, 
+				   const struct InternedString **keys,
+				   int depth_level) {
+  // Create the filename node first
+  struct TreeNode *result = allocate_node(&tree->arena, 
+					  keys[NUM_LEVELS - 1]);
+  // Holds the node created for the depth level above the current one
+  struct TreeNode *parent;
+  int level;
+  // Every node of the branch holds the one new image
+  result->num_images = 1;
+  // Work up the depth levels, connecting each new node to the one below
+  for (level = NUM_LEVELS - 2; level >= depth_level; level--) {
+    parent = allocate_node(&tree->arena, keys[level]);
+    parent->num_images = 1;
+    helper_add_child(tree, parent, 0, result);
+    result = parent;
   }
-  // Returns the new sibling node
   return result;
 }
 
+/**
+ *  A helper function that adds to the number of images of every node on a
+ *  path from the root node, and to its count in the child node index of 
+ *  the node above it. Readers load the counts without locks. The writer 
+ *  counts images before it connects them and uncounts them after it 
+ *  disconnects them, so a count may exceed the images a reader can reach 
+ *  below its node by those of an operation the writer is in the middle of,
+ *  but never falls short of them.
+ *
+ *  @param path The nodes of the path [The root node first].
+ *  @param positions The position of the node of each depth level of the 
+ *  path among the child nodes of the node above it.
+ *  @param num_levels The number of depth levels of the path.
+ *  @param delta The number of images added [Negative if removed].
+ **/
+void helper_count_path(struct TreeNode **path, const int *positions,
+		       int num_levels, long delta) {
+  int depth_level;
+  for (depth_level = num_levels; depth_level >= 0; depth_level--) {
+    ATOMIC_PUBLISH(path[depth_level]->num_images, 
+		   path[depth_level]->num_images + delta);
+    if (depth_level > 0) {
+      nodes_count(path[depth_level - 1]->children, 
+		  positions[depth_level - 1], delta);
+    }
+  }
+}
+
 /**
  *  A helper function that sorts sibling nodes at of a certain depth level.
  *
@@ -163,12 +211,16 @@ struct TreeNode *helper_sibling_node_sort(struct TreeNode *root,
   // Holds the node to be returned. Default return node is the initial root
   // node
   struct TreeNode *result = root;
-  // If sibling node exists
-  if (root->sibling != NULL) {
+  // Holds the sibling node compared with the current root node
+  struct TreeNode *main_sibling;
+  // Compare every pair of adjacent sibling nodes, one pair at a time [A 
+  // loop rather than a call per sibling node, so long runs of sibling 
+  // nodes cannot exhaust the stack]
+  while (root->sibling != NULL) {
     // Obtain sibling node
-    struct TreeNode *main_sibling = root->sibling;
+    main_sibling = root->sibling;
     // If root node's value is larger than sibling node's value
-    if (strcmp(root->value, main_sibling->value) > 0) {
+    if (STATS_STRCMP(root->value->text, main_sibling->value->text) > 0) {
       // Swap the node values (i.e., swap the node references):
       // Saves the next sibling node's reference
       struct TreeNode *temp_node = main_sibling->sibling;
@@ -190,23 +242,17 @@ struct TreeNode *helper_sibling_node_sort(struct TreeNode *root,
       }
       // Indicates that a node swap has occured
       *is_swap_occured = 1;
+      STATS_COUNT(STATS_SORT_SWAPS, 1);
+      // The root node carries on past its next sibling node, which now 
+      // precedes it
+      prev_node = main_sibling;
     }
-    // If the next sibling node exists
-    if (main_sibling->sibling != NULL) {
-      // If our previous node was void
-      if (prev_node == NULL) {
-	// Have our previous node point to the current root node
-	prev_node = root;
-      }
-      // Else, have our previous node point to the current sibling node
-      else {
-	prev_node = prev_node->sibling;
-      }
-      // Recursive call: Attempt to sort the next set of sibling nodes:
-      // The new current root node is the current sibling node
-      result = helper_sibling_node_sort(main_sibling, is_swap_occured,
-					main_root, prev_node);
+    // Else, the next pair starts at the sibling node
+    else {
+      prev_node = root;
+      root = main_sibling;
     }
+    result = root;
   }
   // Returns the next node to be sorted
   return result;
@@ -233,276 +279,1590 @@ void sibling_node_sort(struct TreeNode *root,
   while (is_swap_occured) {
     // Reset the swap detector
     is_swap_occured = 0;
-    // Attempt to sort the sibling nodes:
+    // Attempt to sort the sibling nodes, from the first one [A swap may 
+    // have moved the starting node]:
     // Our previous node is void
-    helper_sibling_node_sort(root, &is_swap_occured, main_root, NULL);
+    helper_sibling_node_sort(main_root->child, &is_swap_occured, main_root,
+			     NULL);
   }
 }
 
 /**
- *  Sorts all nodes in the database.
+ *  Sorts all nodes in the database. Insertion keeps sibling nodes sorted, so
+ *  this is only required to repair a database built by other means. The 
+ *  nodes are walked depth first with an explicit stack of one node per 
+ *  depth level, so neither the number of sibling nodes nor the number of
+ *  depth levels deepens the call stack.
  *
  *  @param root The starting sibling node at the 1st depth level 
  *  [Attribute 1 (A1)].
  *  @param main_root The root node of the database. 
- *  @return A pointer to the next node set to be sorted.
+ *  @return A pointer to the first node of the last set of sibling nodes
+ *  sorted.
  **/
 struct TreeNode *database_sort(struct TreeNode *root, 
 			       struct TreeNode *main_root) {
   // Holds the node to be returned. Default return node is the initial root
   // node
   struct TreeNode *result = root;
-  // If sibling node exists
-  if (root->sibling != NULL) {
-    // Sort the sibling nodes
-    sibling_node_sort(root, main_root);
-    // If sibling node still exists [Which it may not after a node swap]
-    if (root->sibling != NULL) {
-      // Recursive call: Sort the next set of sibling nodes:
-      // The new current root node is the current sibling node
-      result = database_sort(root->sibling, main_root);
-    }
-  }
-  // If child node exists
-  if (root->child != NULL) {
-    // The new main root is the current root
-    main_root = root;
-    // Recursive call: Sort the next set of sibling nodes:
-    // The new current root node is the root node's child
-    result = database_sort(root->child, main_root);
+  // Holds the next sibling node to descend from at each depth level
+  struct TreeNode *stack[NUM_LEVELS];
+  // Holds the current node
+  struct TreeNode *node;
+  // Holds the current depth level
+  int depth_level = 0;
+  // Sort the sibling nodes of the 1st depth level. A swap may replace the
+  // starting node, so the walk starts from the main root's child
+  sibling_node_sort(root, main_root);
+  stack[0] = main_root->child;
+  while (depth_level >= 0) {
+    node = stack[depth_level];
+    // If every sibling node of this depth level is done, go back up
+    if (node == NULL) {
+      depth_level--;
+      continue;
+    }
+    stack[depth_level] = node->sibling;
+    // If child node exists, sort its sibling nodes and walk them next
+    if (node->child != NULL) {
+      sibling_node_sort(node->child, node);
+      result = node->child;
+      stack[++depth_level] = node->child;
+    }
   }
-  // Returns the next node set to be sorted.
+  // Returns the first node of the last set of sibling nodes sorted
   return result;
 }
 
 /**
- *  Insert a new image to a tree
+ *  Initialize an empty tree.
+ *
+ *  @param tree A pointer to the tree.
+ **/
+void tree_init(struct Tree *tree) {
+  // Holds the current attribute depth level
+  int depth_level;
+  // The root node holds no cargo
+  tree->root.value = NULL;
+  tree->root.sibling = NULL;
+  tree->root.child = NULL;
+  tree->root.parent = NULL;
+  tree->root.children = &nodes_counted;
+  tree->root.num_images = 0;
+  // Every other node is allocated from the arena
+  arena_init(&tree->arena);
+  // Memory replaced while readers may hold it goes back to the arena later
+  epoch_init(&tree->epochs, &tree->arena);
+  // Cargo is interned in the arena as well
+  intern_init(&tree->strings, &tree->epochs);
+  // And so are the attribute indexes. Depth levels hold the attributes in
+  // order until planned
+  for (depth_level = 0; depth_level < NUM_ATTRIBUTES; depth_level++) {
+    index_init(&tree->indexes[depth_level], &tree->epochs);
+    tree->order[depth_level] = depth_level;
+  }
+  // Attribute tuples are filtered at the default rate until tree_filter
+  filter_init(&tree->filter, &tree->epochs, FILTER_DEFAULT_RATE);
+  tree->num_images = 0;
+}
+
+/**
+ *  Release all memory held by a tree. The tree is left empty.
+ *
+ *  @param tree A pointer to the tree.
+ **/
+void tree_destroy(struct Tree *tree) {
+  // The rate of the query filter is kept
+  double rate = tree->filter.rate;
+  // Every node, cargo and child node index lives in the arena, so releasing
+  // the arena's blocks releases the whole tree
+  epoch_destroy(&tree->epochs);
+  arena_destroy(&tree->arena);
+  tree_init(tree);
+  tree->filter.rate = rate;
+}
+
+/**
+ *  A helper function that adds the attribute tuple of a new image to the
+ *  query filter of a tree.
+ *
+ *  @param tree A pointer to the tree.
+ *  @param keys The interned cargo of every depth level of the image.
+ **/
+void helper_filter_add(struct Tree *tree, 
+		       const struct InternedString **keys) {
+  // Holds the attribute values of the image, in attribute order
+  const struct InternedString *values[NUM_ATTRIBUTES];
+  int depth_level;
+  for (depth_level = 0; depth_level < NUM_ATTRIBUTES; depth_level++) {
+    values[tree->order[depth_level]] = keys[depth_level];
+  }
+  filter_add(&tree->filter, tree, values);
+}
+
+/**
+ *  A helper function that adds a new branch of attribute nodes to the 
+ *  attribute indexes of a tree. Every node below the first new node of an
+ *  image is new as well, and is the only child node of its parent node.
+ *
+ *  @param tree A pointer to the tree.
+ *  @param node The first new node of the branch.
+ *  @param depth_level The depth level of the node [0 for the first].
+ **/
+void helper_index_branch(struct Tree *tree, struct TreeNode *node,
+			 int depth_level) {
+  // Move through the attribute depth levels [Filenames are not indexed]
+  for ( ; depth_level < NUM_ATTRIBUTES; depth_level++) {
+    index_add(&tree->indexes[depth_level], node);
+    node = node->child;
+  }
+}
+
+/**
+ *  A helper function that connects the missing depth levels of a new image
+ *  to a tree, as a new branch below the last node of the image that exists.
+ *  A new attribute node means a new attribute tuple, which is filtered 
+ *  before the branch is connected: readers cannot find the tuple before the
+ *  filter holds it, and should the add rebuild the filter from the tree, 
+ *  the rebuild does not count the tuple as well. So is the image counted 
+ *  on the path above the branch, for cursor_skip.
+ *
+ *  @param tree A pointer to the tree.
+ *  @param path The nodes of the image that exist [The root node first].
+ *  @param positions The sorted position of the node of each depth level 
+ *  among its sibling nodes [OR] of the branch, at the depth level of its 
+ *  first node.
+ *  @param keys The interned cargo of every depth level of the image.
+ *  @param depth_level The depth level of the first new node.
+ **/
+void helper_insert_branch(struct Tree *tree, struct TreeNode **path, 
+			  const int *positions, 
+			  const struct InternedString **keys, 
+			  int depth_level) {
+  // Holds the first node of the new branch
+  struct TreeNode *child;
+  if (depth_level < NUM_ATTRIBUTES) {
+    helper_filter_add(tree, keys);
+  }
+  // Connect the new branch at its sorted position [No sort is required]
+  child = helper_new_branch(tree, keys, depth_level);
+  helper_count_path(path, positions, depth_level, 1);
+  helper_add_child(tree, path[depth_level], positions[depth_level], child);
+  helper_index_branch(tree, child, depth_level);
+  tree->num_images++;
+}
+
+/**
+ *  Insert a new image to a tree. The depth levels are walked down while
+ *  their nodes exist; the rest of the image becomes a new branch, connected
+ *  at its sorted position.
+ *
+ *  @param tree A pointer to the tree.
+ *  @param values The tokens of an INSERT OPERATION: the attribute values of
+ *  the image, then its filename
+ **/
+void tree_insert(struct Tree *tree, char **values) {
+  // Holds the nodes of the image that exist. Starts at the root node of 
+  // the tree
+  struct TreeNode *path[NUM_LEVELS + 1];
+  // Holds the interned cargo of every depth level [Attributes; filename]
+  const struct InternedString *keys[NUM_LEVELS];
+  // Holds the current depth level
+  int depth_level;
+  // Holds the sorted position of the child node of each depth level (or 
+  // where it belongs)
+  int positions[NUM_LEVELS];
+  // Intern the cargo. Nodes share the single interned copy of each value
+  for (depth_level = 0; depth_level < NUM_LEVELS; depth_level++) {
+    keys[depth_level] = 
+      intern(&tree->strings, 
+	     values[helper_attribute(tree->order, depth_level) + 1]);
+  }
+  // Move down the depth levels until one lacks the required cargo
+  path[0] = &tree->root;
+  for (depth_level = 0; depth_level < NUM_LEVELS; depth_level++) {
+    path[depth_level + 1] = helper_find_child(path[depth_level], 
+					      keys[depth_level], 
+					      &positions[depth_level]);
+    if (path[depth_level + 1] == NULL) {
+      break;
+    }
+  }
+  // If no depth level lacked its cargo, duplicate image was present in 
+  // database
+  if (depth_level < NUM_LEVELS) {
+    helper_insert_branch(tree, path, positions, keys, depth_level);
+  }
+}
+
+/**
+ *  A helper function that compares two images by their cargo, value by 
+ *  value [Attributes; filename]. Used by qsort.
+ *
+ *  @param a The first image.
+ *  @param b The second image.
+ *  @return A negative, zero or positive value if the first image sorts 
+ *  before, equal to or after the second image.
+ **/
+int helper_compare_images(const void *a, const void *b) {
+  const struct TreeImage *image_a = a;
+  const struct TreeImage *image_b = b;
+  // Holds the result of the comparison. Assume the images are equal
+  int result = 0;
+  // Holds the current depth level
+  int depth_level;
+  // Keep comparing cargo until a depth level differs
+  for (depth_level = 0; (depth_level < NUM_LEVELS) && (result == 0); 
+       depth_level++) {
+    // Interned cargo at the same address is equal
+    if (image_a->values[depth_level] != image_b->values[depth_level]) {
+      result = STATS_STRCMP(image_a->values[depth_level]->text,
+		      image_b->values[depth_level]->text);
+    }
+  }
+  return result;
+}
+
+/**
+ *  A helper function that finds a child node when sibling nodes arrive in
+ *  sorted order. The cargo usually matches or follows the last child node,
+ *  so no search is needed; any other cargo is found by a regular search.
+ *
+ *  @param parent The node whose child nodes are to be searched.
+ *  @param value The interned cargo of the required child node.
+ *  @param position Set to the index of the matching child node, or to the 
+ *  index at which a child node with the given cargo should be inserted.
+ *  @return The matching child node, or NULL if there is none.
+ **/
+struct TreeNode *helper_append_find(const struct TreeNode *parent,
+				    const struct InternedString *value,
+				    int *position) {
+  // Holds the number of child nodes
+  int count = parent->children->count;
+  // Holds the last child node [NULL if there are no child nodes]
+  struct TreeNode *last = NULL;
+  if (count > 0) {
+    last = parent->children->nodes[count - 1];
+  }
+  // If the last child node matches the desired cargo
+  if ((last != NULL) && (last->value == value)) {
+    *position = count - 1;
+    return last;
+  }
+  // Else, if the new node belongs after the last child node
+  if ((last == NULL) || 
+      (STATS_STRCMP(last->value->text, value->text) < 0)) {
+    *position = count;
+    return NULL;
+  }
+  // Else, the images were not inserted in sorted order
+  return helper_find_child(parent, value, position);
+}
+
+/**
+ *  A helper function that lays the cargo of an image out in the order of
+ *  the depth levels of a tree.
+ *
+ *  @param order The attribute held by each attribute depth level.
+ *  @param image The image.
+ *  @param keys Set to the cargo of every depth level.
+ **/
+void helper_image_levels(const int *order, const struct TreeImage *image,
+			 const struct InternedString **keys) {
+  int depth_level;
+  for (depth_level = 0; depth_level < NUM_LEVELS; depth_level++) {
+    keys[depth_level] = 
+      image->values[helper_attribute(order, depth_level)];
+  }
+}
+
+/**
+ *  A helper function that inserts an image into a tree, assuming images 
+ *  mostly arrive in the order of the depth levels. Each node is first 
+ *  compared with its last sibling node, and only searched for otherwise; 
+ *  the missing depth levels are then connected as one new branch, usually
+ *  appended after its last sibling node.
  *
- *  @param tree A pointer to the root of the tree.
- *  @param values An array, whose first three members are the attribute 
- *  values for the image and the last one is the filename
+ *  @param tree A pointer to the tree.
+ *  @param keys The interned cargo of every depth level of the image.
  **/
-void tree_insert(struct TreeNode *root, char **values) {
-  // If root node is empty
-  if (root->child == NULL) {
-    // We must add 4 new nodes into the database [Attributes 1-3; filename]
-    helper_tree_insert_children(root, values, 4);
+void helper_append_levels(struct Tree *tree, 
+			  const struct InternedString **keys) {
+  // Holds the nodes of the image that exist. Starts at the root node of 
+  // the tree
+  struct TreeNode *path[NUM_LEVELS + 1];
+  // Holds the current depth level
+  int depth_level;
+  // Holds the sorted position of the child node of each depth level (or 
+  // where it belongs)
+  int positions[NUM_LEVELS];
+  // Move down the depth levels until one lacks the required cargo
+  path[0] = &tree->root;
+  for (depth_level = 0; depth_level < NUM_LEVELS; depth_level++) {
+    path[depth_level + 1] = helper_append_find(path[depth_level], 
+					       keys[depth_level],
+					       &positions[depth_level]);
+    if (path[depth_level + 1] == NULL) {
+      break;
+    }
+  }
+  // Connect the rest of the image, unless it is a duplicate
+  if (depth_level < NUM_LEVELS) {
+    helper_insert_branch(tree, path, positions, keys, depth_level);
+  }
+}
+
+/**
+ *  Insert an image into a tree, assuming images mostly arrive in sorted
+ *  order.
+ *
+ *  @param tree A pointer to the tree.
+ *  @param image The image to insert.
+ **/
+void tree_append(struct Tree *tree, const struct TreeImage *image) {
+  // Holds the cargo of every depth level
+  const struct InternedString *keys[NUM_LEVELS];
+  helper_image_levels(tree->order, image, keys);
+  helper_append_levels(tree, keys);
+}
+
+/**
+ *  Insert many images into a tree at once. The images are sorted first, so
+ *  that every node is appended after its last sibling node instead of being
+ *  searched for. Duplicate images are dropped, as with tree_insert.
+ *
+ *  @param tree A pointer to the tree.
+ *  @param images The images to insert. Their cargo is laid out in the order
+ *  of the depth levels, and the array is sorted, in place.
+ *  @param num_images The number of images.
+ **/
+void tree_bulk_insert(struct Tree *tree, struct TreeImage *images, 
+		      size_t num_images) {
+  // Holds the cargo of an image in the order of the depth levels
+  const struct InternedString *keys[NUM_LEVELS];
+  // Holds the current image
+  size_t i;
+  // Sort the images once, by the cargo of the depth levels
+  for (i = 0; i < num_images; i++) {
+    helper_image_levels(tree->order, &images[i], keys);
+    memcpy(images[i].values, keys, sizeof(keys));
   }
-  // Else, move on to next node depth level
+  qsort(images, num_images, sizeof(struct TreeImage), helper_compare_images);
+  // Build the tree in sorted order
+  for (i = 0; i < num_images; i++) {
+    helper_append_levels(tree, images[i].values);
+  }
+}
+
+/**
+ *  A helper function that disconnects a child node from its parent node, 
+ *  both from the sorted sibling node list and from the sorted child node
+ *  index. The node itself is left as it is, so a reader standing on it can
+ *  still move on to its sibling node.
+ *
+ *  @param tree A pointer to the tree.
+ *  @param parent The node to lose a child node.
+ *  @param position The sorted position of the child node.
+ **/
+void helper_remove_child(struct Tree *tree, struct TreeNode *parent,
+			 int position) {
+  struct TreeNode *node = parent->children->nodes[position];
+  // If the node is the first sibling node
+  if (position == 0) {
+    ATOMIC_PUBLISH(parent->child, node->sibling);
+  }
+  // Else, link its smaller sibling node past it
   else {
-    // Indicates if a new sibling was inserted. Assume no sibling was inserted
-    int is_new_sibling = 0;
-    // Holds the node used for transfers to the next node depth level
-    struct TreeNode *main_transfer_node = root->child;
-    // Insert Attribute 1 (A1) sibling node
-    struct TreeNode *attribute_1;
-    attribute_1 = helper_tree_insert_sibling(main_transfer_node,
-					     values[1], &is_new_sibling);
-    // If a new sibling was inserted
-    if (is_new_sibling == 1) {
-      // We require 3 new children in the database [Attributes 2-3; filename]
-      helper_tree_insert_children(attribute_1, values, 3);
-    }
-    // Else, move on to the next node depth level 
-    // (Dupicate A1 was present in database)
-    else {
-      main_transfer_node = attribute_1->child;
-      // Insert Attribute 2 (A2) sibling node
-      struct TreeNode *attribute_2;
-      attribute_2 = helper_tree_insert_sibling(main_transfer_node,
-					       values[2], &is_new_sibling);
-      // If a new sibling was inserted
-      if (is_new_sibling == 1) {
-	// We require 2 new children in the database [Attribute 3; filename]
-	helper_tree_insert_children(attribute_2, values, 2);
+    ATOMIC_PUBLISH(parent->children->nodes[position - 1]->sibling, 
+		   node->sibling);
+  }
+  // Drop the node from the child node index
+  nodes_remove(&parent->children, position, &tree->epochs);
+}
+
+/**
+ *  A helper function that releases a disconnected node and every node 
+ *  below it: each leaves the attribute indexes, drops its hold on its 
+ *  cargo, and is retired along with its child node index. Nodes below are
+ *  released first, since leaving an index walks up through their parent
+ *  nodes.
+ *
+ *  @param tree A pointer to the tree.
+ *  @param node The node.
+ *  @param depth_level The depth level of the node [0 for the first].
+ *  @return The number of images [Filename nodes] released.
+ **/
+size_t helper_release_branch(struct Tree *tree, struct TreeNode *node,
+			     int depth_level) {
+  // Holds the number of images to be returned
+  size_t result = 0;
+  // Holds the current child node index
+  size_t i;
+  // If the node is a filename node, it is an image
+  if (depth_level == NUM_LEVELS - 1) {
+    result = 1;
+  }
+  // Else, release the nodes below it, then take it out of its index
+  else {
+    for (i = 0; i < node->children->count; i++) {
+      result += helper_release_branch(tree, node->children->nodes[i],
+				      depth_level + 1);
+    }
+    index_remove(&tree->indexes[depth_level], node);
+    // A node of the last attribute depth level is an attribute tuple
+    if (depth_level == NUM_ATTRIBUTES - 1) {
+      filter_remove(&tree->filter);
+    }
+  }
+  nodes_reset(&node->children, 0, &tree->epochs);
+  intern_release(&tree->strings, node->value);
+  epoch_retire(&tree->epochs, node, sizeof(struct TreeNode));
+  return result;
+}
+
+/**
+ *  A helper function that deletes every image below a path of cargo from
+ *  the root node. Nodes left without child nodes are pruned, up to the 
+ *  root node.
+ *
+ *  @param tree A pointer to the tree.
+ *  @param keys The interned cargo of the path.
+ *  @param num_levels The number of depth levels of the path [0 deletes 
+ *  every image].
+ *  @return The number of images deleted.
+ **/
+long helper_delete_path(struct Tree *tree, 
+			const struct InternedString **keys, int num_levels) {
+  // Holds the path of nodes from the root node, and their positions among
+  // their sibling nodes
+  struct TreeNode *path[NUM_LEVELS + 1];
+  int positions[NUM_LEVELS];
+  // Holds the current depth level
+  int depth_level;
+  // Holds the number of images deleted
+  long result = 0;
+  // Find the path to the branch [Nothing to delete if it is missing]
+  path[0] = &tree->root;
+  for (depth_level = 0; depth_level < num_levels; depth_level++) {
+    path[depth_level + 1] = helper_find_child(path[depth_level], 
+					      keys[depth_level],
+					      &positions[depth_level]);
+    if (path[depth_level + 1] == NULL) {
+      return 0;
+    }
+  }
+  // If every image is deleted, release the first depth level nodes one by 
+  // one, from the last
+  if (num_levels == 0) {
+    while (tree->root.children->count > 0) {
+      path[1] = tree->root.children->nodes[tree->root.children->count - 1];
+      helper_remove_child(tree, &tree->root, 
+			  tree->root.children->count - 1);
+      result += helper_release_branch(tree, path[1], 0);
+    }
+    ATOMIC_PUBLISH(tree->root.num_images, 0);
+    tree->num_images = 0;
+    filter_collect(&tree->filter, tree);
+    return result;
+  }
+  // Disconnect the branch, then release it
+  helper_remove_child(tree, path[num_levels - 1], 
+		      positions[num_levels - 1]);
+  result = helper_release_branch(tree, path[num_levels], num_levels - 1);
+  helper_count_path(path, positions, num_levels - 1, -result);
+  // Prune every node above it that was left without child nodes
+  for (depth_level = num_levels - 1; 
+       (depth_level > 0) && (path[depth_level]->children->count == 0); 
+       depth_level--) {
+    helper_remove_child(tree, path[depth_level - 1], 
+			positions[depth_level - 1]);
+    helper_release_branch(tree, path[depth_level], depth_level - 1);
+  }
+  tree->num_images -= result;
+  filter_collect(&tree->filter, tree);
+  return result;
+}
+
+/**
+ *  A helper function that collects the paths of cargo to every node of a 
+ *  depth level whose path matches the given cargo.
+ *
+ *  @param node The node whose child nodes are to be searched.
+ *  @param depth_level The depth level of its child nodes.
+ *  @param keys The cargo required at each depth level [NULL if any cargo
+ *  matches].
+ *  @param num_levels The number of depth levels of the paths.
+ *  @param path Holds the cargo of the path to the node.
+ *  @param paths Holds the paths found so far. Grown as needed.
+ *  @param num_paths The number of paths found so far.
+ *  @param capacity The number of paths the array has room for.
+ **/
+void helper_collect_paths(const struct TreeNode *node, int depth_level,
+			  const struct InternedString **keys, int num_levels,
+			  struct TreeImage *path, struct TreeImage **paths,
+			  size_t *num_paths, size_t *capacity) {
+  // Holds the current child node
+  const struct TreeNode *child;
+  int position;
+  // If the path is complete, store it
+  if (depth_level == num_levels) {
+    if (*num_paths == *capacity) {
+      *capacity = (*capacity > 0) ? (*capacity * 2) : 16;
+      *paths = realloc(*paths, sizeof(struct TreeImage) * *capacity);
+      if (*paths == NULL) {
+	perror("realloc");
+	exit(1);
       }
-      // Else, move on to the next node depth level 
-      // (Dupicate A2 was present in database)
-      else {
-	main_transfer_node = attribute_2->child;
-	// Insert Attribute 3 (A3) sibling node
-	struct TreeNode *attribute_3;
-	attribute_3 = helper_tree_insert_sibling(main_transfer_node,
-						 values[3], &is_new_sibling);
-	// If a new sibling was inserted
-	if (is_new_sibling == 1) {
-	  // We require 1 new child in the database [filename]
-	  helper_tree_insert_children(attribute_3, values, 1);
-	}
-	// Else, move on to the next node depth level
-	// (Dupicate A3 was present in database)
-	else {
-	  main_transfer_node = attribute_3->child;
-	  // Insert filename sibling node
-	  helper_tree_insert_sibling(main_transfer_node, values[4], 
-				     &is_new_sibling);
-	  // If no new sibling was inserted, duplicate filename was present
-	  // in database
-	}
+    }
+    (*paths)[(*num_paths)++] = *path;
+    return;
+  }
+  // If specific cargo is required, only its node can match
+  if (keys[depth_level] != NULL) {
+    child = helper_find_child(node, keys[depth_level], &position);
+    if (child != NULL) {
+      path->values[depth_level] = child->value;
+      helper_collect_paths(child, depth_level + 1, keys, num_levels, path,
+			   paths, num_paths, capacity);
+    }
+  }
+  // Else, every child node matches
+  else {
+    for (child = node->child; child != NULL; child = child->sibling) {
+      path->values[depth_level] = child->value;
+      helper_collect_paths(child, depth_level + 1, keys, num_levels, path,
+			   paths, num_paths, capacity);
+    }
+  }
+}
+
+/**
+ *  Delete an image, or every image below a path of attribute values, from
+ *  a tree. Nodes left without child nodes are pruned, up to the root node,
+ *  and their memory goes back to the arena as soon as no reader can hold 
+ *  it. Sibling nodes stay in sorted order. Should a planned order put a *
+ *  above an exact value, the matching branches are found first, then 
+ *  deleted one by one.
+ *
+ *  @param tree A pointer to the tree.
+ *  @param values The tokens of a DELETE OPERATION. Trailing values may be
+ *  * (any value), to delete a whole branch; * alone deletes every image.
+ *  @return The number of images deleted, or -1 if a value follows a *.
+ **/
+long tree_delete(struct Tree *tree, char **values) {
+  // Holds the interned cargo of every depth level [NULL for *]
+  const struct InternedString *keys[NUM_LEVELS];
+  // Holds the number of depth levels down to the last exact value, and 
+  // the number of values before the first *
+  int num_levels = 0;
+  int num_exact = 0;
+  // Holds the current depth level [OR] value
+  int depth_level;
+  // Holds the paths of the matching branches
+  struct TreeImage path;
+  struct TreeImage *paths = NULL;
+  size_t num_paths = 0;
+  size_t capacity = 0;
+  size_t i;
+  // Holds the number of images deleted
+  long result = 0;
+  // Only trailing values may be *
+  num_exact = tree_check_delete(values);
+  if (num_exact == -1) {
+    return -1;
+  }
+  // Look the values up in the order of the depth levels [Nothing to delete
+  // if a value is in no node]
+  for (depth_level = 0; depth_level < NUM_LEVELS; depth_level++) {
+    keys[depth_level] = NULL;
+    if (helper_attribute(tree->order, depth_level) < num_exact) {
+      keys[depth_level] = 
+	intern_find(&tree->strings, 
+		    values[helper_attribute(tree->order, depth_level) + 1]);
+      if (keys[depth_level] == NULL) {
+	return 0;
       }
+      num_levels = depth_level + 1;
     }
-    // Sort the modified database:
-    // Starting root is the main database root's child [Attribute 1 (A1)]
-    database_sort(root->child, root);
   }
+  // If the exact values lead the depth levels, delete their branch
+  if (num_levels == num_exact) {
+    return helper_delete_path(tree, keys, num_levels);
+  }
+  // Else, delete every branch down to the last exact value that matches
+  helper_collect_paths(&tree->root, 0, keys, num_levels, &path, &paths,
+		       &num_paths, &capacity);
+  // The cargo of a path stays held by its nodes until the path is deleted
+  for (i = 0; i < num_paths; i++) {
+    result += helper_delete_path(tree, paths[i].values, num_levels);
+  }
+  free(paths);
+  return result;
 }
 
 /**
- *  Searches a tree to print all files with matching attribute values.
+ *  Check the tokens of a DELETE OPERATION, of which only trailing values 
+ *  may be * (any value).
  *
- *  @param tree A pointer to the root of the tree.
- *  @param values An array of attribute values
+ *  @param values The tokens of the DELETE OPERATION.
+ *  @return The number of values before the first *; -1 if a value follows
+ *  a *.
  **/
-void tree_search(const struct TreeNode *root, char **values) {
-  // Node detector. Assume that we have not yet found our required value
-  int is_node_found = 0;
+int tree_check_delete(char **values) {
+  // Holds the number of values before the first *
+  int result = 0;
+  // Holds the current value
+  int i;
+  while ((result < NUM_LEVELS) && 
+	 (strcmp(values[result + 1], MATCH_ANY) != 0)) {
+    result++;
+  }
+  for (i = result; i < NUM_LEVELS; i++) {
+    if (strcmp(values[i + 1], MATCH_ANY) != 0) {
+      return -1;
+    }
+  }
+  return result;
+}
+
+/**
+ *  A helper function that rebuilds the child node index of a node and of all
+ *  nodes below it from their sibling node lists.
+ *
+ *  @param tree A pointer to the tree.
+ *  @param root The node whose child node index is to be rebuilt.
+ **/
+void helper_reindex_children(struct Tree *tree, struct TreeNode *root) {
+  // Holds the current child node
+  struct TreeNode *node;
+  // Start a new index with room for every child node
+  nodes_reset(&root->children, root->children->count, &tree->epochs);
+  // Go through the child nodes in their (sorted) sibling node order
+  for (node = root->child; node != NULL; node = node->sibling) {
+    nodes_insert(&root->children, root->children->count, node, 
+		 &tree->epochs);
+    // Rebuild the index of the next depth level
+    helper_reindex_children(tree, node);
+  }
+}
+
+/**
+ *  Sorts all nodes of a tree. Only required as a one-off repair, since
+ *  tree_insert keeps the tree sorted. Unlike inserts, the repair must not
+ *  run while readers are active.
+ *
+ *  @param tree A pointer to the tree.
+ **/
+void tree_sort(struct Tree *tree) {
+  // Holds the root node of the tree
+  struct TreeNode *root = &tree->root;
   // If database is not empty
   if (root->child != NULL) {
-    // Move on to depth level 1 nodes (Attribute 1) A1 
-    root = root->child;
-    // Keep going through sibling nodes until we find the required A1 [OR] 
-    // until we hit NULL
-    while ((root != NULL) && (!is_node_found)) {
-      // If this is the node we are looking for
-      if (strcmp(root->value, values[1]) == 0) {
-	// Node search is complete
-	is_node_found = 1;
+    // Starting root is the main database root's child [Attribute 1 (A1)]
+    database_sort(root->child, root);
+    // The sort rewires sibling nodes only, so rebuild the child node index
+    helper_reindex_children(tree, root);
+  }
+}
+
+/**
+ *  A helper function that finds the first child node of a node that is not
+ *  below the range of a match, using a binary search over the sorted child
+ *  node index.
+ *
+ *  @param children The child node index of the node.
+ *  @param num_children The number of child nodes in the index.
+ *  @param match The match.
+ *  @param is_beyond 0 to find the first child node not below the range; 1
+ *  to find the first child node beyond the range.
+ *  @return The index of the child node [num_children if there is none].
+ **/
+int helper_seek_child(const struct NodeArray *children, size_t num_children,
+		      const struct AttributeMatch *match, int is_beyond) {
+  // Holds the search range [low, high)
+  int low = 0;
+  int high = num_children;
+  const char *text;
+  // Keep halving the search range until it is empty
+  while (low < high) {
+    int middle = low + ((high - low) / 2);
+    text = children->nodes[middle]->value->text;
+    STATS_COUNT(STATS_NODES_VISITED, 1);
+    // If the middle node is still before the required node, search the 
+    // upper half
+    if ((is_beyond) ? (!match_is_beyond(match, text)) : 
+	(match_is_below(match, text))) {
+      low = middle + 1;
+    }
+    // Else, search the lower half
+    else {
+      high = middle;
+    }
+  }
+  return low;
+}
+
+/**
+ *  A helper function that checks if a node holds cargo required by a 
+ *  cursor.
+ *
+ *  @param cursor The cursor.
+ *  @param depth_level The depth level of the node.
+ *  @param node The node.
+ *  @return 1 if the node matches; 0 otherwise.
+ **/
+int helper_cursor_matches(const struct TreeCursor *cursor, int depth_level,
+			  const struct TreeNode *node) {
+  // Interned cargo is recognized by its address
+  if (cursor->keys[depth_level] != NULL) {
+    return cursor->keys[depth_level] == node->value;
+  }
+  return (!match_is_below(&cursor->matches[depth_level], node->value->text) &&
+	  !match_is_beyond(&cursor->matches[depth_level], node->value->text));
+}
+
+/**
+ *  A helper function that finds the first child node of the current node of
+ *  a cursor that matches the cargo required at the next depth level.
+ *
+ *  @param cursor The cursor.
+ *  @param depth_level The depth level of the required child node.
+ *  @return The first matching child node, or NULL if there is none.
+ **/
+const struct TreeNode *helper_cursor_first(const struct TreeCursor *cursor,
+					   int depth_level) {
+  // Holds the node whose child nodes are to be searched
+  const struct TreeNode *parent = (depth_level == 0) ? cursor->root : 
+    cursor->path[depth_level - 1];
+  // Holds the node to be returned. Assume no child node matches
+  const struct TreeNode *result = NULL;
+  // Holds the child node index [Loaded once, as the writer may replace it]
+  const struct NodeArray *children;
+  size_t num_children;
+  // Holds the position of the required node
+  int position;
+  // If a specific cargo is required, find it with a binary search
+  if (cursor->keys[depth_level] != NULL) {
+    result = helper_find_child(parent, cursor->keys[depth_level], &position);
+  }
+  // Else, if any cargo matches, start at the first child node
+  else if (cursor->matches[depth_level].lower_length == 0) {
+    result = ATOMIC_READ(parent->child);
+  }
+  // Else, seek to the first child node in the range of cargo
+  else {
+    children = ATOMIC_READ(parent->children);
+    num_children = ATOMIC_READ(children->count);
+    position = helper_seek_child(children, num_children, 
+				 &cursor->matches[depth_level], 0);
+    if (position < num_children) {
+      result = children->nodes[position];
+    }
+  }
+  // The range of cargo may end before the node
+  if ((result != NULL) && 
+      (match_is_beyond(&cursor->matches[depth_level], result->value->text))) {
+    result = NULL;
+  }
+  return result;
+}
+
+/**
+ *  A helper function that moves a cursor to the next node of its postings
+ *  whose parent nodes hold the cargo required by the cursor. The path of 
+ *  the cursor is set up to that node.
+ *
+ *  @param cursor The cursor.
+ *  @return The depth level below the node, whose nodes must be found next;
+ *  -1 if the postings are exhausted.
+ **/
+int helper_cursor_pin(struct TreeCursor *cursor) {
+  // Holds the depth level to be returned. Assume the postings are exhausted
+  int result = -1;
+  // Holds the current depth level
+  int depth_level;
+  // Holds the node found at the current depth level
+  const struct TreeNode *node;
+  // Keep taking nodes off the postings until one matches
+  while ((result == -1) && 
+	 (cursor->next_posting < cursor->num_postings)) {
+    node = cursor->postings->nodes[cursor->next_posting++];
+    // Walk up the parent nodes and check their cargo
+    for (depth_level = cursor->pinned_level; depth_level >= 0; 
+	 depth_level--) {
+      cursor->path[depth_level] = node;
+      STATS_COUNT(STATS_NODES_VISITED, 1);
+      if (!helper_cursor_matches(cursor, depth_level, node)) {
+	break;
       }
-      // If we have not yet found our node
-      if (!is_node_found) {
-	// Move on to the next sibling node
-      root = root->sibling;
+      node = node->parent;
+    }
+    // If every parent node matched
+    if (depth_level < 0) {
+      result = cursor->pinned_level + 1;
+    }
+  }
+  return result;
+}
+
+/**
+ *  A helper function that moves a cursor on to the next matching sibling 
+ *  node at the given depth level, or at the closest depth level above it 
+ *  that has one.
+ *
+ *  @param cursor The cursor.
+ *  @param depth_level The depth level to advance first.
+ *  @return The depth level below the node that was advanced, whose nodes
+ *  must be found again; -1 if no depth level [OR] posting can be advanced.
+ **/
+int helper_cursor_advance(struct TreeCursor *cursor, int depth_level) {
+  // Holds the depth level to be returned. Assume no depth level can be 
+  // advanced
+  int result = -1;
+  // Holds the next sibling node [NULL if only one cargo matches]
+  const struct TreeNode *sibling;
+  // Keep moving up the depth levels until a sibling node is found [OR] 
+  // until we reach the depth levels pinned by an index
+  while ((depth_level > cursor->pinned_level) && (result == -1)) {
+    // If more than one cargo matches at this depth level, and a sibling 
+    // node exists within the range of cargo
+    sibling = (cursor->keys[depth_level] == NULL) ? 
+      ATOMIC_READ(cursor->path[depth_level]->sibling) : NULL;
+    if ((sibling != NULL) &&
+	(!match_is_beyond(&cursor->matches[depth_level], 
+			  sibling->value->text))) {
+      // Move on to the sibling node
+      cursor->path[depth_level] = sibling;
+      STATS_COUNT(STATS_NODES_VISITED, 1);
+      result = depth_level + 1;
+    }
+    // Else, move up to the previous depth level
+    else {
+      depth_level--;
+    }
+  }
+  // If the nodes below a posting are exhausted, move on to the next one
+  if ((result == -1) && (cursor->postings != NULL)) {
+    result = helper_cursor_pin(cursor);
+  }
+  return result;
+}
+
+/**
+ *  Open a cursor over the images of a tree, in the order of its depth 
+ *  levels [Sorted, unless the tree is planned]. The cursor holds only one 
+ *  node per depth level, so it uses O(depth) memory however many images it
+ *  returns, and can be paused and resumed at will. Inserts and deletes may
+ *  happen while it is open; their images may or may not be returned.
+ *
+ *  @param cursor The cursor.
+ *  @param tree A pointer to the tree.
+ *  @param values The tokens of a QUERY OPERATION, whose attribute values 
+ *  every image must match [See match_parse]; NULL to return every image.
+ **/
+void cursor_open(struct TreeCursor *cursor, const struct Tree *tree,
+		 char **values) {
+  // Holds the current depth level
+  int depth_level;
+  // Holds the postings of the current depth level
+  const struct NodeArray *postings;
+  size_t num_postings;
+  // Holds the first depth level node index, and the number of its nodes in
+  // the range of cargo
+  const struct NodeArray *children = ATOMIC_READ(tree->root.children);
+  size_t num_children = ATOMIC_READ(children->count);
+  size_t num_candidates;
+  cursor->root = &tree->root;
+  cursor->order = tree->order;
+  cursor->postings = NULL;
+  cursor->num_postings = 0;
+  cursor->next_posting = 0;
+  cursor->pinned_level = -1;
+  cursor->next_level = NUM_LEVELS - 1;
+  cursor->is_started = 0;
+  cursor->is_done = 0;
+  // Any filename matches
+  cursor->keys[NUM_ATTRIBUTES] = NULL;
+  match_parse(&cursor->matches[NUM_ATTRIBUTES], MATCH_ANY);
+  // Store the attribute values every image must match, in the order of the
+  // depth levels
+  for (depth_level = 0; depth_level < NUM_ATTRIBUTES; depth_level++) {
+    const char *value = (values != NULL) ? 
+      values[tree->order[depth_level] + 1] : MATCH_ANY;
+    cursor->keys[depth_level] = NULL;
+    match_parse(&cursor->matches[depth_level], value);
+    // Exact cargo is looked up by its interned copy
+    if (cursor->matches[depth_level].is_exact) {
+      cursor->keys[depth_level] = intern_find(&tree->strings, value);
+      // An attribute that was never interned is in no node
+      if (cursor->keys[depth_level] == NULL) {
+	cursor->is_done = 1;
       }
     }
-    // If we found the required node
-    if (is_node_found) {
-      // Reset our node detector
-      is_node_found = 0;
-      // Move on to depth level 2 nodes (Attribute 2) A2
-      root = root->child;
-      // Keep going through sibling nodes until we find the required A2 [OR]
-      // until we hit NULL
-      while ((root != NULL) && (!is_node_found)) {
-	// If this is the node we are looking for
-	if (strcmp(root->value, values[2]) == 0) {
-	  // Node search is complete
-	  is_node_found = 1;
-	}
-	// If we have not yet found our node
-	if (!is_node_found) {
-	  // Move on to the next sibling node
-	  root = root->sibling;
-	}
+  }
+  // Find the first depth level from which every depth level matches any
+  // cargo [Any filename matches]
+  cursor->any_level = NUM_ATTRIBUTES;
+  while ((cursor->any_level > 0) && 
+	 (match_is_any(&cursor->matches[cursor->any_level - 1]))) {
+    cursor->any_level--;
+  }
+  // If the first depth level is not exact, walking down from the root node
+  // visits every one of its nodes in range. Start from the indexed nodes of
+  // the most selective later attribute instead, if there are fewer of them
+  num_candidates = helper_seek_child(children, num_children, 
+				     &cursor->matches[0], 1) -
+    helper_seek_child(children, num_children, &cursor->matches[0], 0);
+  for (depth_level = 1; (depth_level < NUM_ATTRIBUTES) && 
+	 (cursor->keys[0] == NULL) && (!cursor->is_done); depth_level++) {
+    if (cursor->keys[depth_level] != NULL) {
+      postings = index_find(&tree->indexes[depth_level], 
+			    cursor->keys[depth_level]);
+      num_postings = (postings != NULL) ? ATOMIC_READ(postings->count) : 0;
+      // If no node of this depth level holds the attribute
+      if (num_postings == 0) {
+	cursor->is_done = 1;
+      }
+      else if ((num_postings < num_candidates) &&
+	       ((cursor->postings == NULL) || 
+		(num_postings < cursor->num_postings))) {
+	cursor->postings = postings;
+	cursor->num_postings = num_postings;
+	cursor->pinned_level = depth_level;
       }
-      // If we found the required node
-      if (is_node_found) {
-	// Reset our node detector
-	is_node_found = 0;
-	// Move on to depth level 3 nodes (Attribute 3) A3
-	root = root->child;
-	// Keep going through sibling nodes until we find the required A3 [OR]
-	// until we hit NULL
-	while ((root != NULL) && (!is_node_found)) {
-	  // If this is the node we are looking for
-	  if (strcmp(root->value, values[3]) == 0) {
-	    // Node search is complete
-	    is_node_found = 1;
-	  }
-	  // If we have not yet found our node
-	  if (!is_node_found) {
-	    // Move on to the next sibling node
-	    root = root->sibling;
-	  }
-	}
-	// If we found the required node
-	if (is_node_found) {
-	  // Move on to depth level 4 nodes (filename)
-	  root = root->child;
-	  // Keep going through sibling nodes until we hit NULL
-	  while (root != NULL) {
-	    // If next sibling node does not exists
-	    if (root->sibling == NULL) {
-	      // Output current filename without trailing space
-	      printf("%s", root->value);
-	    }
-	    // Else, output current filename with trailing space
-	    else {
-	      printf("%s ", root->value);
-	    }
-	    // Move on to the next sibling node
-	    root = root->sibling;
-	  }
-	  // Add newline character at end of output
-	  printf("\n");
-	}
+    }
+  }
+}
+
+/**
+ *  Return the next image of a cursor.
+ *
+ *  @param cursor The cursor.
+ *  @param image Set to the next image.
+ *  @return 1 if an image was returned; 0 if the cursor is exhausted.
+ **/
+int cursor_next(struct TreeCursor *cursor, struct TreeImage *image) {
+  // Holds the depth level whose node must be found next
+  int depth_level;
+  // Holds the node found at the current depth level
+  const struct TreeNode *node;
+  // If the cursor is exhausted
+  if (cursor->is_done) {
+    return 0;
+  }
+  // If this is the first image, start at the first depth level [OR] below
+  // the first matching node of the postings
+  if (!cursor->is_started) {
+    cursor->is_started = 1;
+    depth_level = (cursor->postings != NULL) ? helper_cursor_pin(cursor) : 0;
+  }
+  // Else, move on from the previous filename [OR] from the branch skipped
+  // last
+  else {
+    depth_level = helper_cursor_advance(cursor, cursor->next_level);
+    cursor->next_level = NUM_LEVELS - 1;
+  }
+  // Keep descending until we reach a filename [OR] until no depth level can
+  // be advanced
+  while ((depth_level >= 0) && (depth_level < NUM_LEVELS)) {
+    node = helper_cursor_first(cursor, depth_level);
+    // If a matching node exists, descend to it
+    if (node != NULL) {
+      cursor->path[depth_level] = node;
+      STATS_COUNT(STATS_NODES_VISITED, 1);
+      depth_level++;
+    }
+    // Else, move on to the next node above
+    else {
+      depth_level = helper_cursor_advance(cursor, depth_level - 1);
+    }
+  }
+  // If no depth level could be advanced, the cursor is exhausted
+  if (depth_level < 0) {
+    cursor->is_done = 1;
+    return 0;
+  }
+  // Store the cargo of the path to the filename, in attribute order
+  for (depth_level = 0; depth_level < NUM_LEVELS; depth_level++) {
+    image->values[helper_attribute(cursor->order, depth_level)] = 
+      cursor->path[depth_level]->value;
+  }
+  return 1;
+}
+
+/**
+ *  A helper function that moves a cursor past the sibling nodes that follow
+ *  its node at a depth level, as many as hold no more than a number of 
+ *  images, by the counts of the child node index of the node above: the 
+ *  images up to its node are added up, and the nodes holding those plus 
+ *  the number found, each in O(log n). Sibling nodes are only moved past up
+ *  to the end of the range of cargo of the depth level, so every image 
+ *  below the depth level must match.
+ *
+ *  @param cursor The cursor.
+ *  @param depth_level The depth level.
+ *  @param num_images The number of images.
+ *  @return The number of images of the sibling nodes moved past. The cursor
+ *  is left on the last of them.
+ **/
+size_t helper_cursor_jump(struct TreeCursor *cursor, int depth_level,
+			  size_t num_images) {
+  // Holds the node whose child nodes are to be searched
+  const struct TreeNode *parent = (depth_level == 0) ? cursor->root : 
+    cursor->path[depth_level - 1];
+  // Holds the child node index [Loaded once, as the writer may replace it]
+  const struct NodeArray *children = ATOMIC_READ(parent->children);
+  size_t num_children = ATOMIC_READ(children->count);
+  // Holds the position of the node of the cursor, and the number of nodes
+  // and images up to and past it
+  int position;
+  size_t end, base, sum;
+  if (!match_is_any(&cursor->matches[depth_level])) {
+    num_children = helper_seek_child(children, num_children, 
+				     &cursor->matches[depth_level], 1);
+  }
+  helper_find_child(parent, cursor->path[depth_level]->value, &position);
+  // If the writer moved the node since, do not move the cursor
+  if (((size_t) position >= num_children) || 
+      (children->nodes[position] != cursor->path[depth_level])) {
+    return 0;
+  }
+  base = nodes_prefix(children, position + 1);
+  end = nodes_seek(children, num_children, base + num_images, &sum);
+  STATS_COUNT(STATS_NODES_VISITED, 1);
+  if ((end <= (size_t) position + 1) || (sum < base)) {
+    return 0;
+  }
+  cursor->path[depth_level] = children->nodes[end - 1];
+  return sum - base;
+}
+
+/**
+ *  Move a cursor past a number of images without returning them. Wherever
+ *  every image below a node matches, the node is skipped whole by its 
+ *  count of images, and so are the sibling nodes after it in the range of 
+ *  cargo that the images left to skip cover, by the counts of the child 
+ *  node index above them. Skipping thus costs O(log n) per depth level from
+ *  the last one that requires specific cargo [OR] a range of it, however 
+ *  many images are skipped, plus a walk of the matching nodes above it.
+ *
+ *  @param cursor The cursor.
+ *  @param num_images The number of images to skip.
+ *  @return The number of images skipped [Fewer if the cursor ran out of 
+ *  images].
+ **/
+size_t cursor_skip(struct TreeCursor *cursor, size_t num_images) {
+  // Holds the number of images to be returned
+  size_t result = 0;
+  // Holds the depth level whose node must be found next
+  int depth_level;
+  // Holds the node found at the current depth level
+  const struct TreeNode *node;
+  // Holds the number of images below the node found last, if every one 
+  // of them matches [0 if not]
+  size_t count;
+  // If the cursor is exhausted [OR] there is nothing to skip
+  if ((cursor->is_done) || (num_images == 0)) {
+    return 0;
+  }
+  // If every image matches and is to be skipped, skip the root node whole
+  count = ATOMIC_READ(cursor->root->num_images);
+  if ((!cursor->is_started) && (cursor->any_level == 0) && 
+      (count <= num_images)) {
+    cursor->is_done = 1;
+    return count;
+  }
+  // Start [OR] move on, as cursor_next does
+  if (!cursor->is_started) {
+    cursor->is_started = 1;
+    depth_level = (cursor->postings != NULL) ? helper_cursor_pin(cursor) : 0;
+  }
+  else {
+    depth_level = helper_cursor_advance(cursor, cursor->next_level);
+    cursor->next_level = NUM_LEVELS - 1;
+  }
+  while ((depth_level >= 0) && (result < num_images)) {
+    count = 0;
+    if (depth_level == NUM_LEVELS) {
+      count = 1;
+    }
+    else if ((depth_level > 0) && (depth_level >= cursor->any_level)) {
+      count = ATOMIC_READ(cursor->path[depth_level - 1]->num_images);
+    }
+    // If every image below the node is to be skipped, move on past it, and
+    // past the sibling nodes after it that are as well [Unless its cargo 
+    // is the only one that matches]
+    if ((count > 0) && (count <= num_images - result)) {
+      result += count;
+      if ((result < num_images) && (cursor->keys[depth_level - 1] == NULL)) {
+	result += helper_cursor_jump(cursor, depth_level - 1, 
+				     num_images - result);
+      }
+      // If it is the last one, cursor_next moves on past it
+      if (result == num_images) {
+	cursor->next_level = depth_level - 1;
+	return result;
+      }
+      depth_level = helper_cursor_advance(cursor, depth_level - 1);
+    }
+    // Else, descend to the first matching node [OR] move on to the next 
+    // node above, as cursor_next does
+    else {
+      node = helper_cursor_first(cursor, depth_level);
+      if (node != NULL) {
+	cursor->path[depth_level] = node;
+	STATS_COUNT(STATS_NODES_VISITED, 1);
+	depth_level++;
+      }
+      else {
+	depth_level = helper_cursor_advance(cursor, depth_level - 1);
+      }
+    }
+  }
+  // If no depth level could be advanced, the cursor is exhausted
+  if (depth_level < 0) {
+    cursor->is_done = 1;
+  }
+  return result;
+}
+
+/**
+ *  Close a cursor. It returns no more images.
+ *
+ *  @param cursor The cursor.
+ **/
+void cursor_close(struct TreeCursor *cursor) {
+  cursor->is_done = 1;
+}
+
+/**
+ *  A helper function that adds the child nodes of a node, and the nodes 
+ *  below them, to the shape of a tree.
+ *
+ *  @param node The node.
+ *  @param depth_level The depth level of its child nodes.
+ *  @param shape The shape.
+ **/
+void helper_tree_shape(const struct TreeNode *node, int depth_level,
+		       struct StatsShape *shape) {
+  // Holds the current child node
+  const struct TreeNode *child;
+  shape->num_nodes[depth_level] += node->children->count;
+  if (node->children->count > shape->max_fanout[depth_level]) {
+    shape->max_fanout[depth_level] = node->children->count;
+  }
+  if (depth_level < NUM_LEVELS - 1) {
+    for (child = node->child; child != NULL; child = child->sibling) {
+      helper_tree_shape(child, depth_level + 1, shape);
+    }
+  }
+}
+
+/**
+ *  Count the nodes of each depth level of a tree, and find the largest 
+ *  number of child nodes of a node of the depth level above each.
+ *
+ *  @param tree A pointer to the tree.
+ *  @param shape Set to the shape of the tree.
+ **/
+void tree_shape(const struct Tree *tree, struct StatsShape *shape) {
+  memset(shape, 0, sizeof(struct StatsShape));
+  helper_tree_shape(&tree->root, 0, shape);
+  memcpy(shape->order, tree->order, sizeof(tree->order));
+}
+
+/**
+ *  A helper function that collects the remaining images of a cursor.
+ *
+ *  @param cursor The cursor.
+ *  @param num_images Set to the number of images.
+ *  @return The newly allocated images [NULL if there are none]. Must be 
+ *  released with free.
+ **/
+struct TreeImage *helper_collect_images(struct TreeCursor *cursor,
+					size_t *num_images) {
+  // Holds the images to be returned
+  struct TreeImage *result = NULL;
+  struct TreeImage image;
+  size_t capacity = 0;
+  *num_images = 0;
+  while (cursor_next(cursor, &image)) {
+    if (*num_images == capacity) {
+      capacity = (capacity > 0) ? (capacity * 2) : 16;
+      result = realloc(result, sizeof(struct TreeImage) * capacity);
+      if (result == NULL) {
+	perror("realloc");
+	exit(1);
       }
     }
+    result[(*num_images)++] = image;
+  }
+  return result;
+}
+
+/**
+ *  A helper function that checks if the depth levels of a tree are out of
+ *  attribute order, so its cursors return images out of sorted order.
+ *
+ *  @param tree A pointer to the tree.
+ *  @return 1 if the tree is planned; 0 otherwise.
+ **/
+int helper_is_planned(const struct Tree *tree) {
+  int depth_level;
+  for (depth_level = 0; depth_level < NUM_ATTRIBUTES; depth_level++) {
+    if (tree->order[depth_level] != depth_level) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/**
+ *  A helper function that opens a cursor for a QUERY [OR] PRINT OPERATION.
+ *  The images of a planned tree come out of its cursor in the order of its 
+ *  depth levels, so they are collected and sorted first, and its counts of
+ *  images cannot skip a sorted page: every page costs O(m log m) for m 
+ *  matching images, however small. The images of any other tree are 
+ *  walked as they are found.
+ *
+ *  @param cursor The cursor.
+ *  @param tree A pointer to the tree.
+ *  @param values The tokens of the QUERY OPERATION; NULL for PRINT.
+ *  @param num_images Set to the number of sorted images.
+ *  @return The newly allocated sorted images, or NULL if the images are to
+ *  be taken from the cursor. Must be released with free.
+ **/
+struct TreeImage *helper_open_sorted(struct TreeCursor *cursor,
+				     const struct Tree *tree, char **values,
+				     size_t *num_images) {
+  // Holds the images to be returned
+  struct TreeImage *result = NULL;
+  *num_images = 0;
+  cursor_open(cursor, tree, values);
+  if (helper_is_planned(tree)) {
+    result = helper_collect_images(cursor, num_images);
+    if (result != NULL) {
+      qsort(result, *num_images, sizeof(struct TreeImage), 
+	    helper_compare_images);
+    }
+  }
+  return result;
+}
+
+/**
+ *  A helper function that returns the next image in sorted order, from the
+ *  sorted images if there are any, or else from the cursor.
+ *
+ *  @param cursor The cursor.
+ *  @param images The sorted images [NULL to use the cursor].
+ *  @param num_images The number of sorted images.
+ *  @param next The index of the next sorted image.
+ *  @param image Set to the next image.
+ *  @return 1 if an image was returned; 0 if there are no more.
+ **/
+int helper_next_sorted(struct TreeCursor *cursor, 
+		       const struct TreeImage *images, size_t num_images, 
+		       size_t *next, struct TreeImage *image) {
+  if (images == NULL) {
+    return cursor_next(cursor, image);
+  }
+  if (*next < num_images) {
+    *image = images[(*next)++];
+    return 1;
+  }
+  return 0;
+}
+
+/**
+ *  A helper function that skips a number of images in sorted order, in the
+ *  sorted images if there are any, or else in the cursor.
+ *
+ *  @param cursor The cursor.
+ *  @param images The sorted images [NULL to use the cursor].
+ *  @param num_images The number of sorted images.
+ *  @param next The index of the next sorted image.
+ *  @param num_skipped The number of images to skip.
+ *  @return The number of images skipped.
+ **/
+size_t helper_skip_sorted(struct TreeCursor *cursor, 
+			  const struct TreeImage *images, size_t num_images,
+			  size_t *next, size_t num_skipped) {
+  if (images == NULL) {
+    return cursor_skip(cursor, num_skipped);
+  }
+  if (num_skipped > num_images - *next) {
+    num_skipped = num_images - *next;
+  }
+  *next += num_skipped;
+  return num_skipped;
+}
+
+/**
+ *  Searches a tree to print all files with matching attribute values, in
+ *  sorted order.
+ *
+ *  @param tree A pointer to the tree.
+ *  @param values An array of attribute values
+ *  @param output The sink to print to.
+ **/
+void tree_search(const struct Tree *tree, char **values, 
+		 struct Output *output) {
+  tree_search_page(tree, values, 0, PAGE_ALL, output);
+}
+
+/**
+ *  Searches a tree to print one page of the files with matching attribute
+ *  values, in sorted order. The files before the page are skipped by the
+ *  counts of images of the nodes, unless the tree is planned: its matching
+ *  images are then collected and sorted first, as for any QUERY OPERATION.
+ *
+ *  @param tree A pointer to the tree.
+ *  @param values An array of attribute values
+ *  @param offset The number of matching files before the page.
+ *  @param limit The largest number of files of the page [PAGE_ALL for 
+ *  every one].
+ *  @param output The sink to print to.
+ **/
+void tree_search_page(const struct Tree *tree, char **values, size_t offset,
+		      size_t limit, struct Output *output) {
+  // Walks the matching images
+  struct TreeCursor cursor;
+  // Holds the sorted images of a planned tree
+  struct TreeImage *images;
+  size_t num_images;
+  size_t next = 0;
+  // Holds the current image
+  struct TreeImage image;
+  // Holds the number of filenames skipped and printed
+  size_t num_skipped;
+  size_t num_printed = 0;
+  // Holds the verdict of the query filter
+  int is_possible = filter_check(&tree->filter, &tree->strings, values);
+  // If no image has the attribute tuple, the tree is not walked
+  if (is_possible == 0) {
+    output_puts(output, "(NULL)\n");
+    return;
+  }
+  images = helper_open_sorted(&cursor, tree, values, &num_images);
+  num_skipped = helper_skip_sorted(&cursor, images, num_images, &next, 
+				   offset);
+  // Output every matching filename of the page, separated by spaces
+  while ((num_printed < limit) && 
+	 (helper_next_sorted(&cursor, images, num_images, &next, &image))) {
+    if (num_printed > 0) {
+      output_putc(output, ' ');
+    }
+    output_append(output, image.values[NUM_ATTRIBUTES]->text, 
+		  image.values[NUM_ATTRIBUTES]->length);
+    num_printed++;
+  }
+  cursor_close(&cursor);
+  free(images);
+  // If we found the required node, add newline character at end of output
+  if (num_printed > 0) {
+    output_putc(output, '\n');
   }
   // If the node detector failed (i.e., no such info exists in database)
-  if (!is_node_found) {
+  else {
     // Output NULL
-    printf("(NULL)\n");
+    output_puts(output, "(NULL)\n");
+    if ((is_possible == 1) && (num_skipped == 0)) {
+      STATS_COUNT(STATS_FILTER_FALSE_POSITIVES, 1);
+    }
   }
 }
 
 /**
- *  Helper function to print all info in database, in sorted order.
+ *  Count the images of a tree with matching attribute values. Every node
+ *  all of whose images match is counted by its count of images, without 
+ *  walking below it [See cursor_skip].
  *
- *  @param tree The root node of the database.
- *  @param values Holds the required info to output. May hold:
- *  Attribute 1 (A1); Attribute 2 (A2); Attribute 3 (A3); Filename.
- *  @param depth_level Indicates the current depth level in the database tree.
- *  @return The next node to be checked for cargo.
+ *  @param tree A pointer to the tree.
+ *  @param values An array of attribute values
+ *  @return The number of matching images.
  **/
-struct TreeNode *helper_tree_print(struct TreeNode *tree, char **values, 
-				   int depth_level) {
-  // Holds the node to be returned
-  struct TreeNode *result;
-  // Store current node cargo based on current depth level
-  values[depth_level] = tree->value;
-  // If a child node exists
-  if (tree->child != NULL) {
-    // Recursive call: Obtain the next node cargo:
-    // We move on to the next child node and increment the depth level 
-    depth_level++;
-    result = helper_tree_print(tree->child, values, depth_level);
-  }
-  // If a child node does not exist
-  if (tree->child == NULL) {
-    // Output all stored cargo values
-    printf("%s %s %s %s\n", values[0], values[1], values[2], values[3]);
-  }
-  // If a sibling node exists
-  if (tree->sibling != NULL) {
-    // If a child node exists
-    if (tree->child != NULL) {
-      // Revert the previous depth level change
-      depth_level--;
-    }
-    // Recursive call: Obtain the next node cargo:
-    // We move on to the next sibling node and keep the current depth level
-    result = helper_tree_print(tree->sibling, values, depth_level);
+size_t tree_count(const struct Tree *tree, char **values) {
+  // Walks the matching images
+  struct TreeCursor cursor;
+  // Holds the number of images to be returned
+  size_t result;
+  // If no image has the attribute tuple, the tree is not walked
+  if (filter_check(&tree->filter, &tree->strings, values) == 0) {
+    return 0;
   }
-  // Returns the next node to be checked for cargo
+  cursor_open(&cursor, tree, values);
+  result = cursor_skip(&cursor, PAGE_ALL);
+  cursor_close(&cursor);
   return result;
 }
 
+/**
+ *  Size the query filter of a tree for a false positive rate, and rebuild
+ *  it from the attribute tuples of the tree.
+ *
+ *  @param tree A pointer to the tree.
+ *  @param rate The false positive rate [0 turns the filter off].
+ **/
+void tree_filter(struct Tree *tree, double rate) {
+  filter_rebuild(&tree->filter, tree, rate);
+}
+
+/**
+ *  Prints a complete tree, in sorted order.
+ *
+ *  @param tree A pointer to the tree.
+ *  @param output The sink to print to.
+ **/
+void tree_print(const struct Tree *tree, struct Output *output) {
+  tree_print_page(tree, 0, PAGE_ALL, output);
+}
 
 /**
- *  Prints a complete tree to the standard output.
+ *  Prints one page of the images of a tree, in sorted order. The images
+ *  before the page are skipped as with tree_search_page.
  *
- *  @param tree A pointer to the root of the tree.
+ *  @param tree A pointer to the tree.
+ *  @param offset The number of images before the page.
+ *  @param limit The largest number of images of the page [PAGE_ALL for 
+ *  every one].
+ *  @param output The sink to print to.
  **/
-void tree_print(const struct TreeNode *tree) {
-  // If database is empty
-  if (tree->child == NULL) {
+void tree_print_page(const struct Tree *tree, size_t offset, size_t limit,
+		     struct Output *output) {
+  // Walks every image
+  struct TreeCursor cursor;
+  // Holds the sorted images of a planned tree
+  struct TreeImage *images;
+  size_t num_images;
+  size_t next = 0;
+  // Holds the current image
+  struct TreeImage image;
+  // Holds the number of images printed
+  size_t num_printed = 0;
+  // Holds the current value
+  int i;
+  images = helper_open_sorted(&cursor, tree, NULL, &num_images);
+  helper_skip_sorted(&cursor, images, num_images, &next, offset);
+  while ((num_printed < limit) && 
+	 (helper_next_sorted(&cursor, images, num_images, &next, &image))) {
+    // Output the cargo of the image, separated by spaces
+    for (i = 0; i < NUM_LEVELS; i++) {
+      output_append(output, image.values[i]->text, 
+		    image.values[i]->length);
+      output_putc(output, (i < NUM_LEVELS - 1) ? ' ' : '\n');
+    }
+    num_printed++;
+  }
+  cursor_close(&cursor);
+  free(images);
+  // If database is empty [OR] the page is past its last image
+  if (num_printed == 0) {
     // Output NULL
-    printf("(NULL)\n");
+    output_puts(output, "(NULL)\n");
   }
-  // Else, output all info found in the database
-  else {
-    // Holds node cargo to be used for printing the output
-    char *values[4];
-    helper_tree_print(tree->child, values, 0);
+}
+
+/**
+ *  Prints the images below a first depth level node of a tree whose depth
+ *  levels are in attribute order, in sorted order. Together, the first 
+ *  depth level nodes print the complete tree, one block each.
+ *
+ *  @param tree A pointer to the tree.
+ *  @param node The first depth level node.
+ *  @param output The sink to print to.
+ **/
+void tree_print_branch(const struct Tree *tree, const struct TreeNode *node,
+		       struct Output *output) {
+  // Holds the current node at each depth level
+  const struct TreeNode *path[NUM_LEVELS];
+  // Holds the current depth level
+  int depth_level = 0;
+  // Holds the current value
+  int i;
+  path[0] = node;
+  while (depth_level >= 0) {
+    // Move down the first child nodes to the filename
+    for ( ; depth_level < NUM_LEVELS - 1; depth_level++) {
+      path[depth_level + 1] = ATOMIC_READ(path[depth_level]->child);
+    }
+    STATS_COUNT(STATS_NODES_VISITED, NUM_LEVELS);
+    // Output the cargo of the image, separated by spaces
+    for (i = 0; i < NUM_LEVELS; i++) {
+      output_append(output, path[i]->value->text, path[i]->value->length);
+      output_putc(output, (i < NUM_LEVELS - 1) ? ' ' : '\n');
+    }
+    // Move up to the closest depth level with a next sibling node [The 
+    // siblings of the first depth level node belong to other blocks]
+    while ((depth_level > 0) && 
+	   ((path[depth_level] = ATOMIC_READ(path[depth_level]->sibling)) ==
+	    NULL)) {
+      depth_level--;
+    }
+    if (depth_level == 0) {
+      depth_level = -1;
+    }
+  }
+}
+
+/**
+ *  Reorder the attribute depth levels of a tree by increasing number of 
+ *  distinct values, which the attribute indexes already count. With the 
+ *  fewest distinct values at the top, sibling lists are shortest where 
+ *  every lookup passes, and the most nodes are shared. If the order 
+ *  changes, every image is collected, the tree is emptied and the images 
+ *  are bulk inserted in the new order; the memory released is reused by 
+ *  the new nodes. Unlike inserts, this must not run while readers are 
+ *  active.
+ *
+ *  @param tree A pointer to the tree.
+ *  @return 1 if the tree was rebuilt; 0 if its order stands.
+ **/
+int tree_plan(struct Tree *tree) {
+  // Holds the number of distinct values of each attribute
+  size_t counts[NUM_ATTRIBUTES];
+  // Holds the planned order
+  int order[NUM_ATTRIBUTES];
+  // Walks every image
+  struct TreeCursor cursor;
+  struct TreeImage *images;
+  size_t num_images;
+  size_t i;
+  int depth_level, attribute;
+  for (depth_level = 0; depth_level < NUM_ATTRIBUTES; depth_level++) {
+    counts[tree->order[depth_level]] = tree->indexes[depth_level].count;
+  }
+  // Insertion sort the attributes by their counts [Ties keep attribute 
+  // order, so an even tree is never rebuilt]
+  for (attribute = 0; attribute < NUM_ATTRIBUTES; attribute++) {
+    for (depth_level = attribute; (depth_level > 0) && 
+	   (counts[order[depth_level - 1]] > counts[attribute]); 
+	 depth_level--) {
+      order[depth_level] = order[depth_level - 1];
+    }
+    order[depth_level] = attribute;
+  }
+  if (memcmp(order, tree->order, sizeof(order)) == 0) {
+    return 0;
+  }
+  // Collect every image, and hold on to its cargo while the nodes holding
+  // it are released
+  cursor_open(&cursor, tree, NULL);
+  images = helper_collect_images(&cursor, &num_images);
+  cursor_close(&cursor);
+  for (i = 0; i < num_images; i++) {
+    for (depth_level = 0; depth_level < NUM_LEVELS; depth_level++) {
+      intern_acquire(images[i].values[depth_level]);
+    }
+  }
+  // Rebuild the tree in the new order
+  helper_delete_path(tree, NULL, 0);
+  memcpy(tree->order, order, sizeof(order));
+  tree_bulk_insert(tree, images, num_images);
+  for (i = 0; i < num_images; i++) {
+    for (depth_level = 0; depth_level < NUM_LEVELS; depth_level++) {
+      intern_release(&tree->strings, images[i].values[depth_level]);
+    }
   }
+  free(images);
+  return 1;
 }
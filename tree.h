@@ -5,18 +5,181 @@
 #ifndef _TREE_H
 #define _TREE_H
 
+#include "arena.h"
+#include "epoch.h"
+#include "filter.h"
+#include "index.h"
+#include "intern.h"
+#include "match.h"
+#include "nodes.h"
+#include "output.h"
+#include "stats.h"
 #include "utils.h"
 
 
 struct TreeNode {
-	char *value;
+	// Interned cargo, shared by every node holding the same value
+	const struct InternedString *value;
 
         struct TreeNode *sibling;
         struct TreeNode *child;
+	// The node on the previous depth level [NULL for the root node]
+	struct TreeNode *parent;
+
+	// Sorted index of the child nodes, used for binary searches
+	struct NodeArray *children;
+	// Number of images below the node [1 for a filename node], so walks
+	// can skip whole branches
+	size_t num_images;
+};
+
+// The interned cargo of an image [Attributes 1-NUM_ATTRIBUTES; filename],
+// in attribute order whatever the order of the depth levels
+struct TreeImage {
+	const struct InternedString *values[NUM_LEVELS];
+};
+
+struct Tree {
+	// The root of the tree. Its child nodes are the first depth level nodes
+	struct TreeNode root;
+	// Holds every node, cargo and child node index of the tree
+	struct Arena arena;
+	// Holds back memory replaced by inserts until no reader can hold it
+	struct Epochs epochs;
+	// Holds the single copy of every distinct cargo value
+	struct InternTable strings;
+	// Maps the cargo of each attribute depth level to its nodes
+	struct AttributeIndex indexes[NUM_ATTRIBUTES];
+	// The attribute held by each attribute depth level [0 for Attribute 1
+	// (A1)]. In attribute order unless planned by tree_plan
+	int order[NUM_ATTRIBUTES];
+	// Rules out QUERY OPERATIONS of attribute tuples no image has
+	struct QueryFilter filter;
+	// Number of images [Filename nodes]
+	size_t num_images;
 };
 
-void tree_insert(struct TreeNode *, char **);
-void tree_search(const struct TreeNode *, char **);
-void tree_print(const struct TreeNode *);
+// Walks the images of a tree in the order of its depth levels, one image at
+// a time
+struct TreeCursor {
+	const struct TreeNode *root;
+	// The attribute held by each attribute depth level
+	const int *order;
+	// Current node at each depth level [Attributes; filename]
+	const struct TreeNode *path[NUM_LEVELS];
+	// Cargo required at each depth level [NULL unless it is exact]
+	const struct InternedString *keys[NUM_LEVELS];
+	// Range of cargo required at each depth level
+	struct AttributeMatch matches[NUM_LEVELS];
+	// Nodes to start from when an index is used [NULL walks from the root]
+	const struct NodeArray *postings;
+	size_t num_postings;
+	size_t next_posting;
+	// Depth level of the postings. Nodes up to it are never advanced
+	int pinned_level;
+	// First depth level from which every depth level matches any cargo
+	int any_level;
+	// Depth level cursor_next advances first [Above the filename after
+	// cursor_skip skips a whole branch]
+	int next_level;
+	int is_started;
+	int is_done;
+};
+
+/*
+ * One writer thread may insert [tree_insert, tree_append, tree_bulk_insert]
+ * and delete [tree_delete] while reader threads search, print, count and
+ * walk cursors. Each reader registers with epoch_register on the epochs of
+ * the tree before the writer runs alongside it, and brackets every read with
+ * epoch_enter and epoch_exit. tree_sort, tree_plan and tree_destroy must 
+ * not run alongside readers. No reader of the program runs alongside the
+ * writer [See epoch.h]; only the concurrency stress test does.
+ */
+void tree_init(struct Tree *);
+void tree_destroy(struct Tree *);
+void tree_insert(struct Tree *, char **);
+void tree_append(struct Tree *, const struct TreeImage *);
+void tree_bulk_insert(struct Tree *, struct TreeImage *, size_t);
+
+/*
+ * Delete the image of the given tokens of a DELETE OPERATION, or every 
+ * image below its values if the trailing ones are * (any value). Nodes left
+ * without child nodes are pruned. Return the number of images deleted, or
+ * -1 if a value follows a *.
+ */
+long tree_delete(struct Tree *, char **);
+
+/*
+ * Return the number of values of a DELETE OPERATION before the first *, or
+ * -1 if a value follows a * [The operation is then invalid].
+ */
+int tree_check_delete(char **);
+void tree_search(const struct Tree *, char **, struct Output *);
+void tree_print(const struct Tree *, struct Output *);
+
+/*
+ * QUERY and PRINT OPERATIONS that skip the given number of images, then 
+ * output at most the given number [PAGE_ALL for every one]. (NULL) is 
+ * output if the page is empty. Skipping costs O(log n) per depth level by
+ * the counts of images, except on a planned tree: its cursors do not run 
+ * in sorted order, so every page collects and sorts all m matching images,
+ * in O(m log m).
+ */
+void tree_search_page(const struct Tree *, char **, size_t, size_t,
+		      struct Output *);
+void tree_print_page(const struct Tree *, size_t, size_t, struct Output *);
+
+/*
+ * Return the number of images matching the tokens of a QUERY OPERATION.
+ */
+size_t tree_count(const struct Tree *, char **);
+
+/*
+ * Size the query filter of a tree for the given false positive rate [0 
+ * turns it off; FILTER_DEFAULT_RATE until set], and rebuild it. Writer 
+ * only. The rate outlives tree_destroy.
+ */
+void tree_filter(struct Tree *, double);
+
+/*
+ * Print the images below a first depth level node of a tree whose depth 
+ * levels are in attribute order, as tree_print does.
+ */
+void tree_print_branch(const struct Tree *, const struct TreeNode *,
+		       struct Output *);
+void tree_sort(struct Tree *);
+
+/*
+ * Reorder the attribute depth levels of a tree by increasing number of 
+ * distinct values, so the levels with the fewest sibling nodes are at the 
+ * top, and rebuild it if the order changed. Return 1 if it was rebuilt, or
+ * 0 if its order stands.
+ */
+int tree_plan(struct Tree *);
+
+/*
+ * Count the nodes of each depth level of a tree, and find its largest 
+ * fanouts. Not to be run alongside the writer.
+ */
+void tree_shape(const struct Tree *, struct StatsShape *);
+
+/*
+ * Cursors return images in the order of the depth levels of the tree: 
+ * sorted unless the tree is planned.
+ */
+void cursor_open(struct TreeCursor *, const struct Tree *, char **);
+int cursor_next(struct TreeCursor *, struct TreeImage *);
+
+/*
+ * Move a cursor past the given number of images without returning them, 
+ * skipping every branch all of whose images match by its count of images,
+ * and runs of such sibling nodes by the counts of the child node index 
+ * above them. Counts may include the images of an insert [OR] delete the
+ * writer is in the middle of, never fewer than the images a reader can 
+ * reach. Return the number of images skipped [Fewer once the cursor is 
+ * exhausted].
+ */
+size_t cursor_skip(struct TreeCursor *, size_t);
+void cursor_close(struct TreeCursor *);
 
 #endif /* _TREE_H */
@@ -3,20 +3,21 @@
  *  Modified by Ibrahim Jomaa on 2017-06-28.
  **/
 
+#include <errno.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
+#include "match.h"
+#include "scan.h"
 #include "utils.h"
 
-// Symbol for INSERT OPERATION: Add new image to database
-#define INSERT "i"
-// Symbol for QUERY OPERATION: Search for image in database
-#define QUERY "q"
-// Symbol for PRINT OPERATION: Output all images in database
-#define PRINT "p"
-
 /**
- *  Tokenize the string stored in cmd based on DELIMITERS as separators.
+ *  Tokenize the string stored in cmd based on DELIMITERS as separators. 
+ *  The delimiters of 64 bytes at a time are found as a bit mask by a 
+ *  vectorized scan, and every token start and end is read off the mask and
+ *  terminated in place [Unlike strtok, nothing is kept between calls, so 
+ *  several threads may tokenize at once]. A command may be of any length.
  * 
  *  @param cmd The user input to analyze.
  *  @param cmd_argv Holds the valid parsed user input.
@@ -24,59 +25,142 @@
  *  input was invalid.
  **/
 int tokenize(char *cmd, char **cmd_argv) {
-  // Holds the number of parsed tokens in a valid command. Assume we are given
-  // an invalid command
-  int num_parsed = -1;
-  // Parse the 1st token
-  char *some_token = strtok(cmd, DELIMITERS);
-  // If parsing did not fail
-  if (some_token != NULL) {
-    // If the token represents a valid operation [Either: "i"; "q"; "p"]
-    if (((some_token[0] == INSERT[0]) || (some_token[0] == QUERY[0]) || 
-	(some_token[0] == PRINT[0])) && ((some_token[1] == '\0') ||
-					 (some_token[1] == '\n'))) {
-      // Holds the number of tokens the operation must have
-      int num_tokens = 0;
-      // If the token is an INSERT OPERATION
-      if (some_token[0] == INSERT[0]) {
-	// The command should have only 5 tokens
-	num_tokens = 5;
-      }
-      // Else, if the token is a QUERY OPERATION
-      else if (some_token[0] == QUERY[0]) {
-	// The command should have only 4 tokens
-	num_tokens = 4;
-      }
-      // Else, the token is a PRINT OPERATION
-      else {
-	// The command should have only 1 token
-	num_tokens = 1;
-      }
-      // Reset the number of tokens parsed
-      num_parsed = 0;
-      // Keep parsing tokens until the required amount has been met [OR] until 
-      // there are no more tokens left to be parsed from the command
-      for ( ; (num_parsed < num_tokens) && (some_token != NULL); num_parsed++)
-	{
-	  // Add current token to our valid tokens
-	  cmd_argv[num_parsed] = some_token;
-	  // Parse the next token
-	  some_token = strtok(NULL, DELIMITERS);
-	}
-      // If the number of tokens parsed does not equal the expected amount of
-      // tokens to be parsed
-      if (num_parsed != num_tokens) {
-	// Void the number of tokens parsed
-	num_parsed = -1;
-      }
-      // Else, if the last parsed token exists
-      else if (some_token != NULL) {
-	  // Void the number of tokens parsed
-	  num_parsed = -1;
+  // Holds the end of the command
+  char *end = cmd + strlen(cmd);
+  // Holds the 64 bytes being tokenized
+  char *block;
+  // Hold bit masks of the delimiters of the block, and of the bytes that
+  // start [OR] end a token
+  unsigned long long delimiters, previous, starts, ends;
+  // Indicates if the byte before the block is a delimiter
+  unsigned long long is_delimiter = 1;
+  // Holds the number of parsed tokens
+  int num_parsed = 0;
+  // Holds the smallest and largest number of tokens the operation may 
+  // have. Assume we are given an invalid operation
+  int min_tokens = 0;
+  int max_tokens = 0;
+  // Holds the current token
+  int i;
+  for (block = cmd; block < end; block += 64) {
+    delimiters = scan_delimiter_mask(block, end);
+    // Bit i is set if the byte before byte i is a delimiter
+    previous = (delimiters << 1) | is_delimiter;
+    is_delimiter = delimiters >> 63;
+    starts = ~delimiters & previous;
+    ends = delimiters & ~previous;
+    // There cannot be more tokens than any operation has
+    if (num_parsed + __builtin_popcountll(starts) > INPUT_ARG_MAX_NUM) {
+      return -1;
+    }
+    // Add every token starting in the block to our valid tokens
+    for ( ; starts != 0; starts &= starts - 1) {
+      cmd_argv[num_parsed++] = block + __builtin_ctzll(starts);
+    }
+    // Terminate every token ending in the block in place [At the end of the
+    // command, this overwrites its terminator]
+    for ( ; ends != 0; ends &= ends - 1) {
+      block[__builtin_ctzll(ends)] = '\0';
+    }
+  }
+  // If the 1st token is a single character
+  if ((num_parsed > 0) && (cmd_argv[0][1] == '\0')) {
+    // If the token is an INSERT [OR] DELETE OPERATION
+    if ((cmd_argv[0][0] == INSERT) || (cmd_argv[0][0] == DELETE)) {
+      // The command should have only the attributes and filename
+      min_tokens = NUM_LEVELS + 1;
+      max_tokens = min_tokens;
+    }
+    // Else, if the token is a QUERY OPERATION
+    else if (cmd_argv[0][0] == QUERY) {
+      // The command should have the attributes, then maybe an offset and a
+      // limit
+      min_tokens = NUM_ATTRIBUTES + 1;
+      max_tokens = NUM_ATTRIBUTES + 3;
+    }
+    // Else, if the token is a PRINT OPERATION
+    else if (cmd_argv[0][0] == PRINT) {
+      // The command may have an offset and a limit
+      min_tokens = 1;
+      max_tokens = 3;
+    }
+    // Else, if the token is a COUNT OPERATION
+    else if (cmd_argv[0][0] == COUNT) {
+      // The command should have at least the first attribute. The rest 
+      // match any value
+      min_tokens = 2;
+      max_tokens = NUM_ATTRIBUTES + 1;
+      for (i = num_parsed; i < max_tokens; i++) {
+	cmd_argv[i] = MATCH_ANY;
       }
     }
+    // Else, if the token is a STATS or FREEZE OPERATION
+    else if ((cmd_argv[0][0] == STATS) || (cmd_argv[0][0] == FREEZE)) {
+      // The command should have only 1 token
+      min_tokens = 1;
+      max_tokens = min_tokens;
+    }
+    // Else, if the token is a SAVE, LOAD or COMPACT OPERATION
+    else if ((cmd_argv[0][0] == SAVE) || (cmd_argv[0][0] == LOAD) ||
+	     (cmd_argv[0][0] == COMPACT)) {
+      // The command should have only 2 tokens
+      min_tokens = 2;
+      max_tokens = min_tokens;
+    }
   }
   // Returns the number of valid tokens parsed from command
-  // Returns -1 if command was invalid
-  return num_parsed;
+  // Returns -1 if command was invalid [Unknown operation, or the number of 
+  // tokens is not within the expected amounts]
+  return ((min_tokens > 0) && (num_parsed >= min_tokens) && 
+	  (num_parsed <= max_tokens)) ? num_parsed : -1;
+}
+
+/**
+ *  A helper function that reads a token as a number of images.
+ *
+ *  @param token The token.
+ *  @param number Set to the number.
+ *  @return 0 on success; -1 if the token is not a decimal number.
+ **/
+static int helper_read_number(const char *token, size_t *number) {
+  char *end;
+  unsigned long long result;
+  if ((token[0] < '0') || (token[0] > '9')) {
+    return -1;
+  }
+  errno = 0;
+  result = strtoull(token, &end, 10);
+  if ((*end != '\0') || (errno == ERANGE) || (result > SIZE_MAX)) {
+    return -1;
+  }
+  *number = result;
+  return 0;
+}
+
+/**
+ *  Read the page of a QUERY [OR] PRINT OPERATION: the offset of its first
+ *  result, and the largest number of results, that may follow its values.
+ *
+ *  @param cmd_argv The tokens of the operation.
+ *  @param num_tokens The number of tokens.
+ *  @param offset Set to the offset [0 if left out].
+ *  @param limit Set to the limit [PAGE_ALL if left out].
+ *  @return 0 on success; -1 if the page is invalid.
+ **/
+int tokenize_page(char **cmd_argv, int num_tokens, size_t *offset,
+		  size_t *limit) {
+  // Holds the number of tokens before the page
+  int num_values = (cmd_argv[0][0] == QUERY) ? (NUM_ATTRIBUTES + 1) : 1;
+  *offset = 0;
+  *limit = PAGE_ALL;
+  if ((num_tokens > num_values) && 
+      (helper_read_number(cmd_argv[num_values], offset) == -1)) {
+    return -1;
+  }
+  if ((num_tokens > num_values + 1) && 
+      ((helper_read_number(cmd_argv[num_values + 1], limit) == -1) ||
+       (*limit == 0))) {
+    return -1;
+  }
+  return 0;
 }
@@ -5,15 +5,64 @@
 #ifndef _UTILS_H
 #define _UTILS_H
 
-#define INPUT_ARG_MAX_NUM	5
-#define BUFFER_SIZE	256
+#include <stddef.h>
+#include <stdint.h>
+
+// Number of attributes of an image. Build with "make clean; make 
+// NUM_ATTRIBUTES=n" for another number
+#ifndef NUM_ATTRIBUTES
+#define NUM_ATTRIBUTES	3
+#endif
+// Number of depth levels of the database [Attributes; filename]
+#define NUM_LEVELS	(NUM_ATTRIBUTES + 1)
+// A QUERY OPERATION may be followed by an offset and a limit
+#define INPUT_ARG_MAX_NUM	(NUM_ATTRIBUTES + 3)
 #define DELIMITERS	" \n"
+#define ERROR_MSG	"Invalid command.\n"
+
+// Symbol for INSERT OPERATION: Add new image to database
+#define INSERT	'i'
+// Symbol for DELETE OPERATION: Remove an image [OR] a branch from database
+#define DELETE	'd'
+// Symbol for QUERY OPERATION: Search for image in database
+#define QUERY	'q'
+// Symbol for PRINT OPERATION: Output all images in database
+#define PRINT	'p'
+// Symbol for STATS OPERATION: Output statistics of the database
+#define STATS	's'
+// Symbol for SAVE OPERATION: Write the database to a snapshot file
+#define SAVE	'w'
+// Symbol for LOAD OPERATION: Replace the database with a snapshot file
+#define LOAD	'l'
+// Symbol for COMPACT OPERATION: Fold the journal into a snapshot file
+#define COMPACT	'k'
+// Symbol for FREEZE OPERATION: Flatten the database for reading
+#define FREEZE	'f'
+// Symbol for COUNT OPERATION: Output the number of images matching 
+// attributes
+#define COUNT	'c'
+// Limit of a QUERY [OR] PRINT OPERATION given no limit
+#define PAGE_ALL	SIZE_MAX
+// Parameters of the 32-bit FNV-1a hash, by which strings are interned, 
+// QUERY OPERATIONS cached and journal records checked
+#define FNV_OFFSET_BASIS	2166136261u
+#define FNV_PRIME	16777619u
 
 
 /*
- * Tokenize the string stored in cmd based on DELIMITERS as separators.
- * Return the number of tokens, and store pointers to them in cmd_argv.
+ * Tokenize the string stored in cmd based on DELIMITERS as separators, in
+ * place. Return the number of tokens, and store pointers to them in 
+ * cmd_argv; or return -1 if the command is invalid. The first token is the
+ * symbol of the operation. The command may be of any length. The values a
+ * COUNT OPERATION leaves out are stored as * (any value).
  */
 int tokenize(char *, char **);
 
+/*
+ * Read the offset and limit that may follow the values of a QUERY [OR] 
+ * PRINT OPERATION of the given number of tokens [0 and PAGE_ALL if left
+ * out]. Return 0, or -1 if either is not a number or the limit is 0.
+ */
+int tokenize_page(char **, int, size_t *, size_t *);
+
 #endif /* _UTILS_H */